@@ -0,0 +1,292 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include <functional>
+#include <sstream>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "async_stdin.hpp"
+#include "latency_stats.hpp"
+
+namespace protoserv
+{
+// @brief Writes metrics in the Prometheus text exposition format
+class metrics_writer
+{
+public:
+    explicit metrics_writer(std::ostream& os)
+        : os_(os)
+    {
+    }
+
+    // @brief Starts a metric family, type is one of counter, gauge, histogram
+    void family(const std::string& name, const char* type, const char* help)
+    {
+        os_ << "# HELP " << name << ' ' << help << '\n'
+            << "# TYPE " << name << ' ' << type << '\n';
+    }
+
+    // @brief Writes a single sample, labels go in the form of key="value",... or empty
+    template <typename T>
+    void sample(const std::string& name, const std::string& labels, T value)
+    {
+        os_ << name;
+        if (!labels.empty())
+        {
+            os_ << '{' << labels << '}';
+        }
+        os_ << ' ' << value << '\n';
+    }
+
+    // @brief Writes the cumulative buckets, the sum and the count of the histogram
+    void histogram(const std::string& name, const std::string& labels, const latency_histogram& h)
+    {
+        auto prefix = labels.empty() ? labels : labels + ",";
+
+        // the trailing empty buckets are implied by +Inf, skip them to keep the scrape small
+        int last = 0;
+        for (int i = 0; i < latency_histogram::bucket_count; ++i)
+        {
+            if (h.bucket_size(i))
+            {
+                last = i;
+            }
+        }
+
+        uint64_t cumulative = 0;
+        for (int i = 0; i <= last; ++i)
+        {
+            cumulative += h.bucket_size(i);
+            os_ << name << "_bucket{" << prefix << "le=\"" << latency_histogram::bucket_bound(i)
+                << "\"} " << cumulative << '\n';
+        }
+        os_ << name << "_bucket{" << prefix << "le=\"+Inf\"} " << h.count() << '\n';
+
+        sample(name + "_sum", labels, h.sum());
+        sample(name + "_count", labels, h.count());
+    }
+
+private:
+    std::ostream& os_;
+};
+
+/*
+@class admin_endpoint
+@description
+Administrative listener, TCP or UNIX domain socket. Speaks two protocols:
+- a line protocol, every line is a command (the stdin command set), the reply is the command output;
+- HTTP GET /metrics, the reply is the metrics in the Prometheus text format.
+The requests are posted to the io_service rather than served in place,
+so that they queue behind the network events which are ready already.
+A connection sending a line longer than max_line_length is closed.
+*/
+template <typename Protocol>
+class admin_endpoint
+{
+public:
+    using protocol_type = Protocol;
+    using endpoint_type = typename Protocol::endpoint;
+    using acceptor_type = typename Protocol::acceptor;
+    using socket_type = typename Protocol::socket;
+    using error_code = boost::system::error_code;
+
+    // @brief The longest request or header line accepted
+    static constexpr size_t max_line_length = 8 * 1024;
+
+    // @brief Command event, the output goes to the stream
+    std::function<void(const command&, std::ostream&)> onCommand;
+
+    // @brief Metrics scrape event
+    std::function<void(metrics_writer&)> onScrape;
+
+    admin_endpoint(boost::asio::io_service& service, const endpoint_type& endpoint)
+        : service_(service)
+        , acceptor_(service, endpoint)
+        , next_socket_(service)
+    {
+        onCommand = [](auto&, auto&) {};
+        onScrape = [](auto&) {};
+
+        do_accept();
+    }
+
+    admin_endpoint(const admin_endpoint&) = delete;
+    admin_endpoint& operator =(const admin_endpoint&) = delete;
+
+    // @brief Stops accepting new connections
+    void close()
+    {
+        error_code ec;
+        acceptor_.close(ec);
+    }
+
+    // @brief Returns the local endpoint, handy if bound to port 0
+    endpoint_type local_endpoint() const
+    {
+        return acceptor_.local_endpoint();
+    }
+
+private:
+    // @brief A single admin connection, owned by its pending operations
+    class connection : public std::enable_shared_from_this<connection>
+    {
+    public:
+        connection(admin_endpoint& owner, socket_type socket)
+            : owner_(owner)
+            , socket_(std::move(socket))
+            , input_(max_line_length)
+        {
+        }
+
+        // @brief Reads the next request line
+        void read_line()
+        {
+            auto self = this->shared_from_this();
+            boost::asio::async_read_until(socket_, input_, '\n', [self](error_code err, size_t)
+            {
+                if (!err)
+                {
+                    self->handle_line();
+                }
+            });
+        }
+
+    private:
+        // @brief Tells an HTTP request from a command
+        void handle_line()
+        {
+            std::string line;
+            std::istream is(&input_);
+            std::getline(is, line);
+            boost::algorithm::trim(line);
+
+            if (boost::algorithm::starts_with(line, "GET "))
+            {
+                read_http_headers(line);
+            }
+            else if (line.empty())
+            {
+                read_line();
+            }
+            else
+            {
+                auto self = this->shared_from_this();
+                owner_.service_.post([self, line]()
+                {
+                    command cmd;
+                    cmd.parse(line);
+
+                    std::ostringstream os;
+                    self->owner_.onCommand(cmd, os);
+                    self->write(os.str(), false);
+                });
+            }
+        }
+
+        // @brief Skips the HTTP headers up to the empty line, replies with the metrics
+        void read_http_headers(const std::string& request_line)
+        {
+            std::vector<std::string> parts;
+            boost::algorithm::split(parts, request_line, boost::is_any_of(" "));
+            auto found = parts.size() > 1 && (parts[1] == "/metrics" || parts[1] == "/");
+
+            skip_http_headers(found);
+        }
+
+        // @brief Reads the header lines one by one until the empty one
+        void skip_http_headers(bool found)
+        {
+            auto self = this->shared_from_this();
+            boost::asio::async_read_until(socket_, input_, '\n', [self, found](error_code err, size_t)
+            {
+                if (err)
+                {
+                    return;
+                }
+
+                std::string line;
+                std::istream is(&self->input_);
+                std::getline(is, line);
+                boost::algorithm::trim(line);
+
+                if (!line.empty())
+                {
+                    self->skip_http_headers(found);
+                    return;
+                }
+
+                self->owner_.service_.post([self, found]()
+                {
+                    self->write(found ? self->scrape() : "HTTP/1.0 404 Not Found\r\n\r\n", true);
+                });
+            });
+        }
+
+        // @brief Renders the metrics along with the HTTP header
+        std::string scrape()
+        {
+            std::ostringstream body;
+            metrics_writer writer(body);
+            owner_.onScrape(writer);
+
+            auto text = body.str();
+            std::ostringstream os;
+            os << "HTTP/1.0 200 OK\r\n"
+               << "Content-Type: text/plain; version=0.0.4\r\n"
+               << "Content-Length: " << text.size() << "\r\n\r\n"
+               << text;
+            return os.str();
+        }
+
+        // @brief Sends the reply, then either closes the connection or reads the next line
+        void write(std::string reply, bool close)
+        {
+            output_ = std::move(reply);
+
+            auto self = this->shared_from_this();
+            boost::asio::async_write(socket_, boost::asio::buffer(output_), [self, close](error_code err, size_t)
+            {
+                if (!err && !close)
+                {
+                    self->read_line();
+                }
+                else
+                {
+                    error_code ec;
+                    self->socket_.shutdown(socket_type::shutdown_both, ec);
+                    self->socket_.close(ec);
+                }
+            });
+        }
+
+        admin_endpoint& owner_;
+        socket_type socket_;
+        boost::asio::streambuf input_;
+        std::string output_;
+    };
+
+    // @brief Accepts incoming admin connection
+    void do_accept()
+    {
+        acceptor_.async_accept(next_socket_, [this](error_code err)
+        {
+            if (!err)
+            {
+                std::make_shared<connection>(*this, std::move(next_socket_))->read_line();
+                next_socket_ = socket_type(service_);
+                do_accept();
+            }
+        });
+    }
+
+    boost::asio::io_service& service_;
+    acceptor_type acceptor_;
+    socket_type next_socket_;
+};
+
+} // namespace protoserv
@@ -132,6 +132,13 @@ public:
         session_->send(get_message_id<T>(), message);
     }
 
+    // @brief Sends protobuf message the server drops unhandled once the deadline passes
+    template <typename T>
+    void send(const T& message, std::chrono::system_clock::time_point deadline)
+    {
+        session_->send(get_message_id<T>(), message, deadline_ns(deadline));
+    }
+
     template <typename T>
     void send(int messageId, const T& message)
     {
@@ -233,6 +240,11 @@ public:
         }
     }
 
+    // @brief Read completion event handler. TODO: remove from public
+    void notify_read_complete(session_type&)
+    {
+    }
+
     // TODO: remove from public
     void remove_session(session_type* session)
     {
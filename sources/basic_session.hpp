@@ -12,12 +12,46 @@
 #include <limits>
 #include <string>
 #include <any>
+#include <vector>
+#include <functional>
+#include <cstring>
+#include <random>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <linux/net_tstamp.h>
+#include <time.h>
+#include <unistd.h>
+#endif
 
 #include "session_buffers.hpp"
+#include "session_policy.hpp"
+#include "latency_stats.hpp"
+#include "tcp_info.hpp"
+#include "tls.hpp"
+#include "flow_control.hpp"
+#include "deadline.hpp"
+#include "stream_resume.hpp"
+#include "reply_order.hpp"
 #include "message.hpp"
 
 namespace protoserv
 {
+/*
+@description
+Turns on the kernel software receive timestamps (SO_TIMESTAMPING) on the socket.
+Accepted sockets inherit the setting from the listening one.
+*/
+inline bool set_rx_timestamping(int fd)
+{
+#ifdef __linux__
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    return ::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0;
+#else
+    return false;
+#endif
+}
+
 /*
 @class protobuf_packet
 @description
@@ -46,17 +80,118 @@ public:
         static_cast<Derived*>(this)->send(buf, size);
     }
 
-    void handle_message(uint16_t* header)
+    /*
+    @description
+    Sends the message preceded by a deadline frame, both in one go,
+    so that the flow control parks or passes them together
+    */
+    void send(int messageType, const google::protobuf::Message& msg, int64_t deadline)
+    {
+        if (!deadline)
+        {
+            send(messageType, msg);
+            return;
+        }
+
+        constexpr auto header_size = 2 * sizeof(uint16_t);
+        const auto message_size = msg.ByteSize();
+        const auto size = header_size + message_size;
+        assert(size <= std::numeric_limits<uint16_t>::max());
+
+        auto buf = static_cast<uint16_t*>(alloca(deadline_frame_size + size));
+        buf[0] = static_cast<uint16_t>(deadline_frame_size);
+        buf[1] = deadline_message_type;
+        std::memcpy(&buf[2], &deadline, sizeof(deadline));
+
+        auto frame = buf + deadline_frame_size / sizeof(uint16_t);
+        frame[0] = static_cast<uint16_t>(size);
+        frame[1] = messageType;
+        msg.SerializePartialToArray(&frame[2], message_size);
+
+        static_cast<Derived*>(this)->send(buf, deadline_frame_size + size);
+    }
+
+    void handle_message(uint16_t* header, int64_t rx_time = 0, int64_t deadline = 0)
     {
         Message msg{ 0 };
         msg.type = header[1];
         msg.size = header[0] - 4;
         msg.data = &header[2];
+        msg.rx_time = rx_time;
+        msg.deadline = deadline;
 
         static_cast<Derived*>(this)->notify_message(msg);
     }
 };
 
+/*
+@description
+Serializes the message into a complete frame, the size and type header
+included, ready for basic_session::send_encoded()
+*/
+inline std::string encode_packet(int messageType, const google::protobuf::Message& msg)
+{
+    const auto size = 2 * sizeof(uint16_t) + msg.ByteSize();
+    assert(size <= std::numeric_limits<uint16_t>::max());
+
+    std::string ret(size, '\0');
+    auto buf = reinterpret_cast<uint16_t*>(&ret[0]);
+    buf[0] = static_cast<uint16_t>(size);
+    buf[1] = messageType;
+    msg.SerializePartialToArray(&buf[2], static_cast<int>(size - 2 * sizeof(uint16_t)));
+    return ret;
+}
+
+/*
+@class session_handoff
+@description
+What a session takes along to another loop, see basic_session::hand_off():
+the socket, the bytes of the frame partially received, the bytes not written
+yet, the flow control state and the user data. Closes the socket if dropped
+without being taken over.
+*/
+struct session_handoff
+{
+    session_handoff() = default;
+
+    session_handoff(session_handoff&& rhs)
+        : fd(rhs.release())
+        , unread(std::move(rhs.unread))
+        , unsent(std::move(rhs.unsent))
+        , flow(std::move(rhs.flow))
+        , flow_initiator(rhs.flow_initiator)
+        , user(std::move(rhs.user))
+    {
+    }
+
+    session_handoff& operator =(session_handoff&&) = delete;
+
+    ~session_handoff()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+#endif
+    }
+
+    // @brief Gives the socket up to the caller
+    int release()
+    {
+        auto ret = fd;
+        fd = -1;
+        return ret;
+    }
+
+    int fd = -1;
+    std::string unread;
+    std::string unsent;
+    std::unique_ptr<credit_flow> flow;
+    bool flow_initiator = false;
+    std::any user;
+};
+
 /*
 @class basic_session
 @brief Low-level session operations
@@ -71,10 +206,13 @@ Network packet format
 
 <Message> support 2 formats:
 - Protobuf <Message> format
+
+The read/write buffer layout is defined by the Policy, see session_policy.
 */
 template <
     class Derived,
-    typename Formatter = protobuf_packet<Derived>
+    typename Formatter = protobuf_packet<Derived>,
+    typename Policy = default_session_policy
     >
 class basic_session: public Formatter
 {
@@ -83,13 +221,17 @@ public:
 
     using clock_type = std::chrono::steady_clock;
     using tcp = boost::asio::ip::tcp;
+    using policy_type = Policy;
     using Formatter::send;
     using Formatter::handle_message;
 
+    // @brief Receives the outgoing bytes of a loopback session, nullptr and zero mean disconnect
+    using loopback_sink = std::function<void(const void*, size_t)>;
+
     explicit basic_session(tcp::socket socket)
         : socket_(std::move(socket))
     {
-        readbuf_.reserve(2 * 1024);
+        readbuf_.reserve(Policy::read_buffer_size);
     }
 
     void connect(tcp::socket&& socket)
@@ -116,6 +258,7 @@ public:
         boost::system::error_code ec;
         socket_.close(ec);
         connected_ = false;
+        alive_.reset();
     }
 
     /*
@@ -143,314 +286,1406 @@ public:
     /*
     @description
     Initiates IO on the server socket. Perhaps, this method does not belong here.
-    The initiated IO includes both write and read operations.
+    The initiated IO includes both write and read operations. With TLS enabled
+    the handshake goes first, the session is connected once it is done.
     */
     void start()
     {
-        set_connected();
-        do_read_recurring();
-        do_write();
+        boost::system::error_code ec;
+        remote_endpoint_ = socket_.remote_endpoint(ec);
+
+        if (tls_context_)
+        {
+            tls_ = std::make_unique<tls_channel>(*tls_context_, socket_.native_handle(),
+                                                 remote_endpoint_.address().to_string());
+            socket_.non_blocking(true, ec);
+            do_tls_handshake();
+            return;
+        }
+
+        start_io();
     }
 
     /*
     @description
-    Check if socket is connected or not, soft of. It does not perform
-    any network operation, and it does not know the actual state of the connection
+    Makes the session speak TLS with the given context, takes effect when
+    the session starts. The context must outlive the session. Once the handshake
+    is done, the encryption is left to the kernel if kTLS is available, and
+    done in userspace otherwise, see kernel_tls().
     */
-    bool connected() const
+    void enable_tls(tls_context& ctx)
     {
-        return connected_;
+        tls_context_ = &ctx;
     }
 
     /*
     @description
-    Asynchronously connects to the given endpoint. Calls the handler when successful
-    or error occurs.
+    Checks if the session has completed the TLS handshake
     */
-    void async_connect(tcp::endpoint endpoint, std::function<void(boost::system::error_code)> handler)
+    bool tls_enabled() const
     {
-        socket_.async_connect(endpoint, handler);
+        return tls_ && connected_;
     }
 
     /*
     @description
-    A session has an assosicated last activity timeout. This function would
-    close the session (with all notifications) if the timeout expires.
-    Expects a std::chrono family parameter (e.g. std::chrono::milliseconds{10})
+    Checks if the kernel does the TLS record encryption in both directions,
+    the session IO is then the same as on a plain socket
     */
-    template <typename Duration>
-    void disconnect_inactive(Duration duration)
+    bool kernel_tls() const
     {
-        auto inactivity = clock_type::now() - last_activity_;
-        if (inactivity > duration)
-        {
-            orderly_disconnect();
-        }
+        return tls_ && tls_->kernel_send() && tls_->kernel_recv();
     }
 
     /*
     @description
-    Reads the socket, the number of bytes read is unknown and depends on the network, the peer,
-    the OS etc. Once read, tries to parse the data and fire notifications.
+    Turns on the credit flow control: the peer may send up to the given number
+    of messages (and bytes, unless zero) not yet passed to the handlers.
+    The initiating side opens the window as soon as it connects, the other one
+    answers the first grant it receives. Call before the session starts.
     */
-    void read_some()
+    void enable_flow_control(uint32_t messages, uint32_t bytes, bool initiate)
     {
-        struct read_once
-        {
-            explicit read_once(basic_session& s) : session(s) { }
-            ~read_once()
-            {
-                session.readbuf_.grow_capacity();
-            }
-            basic_session& session;
-        };
-        do_read<read_once>();
+        flow().set_window(messages, bytes);
+        flow_initiator_ = initiate;
     }
 
     /*
     @description
-    Associates some user data with the connection. The user data may
-    be stored in-place, along with the session object inself, but this
-    depends on sizeof(T)
+    Limits the bytes parked out of credit, the session is closed if the peer
+    does not grant enough to stay below, see credit_flow::park()
     */
-    template <typename T>
-    void set_user_data(T&& t)
+    void limit_parked_bytes(size_t bytes)
     {
-        user_ = std::forward<T>(t);
+        flow().set_park_limit(bytes);
     }
 
     /*
     @description
-    Returns session user data previously set by set_user_data.
-    Make sure you pass the same type in the template paramter.
+    Out of credit, keeps only the latest unsent message of the given type
+    instead of queueing them all. Suits the snapshot-like messages (prices, states).
     */
-    template <typename T>
-    T& get_user_data()
+    void conflate(int messageType, bool conflated = true)
     {
-        return *std::any_cast<T>(&user_);
+        flow().set_conflated(static_cast<uint16_t>(messageType), conflated);
     }
 
     /*
     @description
-    Tries to obtain the associated user data. Returns nullptr if
-    not matching type is requested.
+    Sends a frame encoded beforehand, see encode_packet(). Skips the serialization,
+    the rest (flow control, buffering) is the same as for send().
     */
-    template <typename T>
-    T* get_user_data_if()
+    void send_encoded(const void* frame, size_t len)
     {
-        if (user_.has_value())
+        send(frame, len);
+    }
+
+    /*
+    @description
+    Copies every frame sent from now on to the string as well, nullptr stops.
+    Lets the response cache keep the reply a handler sends.
+    */
+    void capture_sent(std::string* into)
+    {
+        capture_ = into;
+    }
+
+    /*
+    @description
+    Sends a sequence of frames encoded beforehand, a frame per buffer.
+    Every frame takes the send() path, the write waits for the whole sequence
+    though, so the frames sent in one go go out in a single write.
+    */
+    template <typename ConstBufferSequence>
+    void send_encoded(const ConstBufferSequence& frames)
+    {
+        auto corked = corked_;
+        corked_ = true;
+        for (auto& b : frames)
         {
-            return std::any_cast<T>(&user_);
+            send(b.data(), b.size());
         }
-        return nullptr;
-    }
+        corked_ = corked;
 
-private:
+        if (connected_ && !corked_ && !write_in_progress_)
+        {
+            do_write();
+        }
+    }
 
     /*
     @description
-    Changes the state of the session to "connected", fires a notificatoin
+    Number of received bytes queued behind the message being handled,
+    i.e. read from the socket but not parsed yet
     */
-    void set_connected()
+    size_t queued_read_bytes() const
     {
-        assert(socket_.is_open());
-        connected_ = true;
-        static_cast<Derived*>(this)->notify_connected();
-        refresh_activity();
+        return queued_read_bytes_;
     }
 
+    /*
+    @description
+    Makes the session serve resumable streams: once the peer asks to resume
+    a stream (see resume_on_reconnect()), the session numbers the frames it sends
+    and keeps the latest ones in the stream ring. The registry must outlive the session.
+    */
+    void enable_resume(stream_registry& streams)
+    {
+        streams_ = &streams;
+    }
 
     /*
     @description
-    Schedules an async write operation, copies the data to the internal write buffer first
+    Asks the peer to number the frames it sends, and on every (re)connect
+    to resume the stream where it stopped. If the peer can't send all the missed
+    frames, the handler gets the sequence number expected and the one the stream
+    continues with, the messages in between are lost: time to take a snapshot.
     */
-    void send(const void* buf, size_t len)
+    void resume_on_reconnect(std::function<void(uint64_t, uint64_t)> gap_handler)
     {
+        if (!resume_id_)
+        {
+            std::random_device rd;
+            resume_id_ = (static_cast<uint64_t>(rd()) << 32 | rd()) | 1;
+        }
+        on_gap_ = std::move(gap_handler);
         if (connected_)
         {
-            writebuf_.append(buf, len);
-            if (!write_in_progress_)
-            {
-                do_write();
-            }
+            send_resume_request();
         }
     }
 
     /*
     @description
-    The class schedules an async read operation on the given session.
-    This could be a one-chance operation, or a series of recurrings reads.
+    The sequence number of the next frame expected from the peer, see resume_on_reconnect()
     */
-    class read_scheduler
+    uint64_t next_sequence() const
     {
-    public:
-        explicit read_scheduler(basic_session& session)
-            : session_(session)
-            , postpone_(!session.readbuf_.free_capacity())
+        return next_seq_;
+    }
+
+    /*
+    @description
+    Reserves the place of the reply to the request being handled, the handler
+    sends it later through the token returned. Until then, the frames the session
+    sends are held, see reply_order; the requests that follow are handled meanwhile.
+    The handler keeps the token and returns void, the last copy dropped cancels the reply.
+    */
+    deferred_reply defer_reply()
+    {
+        if (!connected_)
         {
-            if (!postpone_)
-            {
-                session_.do_read<read_scheduler>();
-            }
+            return deferred_reply();
         }
-
-        ~read_scheduler()
+        if (!order_)
         {
-            if (postpone_)
+            order_ = std::make_shared<reply_order>([this](const void* buf, size_t len)
             {
-                session_.readbuf_.grow_capacity();
-                session_.do_read<read_scheduler>();
-            }
+                send_ordered(buf, len);
+            });
+            order_->set_hold_limit(hold_limit_);
         }
-
-    private:
-        basic_session& session_;
-        bool postpone_ = false;
-    };
+        return deferred_reply(order_, order_->reserve());
+    }
 
     /*
     @description
-    Schedules a recurring read operation, meaning if one operation ends,
-    the next one gets scheduled at once
+    Returns the number of the deferred replies not sent yet, see defer_reply()
     */
-    void do_read_recurring()
+    size_t deferred_replies() const
     {
-        do_read<read_scheduler>();
+        return order_ ? order_->deferred() : 0;
     }
 
     /*
     @description
-    Schedules an async read operation
+    Limits the bytes held behind the deferred replies, the session is closed
+    if a reply keeps them waiting past the limit, see reply_order::send()
     */
-    template <typename Scheduler>
-    void do_read()
+    void limit_held_bytes(size_t bytes)
     {
-        assert(readbuf_.free_capacity() > 0);
-
-        schedule_operation();
-
-        socket_.async_read_some(get_read_buffer(), [this](auto err, size_t len)
+        hold_limit_ = bytes;
+        if (order_)
         {
-            complete_operation();
+            order_->set_hold_limit(bytes);
+        }
+    }
 
-            if (!err)
-            {
-                readbuf_.grow(len);
-                Scheduler scheduler(*this);
-                process_read_data();
-            }
-            else
-            {
-                orderly_disconnect();
-            }
-        });
+    /*
+    @description
+    Returns the number of frames dropped since the frames held behind
+    the deferred replies would exceed the limit, each closes the session
+    */
+    uint64_t held_overflows() const
+    {
+        return held_overflows_;
     }
 
     /*
     @description
-    Wraps the free part of the read buffer in an asio structere, for asio to
-    be able to consume it.
+    Returns the number of requests dropped unparsed since their deadline had passed
     */
-    auto get_read_buffer()
+    uint64_t expired_requests() const
     {
-        assert(readbuf_.free_capacity() > 0);
-        return boost::asio::buffer(readbuf_.end(), readbuf_.free_capacity());
+        return expired_requests_;
     }
 
     /*
     @description
-    Parses the read buffer and fires notifications on protobuf messages if any parsed.
+    Returns the flow control state, nullptr if the session never used it
     */
-    void process_read_data()
+    const credit_flow* flow_control() const
     {
-        parse_read_buffer();
-        refresh_activity();
+        return flow_.get();
     }
 
     /*
     @description
-    Schedules an async write operation. If another write operation is in flight,
-    then does nothing, the re-scheduling would be performed by the other operation.
+    Starts the session on an in-process transport instead of the socket.
+    The outgoing bytes are passed to the sink synchronously, as they are sent,
+    the incoming ones are fed with loopback_receive(). The framing, parsing
+    and notifications are those of a socket session.
     */
-    void do_write()
+    void start_loopback(loopback_sink sink)
     {
-        if (!writebuf_.empty())
-        {
-            auto& buf = writebuf_.flip();
-            write_in_progress_.store(true);
-            do_write(buf);
-        }
-        else
-        {
-            write_in_progress_.store(false);
-        }
+        loopback_ = std::move(sink);
+        set_connected();
     }
 
     /*
     @description
-    Asks asio to perform an async write operation on the given write buffer
+    Feeds the bytes sent by the loopback peer, parses them and fires notifications
+    at once. Zero length means the peer is gone. Bytes fed from within a handler
+    of this session are parsed after the handler returns.
     */
-    void do_write(writebuf& buf)
+    void loopback_receive(const void* buf, size_t len)
     {
-        using boost::system::error_code;
-        boost::container::small_vector<boost::asio::const_buffer, 8> asioBuf;
+        if (!connected_)
+        {
+            return;
+        }
+        if (!len)
+        {
+            orderly_disconnect();
+            return;
+        }
 
-        // wrap the write buffer with asio buffer
-        buf.foreach([&asioBuf](auto & b)
+        auto bytes = static_cast<const uint8_t*>(buf);
+        if (loopback_busy_)
         {
-            asioBuf.emplace_back(b.begin(), b.size());
-        });
+            loopback_backlog_.insert(loopback_backlog_.end(), bytes, bytes + len);
+            return;
+        }
 
+        // the pending operation keeps the session alive while its handlers run
+        loopback_busy_ = true;
         schedule_operation();
 
-        boost::asio::async_write(socket_, asioBuf,
-                                 [this, &buf](error_code err, size_t bytesTransfered)
+        feed_loopback(bytes, len);
+        while (!loopback_backlog_.empty() && connected_)
         {
-            complete_operation();
-
-            if (err)
-            {
-                // we got an error, close the session and fire the notification
-                orderly_disconnect();
-            }
-            else
-            {
+            std::vector<uint8_t> backlog;
+            backlog.swap(loopback_backlog_);
+            feed_loopback(backlog.data(), backlog.size());
+        }
+        loopback_backlog_.clear();
 
-                buf.clear();
+        loopback_busy_ = false;
+        complete_operation();
 
-                if (writebuf_.empty())
-                {
-                    // no more data in the write buffer
-                    write_in_progress_.store(false);
-                }
-                else
-                {
-                    // schedule another write if the write buffer has any data
-                    do_write(writebuf_.flip());
-                }
-            }
-        });
+        if (!connected_ && !outstanding_ops_)
+        {
+            static_cast<Derived*>(this)->handle_disconnected_session();
+        }
     }
 
     /*
     @description
-    Parse the read buffer.
+    Returns a token which expires once the session disconnects. The code
+    answering the session later on keeps it along with the session reference,
+    the pooled session object may serve another peer by then.
     */
-    void parse_read_buffer()
+    std::weak_ptr<const void> alive_token() const
     {
-        auto buf = readbuf_.begin();
-        auto beg = buf;
-        auto end = readbuf_.end();
+        return alive_;
+    }
 
-        // unless we receive 4 bytes, we can't parse the message header
-        while (end - buf >= 4)
+    /*
+    @description
+    Check if socket is connected or not, soft of. It does not perform
+    any network operation, and it does not know the actual state of the connection
+    */
+    bool connected() const
+    {
+        return connected_;
+    }
+
+    /*
+    @description
+    Asynchronously connects to the given endpoint. Calls the handler when successful
+    or error occurs.
+    */
+    void async_connect(tcp::endpoint endpoint, std::function<void(boost::system::error_code)> handler)
+    {
+        socket_.async_connect(endpoint, handler);
+    }
+
+    /*
+    @description
+    A session has an assosicated last activity timeout. This function would
+    close the session (with all notifications) if the timeout expires.
+    Expects a std::chrono family parameter (e.g. std::chrono::milliseconds{10})
+    */
+    template <typename Duration>
+    void disconnect_inactive(Duration duration)
+    {
+        auto inactivity = clock_type::now() - last_activity_;
+        if (inactivity > duration)
+        {
+            orderly_disconnect();
+        }
+    }
+
+    /*
+    @description
+    Returns the read buffer memory to the allocator if the session has been quiet
+    for longer than the given duration. The pending read is cancelled and
+    re-scheduled on a smaller buffer. Expects a std::chrono family parameter.
+    */
+    template <typename Duration>
+    void release_idle_read_buffer(Duration duration)
+    {
+        auto inactivity = clock_type::now() - last_activity_;
+        if (connected_ && outstanding_ops_ && !write_in_progress_ && !release_pending_ && !handoff_
+                && inactivity > duration && readbuf_.releasable())
+        {
+            release_pending_ = true;
+            boost::system::error_code ec;
+            socket_.cancel(ec);
+        }
+    }
+
+    /*
+    @description
+    Ensures the read buffer capacity, intended to be called before the session starts
+    */
+    void reserve_read_buffer(size_t bytes)
+    {
+        readbuf_.reserve(bytes);
+    }
+
+    /*
+    @description
+    Sets the size of the write buffer chunks allocated once the first one is full,
+    zero means the policy default. Intended to be called before the session starts.
+    */
+    void set_write_chunk_size(size_t bytes)
+    {
+        writebuf_.set_chunk_size(bytes);
+    }
+
+    /*
+    @description
+    Returns the number of bytes currently held by the session read buffer
+    */
+    size_t read_buffer_bytes() const
+    {
+        return readbuf_.capacity();
+    }
+
+    /*
+    @description
+    Asks the kernel to timestamp the incoming packets (SO_TIMESTAMPING, software RX),
+    takes effect when the session starts. The socket is then read with recvmsg to collect
+    the timestamps along with the data. Silently falls back to the regular reads
+    if the platform does not support it, see rx_timestamps_enabled().
+    */
+    void enable_rx_timestamps()
+    {
+        rx_timestamps_requested_ = true;
+    }
+
+    /*
+    @description
+    Checks if the kernel receive timestamps are being collected
+    */
+    bool rx_timestamps_enabled() const
+    {
+        return rx_timestamps_;
+    }
+
+    /*
+    @description
+    Kernel receive timestamp of the last read in nanoseconds since epoch,
+    zero unless rx timestamps are enabled and supported.
+    */
+    int64_t rx_time() const
+    {
+        return rx_time_;
+    }
+
+    /*
+    @description
+    Starts collecting the latency breakdown into the given stats,
+    nullptr stops it. The stats must outlive the session.
+    */
+    void set_latency_stats(latency_stats* stats)
+    {
+        latency_ = stats;
+    }
+
+    /*
+    @description
+    Returns the peer address, as of the moment the session was started
+    */
+    const tcp::endpoint& remote_endpoint() const
+    {
+        return remote_endpoint_;
+    }
+
+    /*
+    @description
+    Returns the moment the session last received any data
+    */
+    clock_type::time_point last_activity() const
+    {
+        return last_activity_;
+    }
+
+    /*
+    @description
+    Takes a fresh TCP_INFO sample of the connection, see tcp_info()
+    */
+    void sample_tcp_info()
+    {
+        if (connected_)
+        {
+            protoserv::sample_tcp_info(socket_.native_handle(), tcp_info_);
+        }
+    }
+
+    /*
+    @description
+    Returns the last TCP_INFO sample, check sampled_at for its age
+    */
+    const tcp_sample& tcp_info() const
+    {
+        return tcp_info_;
+    }
+
+    /*
+    @description
+    Reads the socket, the number of bytes read is unknown and depends on the network, the peer,
+    the OS etc. Once read, tries to parse the data and fire notifications.
+    */
+    void read_some()
+    {
+        struct read_once
+        {
+            explicit read_once(basic_session& s) : session(s) { }
+            ~read_once()
+            {
+                session.readbuf_.grow_capacity();
+            }
+            basic_session& session;
+        };
+        do_read<read_once>();
+    }
+
+    /*
+    @description
+    Associates some user data with the connection. The user data may
+    be stored in-place, along with the session object inself, but this
+    depends on sizeof(T)
+    */
+    template <typename T>
+    void set_user_data(T&& t)
+    {
+        user_ = std::forward<T>(t);
+    }
+
+    /*
+    @description
+    Returns session user data previously set by set_user_data.
+    Make sure you pass the same type in the template paramter.
+    */
+    template <typename T>
+    T& get_user_data()
+    {
+        return *std::any_cast<T>(&user_);
+    }
+
+    /*
+    @description
+    Tries to obtain the associated user data. Returns nullptr if
+    not matching type is requested.
+    */
+    template <typename T>
+    T* get_user_data_if()
+    {
+        if (user_.has_value())
+        {
+            return std::any_cast<T>(&user_);
+        }
+        return nullptr;
+    }
+
+    /*
+    @description
+    Starts or stops measuring the time the handlers spend on the messages
+    of the session, see take_busy_time()
+    */
+    void measure_busy_time(bool measure)
+    {
+        busy_measured_ = measure;
+    }
+
+    /*
+    @description
+    Returns the time the handlers spent on the session messages since the last call
+    */
+    clock_type::duration take_busy_time()
+    {
+        auto ret = busy_;
+        busy_ = clock_type::duration::zero();
+        return ret;
+    }
+
+    // @brief Receives the session handed off, see hand_off()
+    using handoff_sink = std::function<void(session_handoff&&)>;
+
+    /*
+    @description
+    Checks if the session may move to another loop: a plain socket session
+    with no deferred replies and no resumable stream. The TLS and loopback
+    sessions stay where they are.
+    */
+    bool can_hand_off() const
+    {
+        return connected_ && !loopback_ && !tls_ && !stream_ && !(order_ && order_->holding()) && !handoff_;
+    }
+
+    /*
+    @description
+    Hands the session off between the read batches: the pending read and write
+    are cancelled, the data read already is handled, the bytes not written go
+    along, then the socket and the rest of session_handoff go to the sink. The session
+    is disconnected then, with no user data left, the sink decides where the peer
+    connects again, see take_over(). Returns false if the session can't move.
+    */
+    bool hand_off(handoff_sink sink)
+    {
+        if (!can_hand_off())
+        {
+            return false;
+        }
+
+        handoff_ = std::move(sink);
+        boost::system::error_code ec;
+        socket_.cancel(ec);
+        return true;
+    }
+
+    /*
+    @description
+    Continues the session handed off by another loop, intended to be called
+    before the session starts. The peer state (flow control credits, user data,
+    the frame partially received) carries on, the handlers see a connect.
+    */
+    void take_over(session_handoff&& h)
+    {
+        if (!h.unread.empty())
+        {
+            readbuf_.reserve(h.unread.size() + Policy::read_buffer_size);
+            std::memcpy(readbuf_.end(), h.unread.data(), h.unread.size());
+            readbuf_.grow(h.unread.size());
+            readbuf_.expect(h.unread.size() >= 2 ? reinterpret_cast<const uint16_t*>(h.unread.data())[0] : 0);
+        }
+        if (!h.unsent.empty())
+        {
+            writebuf_.append(h.unsent.data(), h.unsent.size());
+        }
+        if (h.flow)
+        {
+            flow_ = std::move(h.flow);
+            flow_initiator_ = h.flow_initiator;
+        }
+        user_ = std::move(h.user);
+
+        // the TLS sessions never move, the handshake is done anyway
+        tls_context_ = nullptr;
+        taken_over_ = true;
+    }
+
+private:
+
+    /*
+    @description
+    Starts the reads and writes of the established session
+    */
+    void start_io()
+    {
+        apply_rx_timestamps();
+        set_connected();
+        do_read_recurring();
+        do_write();
+    }
+
+    /*
+    @description
+    Makes the next TLS handshake step, waits for the socket as the handshake asks.
+    A failed handshake closes the socket, the session is never connected.
+    */
+    void do_tls_handshake()
+    {
+        boost::system::error_code ec;
+        auto state = tls_->handshake();
+        if (state == tls_channel::state::done)
+        {
+            socket_.non_blocking(false, ec);
+            start_io();
+            return;
+        }
+        if (state == tls_channel::state::failed)
+        {
+            socket_.close(ec);
+            orderly_disconnect();
+            return;
+        }
+
+        schedule_operation();
+        auto wait = state == tls_channel::state::want_read ? tcp::socket::wait_read : tcp::socket::wait_write;
+        socket_.async_wait(wait, [this](boost::system::error_code err)
+        {
+            complete_operation();
+            if (err)
+            {
+                boost::system::error_code ec;
+                socket_.close(ec);
+                orderly_disconnect();
+            }
+            else
+            {
+                do_tls_handshake();
+            }
+        });
+    }
+
+    /*
+    @description
+    Changes the state of the session to "connected", fires a notificatoin
+    */
+    void set_connected()
+    {
+        assert(socket_.is_open() || loopback_);
+        connected_ = true;
+        alive_ = std::make_shared<bool>(true);
+
+        // a session taken over carries on with the same peer, nothing starts over
+        auto taken_over = taken_over_;
+        taken_over_ = false;
+
+        if (flow_ && !taken_over)
+        {
+            // a reconnect starts over, the parked frames belong to the previous peer
+            flow_->reset();
+            if (flow_initiator_ && flow_->receiving())
+            {
+                // ahead of anything the handlers send, so the peer is limited from the start
+                send_grant(flow_->initial_grant());
+            }
+        }
+        frame_sequenced_ = false;
+        // the replies deferred belong to the previous peer
+        order_.reset();
+        if (resume_id_ && !taken_over)
+        {
+            send_resume_request();
+        }
+        static_cast<Derived*>(this)->notify_connected();
+        refresh_activity();
+    }
+
+
+    /*
+    @description
+    Schedules an async write operation, copies the data to the internal write buffer first
+    */
+    void send(const void* buf, size_t len)
+    {
+        if (capture_)
+        {
+            capture_->append(static_cast<const char*>(buf), len);
+        }
+        if (order_ && order_->holding())
+        {
+            if (!order_->send(buf, len))
+            {
+                // the deferred reply takes too long, the peer would wait forever anyway
+                ++held_overflows_;
+                disconnect_later();
+            }
+            return;
+        }
+        send_ordered(buf, len);
+    }
+
+    /*
+    @description
+    Sends the frame in its turn, the deferred replies ahead of it are sent already
+    */
+    void send_ordered(const void* buf, size_t len)
+    {
+        if (connected_ && stream_)
+        {
+            if (stream_->owner() == this)
+            {
+                send_sequenced(stream_->ring().push(buf, len), buf, len);
+                return;
+            }
+            // another session of the peer took the stream over
+            stream_.reset();
+        }
+        send_credited(buf, len);
+    }
+
+    /*
+    @description
+    Sends the frame preceded by its sequence frame, both in one go
+    */
+    void send_sequenced(uint64_t seq, const void* buf, size_t len)
+    {
+        auto frame = static_cast<uint8_t*>(alloca(sequence_frame_size + len));
+        auto header = reinterpret_cast<uint16_t*>(frame);
+        header[0] = static_cast<uint16_t>(sequence_frame_size);
+        header[1] = sequence_message_type;
+        std::memcpy(frame + 2 * sizeof(uint16_t), &seq, sizeof(seq));
+        std::memcpy(frame + sequence_frame_size, buf, len);
+        send_credited(frame, sequence_frame_size + len);
+    }
+
+    /*
+    @description
+    Sends the frame unless out of credit, parks it otherwise
+    */
+    void send_credited(const void* buf, size_t len)
+    {
+        if (connected_)
+        {
+            if (flow_ && flow_->limited())
+            {
+                // the parked frames go first, keeps the order
+                if (flow_->parked() || !flow_->can_send())
+                {
+                    if (!flow_->park(buf, len))
+                    {
+                        // the peer does not take what it is sent, gives up on it
+                        disconnect_later();
+                    }
+                    return;
+                }
+                flow_->sent(len);
+            }
+            send_frame(buf, len);
+        }
+    }
+
+    /*
+    @description
+    Passes the frame to the transport, bypasses the flow control
+    */
+    void send_frame(const void* buf, size_t len)
+    {
+        if (connected_)
+        {
+            if (loopback_)
+            {
+                loopback_(buf, len);
+                return;
+            }
+
+            if (latency_)
+            {
+                auto type = sent_message_type(buf, len);
+                if (type < first_control_message_type)
+                {
+                    unsent_.push_back(pending_send{ type, wall_clock_ns() });
+                }
+            }
+
+            writebuf_.append(buf, len);
+            if (!write_in_progress_ && !corked_)
+            {
+                do_write();
+            }
+        }
+    }
+
+    /*
+    @description
+    The class schedules an async read operation on the given session.
+    This could be a one-chance operation, or a series of recurrings reads.
+    */
+    class read_scheduler
+    {
+    public:
+        explicit read_scheduler(basic_session& session)
+            : session_(session)
+            , postpone_(!session.readbuf_.free_capacity() || session.readbuf_.wants_resize())
+        {
+            if (!postpone_)
+            {
+                session_.do_read<read_scheduler>();
+            }
+        }
+
+        ~read_scheduler()
+        {
+            if (postpone_)
+            {
+                session_.readbuf_.grow_capacity();
+                session_.do_read<read_scheduler>();
+            }
+        }
+
+    private:
+        basic_session& session_;
+        bool postpone_ = false;
+    };
+
+    /*
+    @description
+    Schedules a recurring read operation, meaning if one operation ends,
+    the next one gets scheduled at once
+    */
+    void do_read_recurring()
+    {
+        do_read<read_scheduler>();
+    }
+
+    /*
+    @description
+    Schedules an async read operation. With rx timestamps enabled waits for
+    the socket to become readable and reads it with recvmsg.
+    */
+    template <typename Scheduler>
+    void do_read()
+    {
+        assert(readbuf_.free_capacity() > 0);
+
+        schedule_operation();
+
+        if (rx_timestamps_)
+        {
+            socket_.async_wait(tcp::socket::wait_read, [this](boost::system::error_code err)
+            {
+                complete_operation();
+
+                size_t len = 0;
+                if (!err)
+                {
+                    err = receive_timestamped(len);
+                    if (err == boost::asio::error::would_block)
+                    {
+                        // spurious wakeup, wait again
+                        do_read<Scheduler>();
+                        return;
+                    }
+                }
+
+                handle_read<Scheduler>(err, len);
+            });
+        }
+        else if (tls_ && !tls_->kernel_recv())
+        {
+            read_tls<Scheduler>();
+        }
+        else
+        {
+            socket_.async_read_some(get_read_buffer(), [this](auto err, size_t len)
+            {
+                complete_operation();
+                handle_read<Scheduler>(err, len);
+            });
+        }
+    }
+
+    /*
+    @description
+    Reads the ciphertext and decrypts it into the read buffer. The plaintext left
+    inside TLS from the previous read is taken first, the socket may have nothing more.
+    */
+    template <typename Scheduler>
+    void read_tls()
+    {
+        size_t len = 0;
+        auto err = tls_->decrypt(readbuf_.end(), readbuf_.free_capacity(), len);
+        if (err != boost::asio::error::would_block)
+        {
+            boost::asio::post(socket_.get_executor(), [this, err, len]()
+            {
+                complete_operation();
+                handle_read<Scheduler>(err, len);
+            });
+            return;
+        }
+
+        socket_.async_read_some(tls_->input_buffer(), [this](boost::system::error_code err, size_t n)
+        {
+            complete_operation();
+
+            size_t len = 0;
+            if (!err)
+            {
+                tls_->received(n);
+                err = tls_->decrypt(readbuf_.end(), readbuf_.free_capacity(), len);
+                if (err == boost::asio::error::would_block)
+                {
+                    // a partial record, read on
+                    do_read<Scheduler>();
+                    return;
+                }
+            }
+
+            handle_read<Scheduler>(err, len);
+        });
+    }
+
+    /*
+    @description
+    Sets the socket option for the kernel receive timestamps if requested
+    */
+    void apply_rx_timestamps()
+    {
+        // the timestamped reads bypass the userspace TLS
+        auto plain = !tls_ || tls_->kernel_recv();
+        rx_timestamps_ = rx_timestamps_requested_ && plain && set_rx_timestamping(socket_.native_handle());
+    }
+
+    /*
+    @description
+    Completes the read operation: parses the data, or disconnects on error
+    */
+    template <typename Scheduler>
+    void handle_read(boost::system::error_code err, size_t len)
+    {
+        if (!err)
+        {
+            release_pending_ = false;
+            if (latency_)
+            {
+                read_time_ = wall_clock_ns();
+            }
+            readbuf_.grow(len);
+            if (handoff_)
+            {
+                // the last batch on this loop, no read follows
+                schedule_operation();
+                process_read_data();
+                complete_operation();
+                read_parked();
+                return;
+            }
+            Scheduler scheduler(*this);
+            process_read_data();
+        }
+        else if (err == boost::asio::error::operation_aborted && handoff_ && connected_)
+        {
+            read_parked();
+        }
+        else if (err == boost::asio::error::operation_aborted && release_pending_ && connected_)
+        {
+            // the read was cancelled on purpose, to give the memory back
+            release_pending_ = false;
+            readbuf_.release();
+            Scheduler scheduler(*this);
+        }
+        else
+        {
+            orderly_disconnect();
+        }
+    }
+
+    /*
+    @description
+    Reads the socket with recvmsg, picks the kernel receive timestamp from the control data
+    */
+    boost::system::error_code receive_timestamped(size_t& len)
+    {
+#ifdef __linux__
+        iovec iov{ readbuf_.end(), readbuf_.free_capacity() };
+        alignas(cmsghdr) char control[CMSG_SPACE(3 * sizeof(timespec))];
+
+        msghdr hdr{};
+        hdr.msg_iov = &iov;
+        hdr.msg_iovlen = 1;
+        hdr.msg_control = control;
+        hdr.msg_controllen = sizeof(control);
+
+        auto n = ::recvmsg(socket_.native_handle(), &hdr, MSG_DONTWAIT);
+        if (n < 0)
+        {
+            return boost::system::error_code(errno, boost::asio::error::get_system_category());
+        }
+        if (n == 0)
+        {
+            return boost::asio::error::eof;
+        }
+
+        // a read with no timestamp must not take the one of the previous read
+        rx_time_ = 0;
+        for (auto* cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMPING)
+            {
+                // software timestamp goes first, the hardware ones follow
+                auto* ts = reinterpret_cast<const timespec*>(CMSG_DATA(cmsg));
+                rx_time_ = int64_t(ts[0].tv_sec) * 1000000000 + ts[0].tv_nsec;
+            }
+        }
+
+        len = static_cast<size_t>(n);
+        return {};
+#else
+        return boost::asio::error::operation_not_supported;
+#endif
+    }
+
+    /*
+    @description
+    Copies the loopback bytes to the read buffer chunk by chunk, parses every chunk
+    */
+    void feed_loopback(const uint8_t* bytes, size_t len)
+    {
+        while (len && connected_)
+        {
+            if (!readbuf_.free_capacity() || readbuf_.wants_resize())
+            {
+                readbuf_.grow_capacity();
+            }
+
+            auto n = std::min(len, readbuf_.free_capacity());
+            std::memcpy(readbuf_.end(), bytes, n);
+            bytes += n;
+            len -= n;
+
+            if (latency_)
+            {
+                read_time_ = wall_clock_ns();
+            }
+            readbuf_.grow(n);
+            process_read_data();
+        }
+    }
+
+    /*
+    @description
+    Wraps the free part of the read buffer in an asio structere, for asio to
+    be able to consume it.
+    */
+    auto get_read_buffer()
+    {
+        assert(readbuf_.free_capacity() > 0);
+        return boost::asio::buffer(readbuf_.end(), readbuf_.free_capacity());
+    }
+
+    /*
+    @description
+    Parses the read buffer and fires notifications on protobuf messages if any parsed.
+    */
+    void process_read_data()
+    {
+        if (busy_measured_)
+        {
+            auto start = clock_type::now();
+            parse_read_buffer();
+            busy_ += clock_type::now() - start;
+        }
+        else
+        {
+            parse_read_buffer();
+        }
+        refresh_activity();
+    }
+
+    /*
+    @description
+    No read is pending any more, the session is handed off once no write is in progress either
+    */
+    void read_parked()
+    {
+        release_pending_ = false;
+        if (!connected_)
+        {
+            // closed by a handler of the last batch
+            if (!outstanding_ops_)
+            {
+                static_cast<Derived*>(this)->handle_disconnected_session();
+            }
+            return;
+        }
+
+        read_parked_ = true;
+        if (!write_in_progress_)
+        {
+            finish_hand_off();
+        }
+    }
+
+    /*
+    @description
+    Passes the socket and the session state to the hand-off sink, then disconnects
+    */
+    void finish_hand_off()
+    {
+        session_handoff h;
+        h.unread.assign(reinterpret_cast<const char*>(readbuf_.begin()), readbuf_.end() - readbuf_.begin());
+        h.unsent.swap(unwritten_);
+        writebuf_.foreach([&h](auto & b)
+        {
+            h.unsent.append(reinterpret_cast<const char*>(b.begin()), b.size());
+        });
+        writebuf_.clear();
+        h.flow = std::move(flow_);
+        h.flow_initiator = flow_initiator_;
+        h.user = std::move(user_);
+        user_.reset();
+
+        // leaves the descriptor open, the other loop goes on with it
+        boost::system::error_code ec;
+        h.fd = socket_.release(ec);
+
+        // the session may be gone once disconnected
+        handoff_sink sink;
+        sink.swap(handoff_);
+        read_parked_ = false;
+        orderly_disconnect();
+        sink(std::move(h));
+    }
+
+    /*
+    @description
+    Schedules an async write operation. If another write operation is in flight,
+    then does nothing, the re-scheduling would be performed by the other operation.
+    Nothing is written once the session is being handed off, the data goes along.
+    */
+    void do_write()
+    {
+        if (!writebuf_.empty() && !handoff_)
+        {
+            auto& buf = flip_write_buffer();
+            write_in_progress_.store(true);
+            do_write(buf);
+        }
+        else
+        {
+            write_in_progress_.store(false);
+        }
+    }
+
+    /*
+    @description
+    Asks asio to perform an async write operation on the given write buffer
+    */
+    void do_write(typename Policy::write_buffer_type::buffer_type& buf)
+    {
+        using boost::system::error_code;
+        boost::container::small_vector<boost::asio::const_buffer, 8> asioBuf;
+
+        if (tls_ && !tls_->kernel_send())
+        {
+            // encrypted in userspace, the records go out instead
+            boost::system::error_code tls_err;
+            buf.foreach([this, &tls_err](auto & b)
+            {
+                if (!tls_err)
+                {
+                    tls_err = tls_->encrypt(b.begin(), b.size());
+                }
+            });
+            if (tls_err)
+            {
+                // the data can't go out, the session is over
+                disconnect_later();
+                return;
+            }
+            asioBuf.push_back(tls_->output());
+        }
+        else
+        {
+            // wrap the write buffer with asio buffer
+            buf.foreach([&asioBuf](auto & b)
+            {
+                asioBuf.emplace_back(b.begin(), b.size());
+            });
+        }
+
+        schedule_operation();
+
+        boost::asio::async_write(socket_, asioBuf,
+                                 [this, &buf](error_code err, size_t bytesTransfered)
+        {
+            complete_operation();
+
+            if (err == boost::asio::error::operation_aborted && handoff_ && connected_)
+            {
+                // cancelled by hand_off(), the bytes not written yet go along
+                buf.foreach([this, &bytesTransfered](auto & b)
+                {
+                    auto skip = std::min(bytesTransfered, b.size());
+                    bytesTransfered -= skip;
+                    unwritten_.append(reinterpret_cast<const char*>(b.begin()) + skip, b.size() - skip);
+                });
+                buf.clear();
+                write_in_progress_.store(false);
+                if (read_parked_)
+                {
+                    finish_hand_off();
+                }
+            }
+            else if (err)
+            {
+                // we got an error, close the session and fire the notification
+                orderly_disconnect();
+            }
+            else
+            {
+                record_write_complete();
+                buf.clear();
+
+                if (writebuf_.empty() || handoff_)
+                {
+                    // no more data in the write buffer, or it goes along with the hand-off
+                    write_in_progress_.store(false);
+                    if (read_parked_)
+                    {
+                        finish_hand_off();
+                    }
+                }
+                else
+                {
+                    // schedule another write if the write buffer has any data
+                    do_write(flip_write_buffer());
+                }
+            }
+        });
+    }
+
+    /*
+    @description
+    Swaps the write buffers, the pending send timestamps follow the data
+    */
+    auto& flip_write_buffer()
+    {
+        if (latency_)
+        {
+            inflight_.swap(unsent_);
+        }
+        return writebuf_.flip();
+    }
+
+    /*
+    @description
+    Accounts for the messages of the completed write operation
+    */
+    void record_write_complete()
+    {
+        if (latency_)
+        {
+            auto now = wall_clock_ns();
+            for (auto& s : inflight_)
+            {
+                latency_->get(s.type).send_to_write.record(now - s.time);
+            }
+        }
+        inflight_.clear();
+    }
+
+    /*
+    @description
+    Passes the message on, measures the time it spent in the session and in the handler
+    */
+    void handle_message_timed(uint16_t* msghead, int64_t deadline)
+    {
+        auto type = msghead[1];
+        auto dispatched = wall_clock_ns();
+        {
+            auto& stats = latency_->get(type);
+            if (rx_time_)
+            {
+                stats.kernel_to_read.record(read_time_ - rx_time_);
+            }
+            stats.read_to_dispatch.record(dispatched - read_time_);
+        }
+
+        handle_message(msghead, rx_time_, deadline);
+
+        // the handler might have grown the stats, do not hold the reference across the call
+        if (latency_)
+        {
+            latency_->get(type).handler.record(wall_clock_ns() - dispatched);
+        }
+    }
+
+    /*
+    @description
+    Wall clock time in nanoseconds, comparable with the kernel timestamps
+    */
+    static int64_t wall_clock_ns()
+    {
+        using namespace std::chrono;
+        return duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+    }
+
+    /*
+    @description
+    Parse the read buffer.
+    */
+    void parse_read_buffer()
+    {
+        auto buf = readbuf_.begin();
+        auto beg = buf;
+        auto end = readbuf_.end();
+
+        // unless we receive 4 bytes, we can't parse the message header
+        while (end - buf >= 4)
         {
             auto* msghead = reinterpret_cast<uint16_t*>(buf);
             auto messageSize = msghead[0];
 
             if (messageSize <= end - buf)
             {
-                handle_message(msghead);
+                queued_read_bytes_ = end - buf - messageSize;
+                if (msghead[1] >= first_control_message_type)
+                {
+                    handle_control(msghead);
+                }
+                else
+                {
+                    auto deadline = deadline_;
+                    deadline_ = 0;
+
+                    if (frame_sequenced_ && !accept_sequence())
+                    {
+                        // sent again on resume, handled already
+                    }
+                    else if (deadline && deadline_expired(deadline, deadline_clock_ns()))
+                    {
+                        ++expired_requests_;
+                    }
+                    else if (latency_)
+                    {
+                        handle_message_timed(msghead, deadline);
+                    }
+                    else
+                    {
+                        handle_message(msghead, rx_time_, deadline);
+                    }
+                    if (flow_)
+                    {
+                        flow_->consumed(messageSize);
+                    }
+                }
                 buf += messageSize;
             }
             else
@@ -459,9 +1694,207 @@ private:
             }
         }
 
+        static_cast<Derived*>(this)->notify_read_complete();
+
+        if (flow_ && flow_->grant_due())
+        {
+            send_grant(flow_->take_grant());
+        }
+
+        // let the buffer know how big the partially received frame is
+        readbuf_.expect(end - buf >= 2 ? reinterpret_cast<uint16_t*>(buf)[0] : 0);
         readbuf_.erase(buf - beg);
     }
 
+    /*
+    @description
+    Handles a control frame of the framework, the unknown ones are ignored
+    */
+    void handle_control(uint16_t* msghead)
+    {
+        auto size = msghead[0];
+        auto payload = msghead + 2;
+
+        switch (msghead[1])
+        {
+        case credit_message_type:
+            handle_credit(msghead);
+            return;
+
+        case deadline_message_type:
+            // applies to the next frame
+            if (size >= deadline_frame_size)
+            {
+                std::memcpy(&deadline_, payload, sizeof(deadline_));
+            }
+            break;
+
+        case sequence_message_type:
+            // applies to the next frame
+            if (size >= sequence_frame_size)
+            {
+                std::memcpy(&frame_seq_, payload, sizeof(frame_seq_));
+                frame_sequenced_ = true;
+            }
+            break;
+
+        case resume_message_type:
+            if (size >= 4 + 2 * sizeof(uint64_t))
+            {
+                uint64_t ids[2];
+                std::memcpy(ids, payload, sizeof(ids));
+                handle_resume(ids[0], ids[1]);
+            }
+            return;
+
+        case resumed_message_type:
+            if (size >= sequence_frame_size)
+            {
+                uint64_t seq;
+                std::memcpy(&seq, payload, sizeof(seq));
+                handle_resumed(seq);
+            }
+            return;
+
+        default:
+            return;
+        }
+
+        // the prefix frames take the flow control bytes along with the frame they precede
+        if (flow_)
+        {
+            flow_->consumed(size, 0);
+        }
+    }
+
+    /*
+    @description
+    Checks the sequence number of the frame received, drops the duplicates
+    */
+    bool accept_sequence()
+    {
+        frame_sequenced_ = false;
+        if (frame_seq_ < next_seq_)
+        {
+            return false;
+        }
+        next_seq_ = frame_seq_ + 1;
+        return true;
+    }
+
+    /*
+    @description
+    The peer asks to resume the stream: the session takes the stream over,
+    tells where it continues from and sends the missed frames, if still held
+    */
+    void handle_resume(uint64_t id, uint64_t next)
+    {
+        if (!streams_)
+        {
+            return;
+        }
+
+        if (stream_)
+        {
+            stream_->detach(this, sequenced_stream::clock_type::now());
+        }
+        stream_ = streams_->find_or_create(id);
+        stream_->attach(this);
+
+        auto& ring = stream_->ring();
+        auto from = ring.holds(next) ? next : ring.next();
+        send_control(resumed_message_type, &from, sizeof(from));
+
+        ring.replay(from, [this](uint64_t seq, const void* frame, size_t len)
+        {
+            send_sequenced(seq, frame, len);
+        });
+    }
+
+    /*
+    @description
+    The peer tells where the stream continues from, anything else than
+    the next frame expected means the frames in between are lost
+    */
+    void handle_resumed(uint64_t from)
+    {
+        auto expected = next_seq_;
+        next_seq_ = from;
+        if (from != expected && on_gap_)
+        {
+            on_gap_(expected, from);
+        }
+    }
+
+    // @brief Asks the peer to resume the stream from the next frame expected
+    void send_resume_request()
+    {
+        uint64_t request[2] = { resume_id_, next_seq_ };
+        send_control(resume_message_type, request, sizeof(request));
+    }
+
+    /*
+    @description
+    Sends a control frame with the given payload, bypasses the flow control
+    */
+    void send_control(uint16_t type, const void* payload, size_t len)
+    {
+        auto frame = static_cast<uint16_t*>(alloca(4 + len));
+        frame[0] = static_cast<uint16_t>(4 + len);
+        frame[1] = type;
+        std::memcpy(&frame[2], payload, len);
+        send_frame(frame, 4 + len);
+    }
+
+    /*
+    @description
+    Adds the credits granted by the peer, sends the parked frames they cover.
+    The first grant of a session turns the sending limit on and, unless this
+    side initiated the protocol, opens the window in the other direction.
+    */
+    void handle_credit(uint16_t* msghead)
+    {
+        if (msghead[0] < 4 + sizeof(credit_grant))
+        {
+            return;
+        }
+
+        credit_grant grant;
+        std::memcpy(&grant, msghead + 2, sizeof(grant));
+
+        auto& flow = this->flow();
+        auto first = !flow.limited();
+        flow.granted(grant);
+        if (first && !flow_initiator_ && flow.receiving())
+        {
+            send_grant(flow.initial_grant());
+        }
+
+        flow.flush([this](const void* buf, size_t len)
+        {
+            send_frame(buf, len);
+        });
+    }
+
+    /*
+    @description
+    Sends a credit grant frame, never limited by the credits itself
+    */
+    void send_grant(const credit_grant& grant)
+    {
+        send_control(credit_message_type, &grant, sizeof(grant));
+    }
+
+    // @brief Returns the flow control state, creates it on first use
+    credit_flow& flow()
+    {
+        if (!flow_)
+        {
+            flow_ = std::make_unique<credit_flow>();
+        }
+        return *flow_;
+    }
+
     /*
     @description
     Close the session and notifies the listener.
@@ -472,7 +1905,20 @@ private:
         {
             socket_.close();
             connected_.store(false);
+            alive_.reset();
+            if (stream_)
+            {
+                // kept for the peer to resume
+                stream_->detach(this, sequenced_stream::clock_type::now());
+                stream_.reset();
+            }
             static_cast<Derived*>(this)->notify_disconnected();
+
+            if (loopback_)
+            {
+                // let the peer know, its call back is ignored since we are disconnected already
+                loopback_(nullptr, 0);
+            }
         }
 
         if (!outstanding_ops_)
@@ -481,6 +1927,21 @@ private:
         }
     }
 
+    /*
+    @description
+    Closes the session from the loop rather than in place, the caller may be
+    a handler of the session sending something
+    */
+    void disconnect_later()
+    {
+        schedule_operation();
+        boost::asio::post(socket_.get_executor(), [this]()
+        {
+            complete_operation();
+            orderly_disconnect();
+        });
+    }
+
     /*
     @description
     Updates the last activity timestamp on the session.
@@ -515,12 +1976,80 @@ private:
     tcp::socket socket_;
 
     std::atomic_bool write_in_progress_ = false;
+    // the frames are being appended in a batch, the write waits for the last one
+    bool corked_ = false;
     std::atomic_bool connected_ = false;
+    // expires on disconnect, see alive_token()
+    std::shared_ptr<const void> alive_;
+    bool release_pending_ = false;
+    bool rx_timestamps_requested_ = false;
+    bool rx_timestamps_ = false;
     int outstanding_ops_ = 0;
+    size_t queued_read_bytes_ = 0;
+    int64_t deadline_ = 0;
+    uint64_t expired_requests_ = 0;
+
+    // resumable streams, the sending side
+    stream_registry* streams_ = nullptr;
+    std::shared_ptr<sequenced_stream> stream_;
+
+    // resumable streams, the receiving side
+    uint64_t resume_id_ = 0;
+    uint64_t next_seq_ = 0;
+    uint64_t frame_seq_ = 0;
+    bool frame_sequenced_ = false;
+    std::function<void(uint64_t, uint64_t)> on_gap_;
+
+    // the frames sent are copied here as well, see capture_sent()
+    std::string* capture_ = nullptr;
+
+    // the replies deferred by the handlers, created on the first one
+    std::shared_ptr<reply_order> order_;
+    size_t hold_limit_ = reply_order::default_hold_limit;
+    uint64_t held_overflows_ = 0;
     clock_type::time_point last_activity_;
 
-    rolling_buffer readbuf_;
-    double_writebuf writebuf_;
+    typename Policy::read_buffer_type readbuf_;
+    typename Policy::write_buffer_type writebuf_;
+
+    struct pending_send
+    {
+        int type;
+        int64_t time;
+    };
+
+    // latency instrumentation, off unless the stats are set
+    latency_stats* latency_ = nullptr;
+    int64_t rx_time_ = 0;
+    int64_t read_time_ = 0;
+    std::vector<pending_send> unsent_;
+    std::vector<pending_send> inflight_;
+
+    tcp_sample tcp_info_;
+
+    // TLS, off unless the context is set
+    tls_context* tls_context_ = nullptr;
+    std::unique_ptr<tls_channel> tls_;
+
+    // in-process transport, empty for socket sessions
+    loopback_sink loopback_;
+    std::vector<uint8_t> loopback_backlog_;
+    bool loopback_busy_ = false;
+
+    // credit flow control, created on the first grant or when enabled
+    std::unique_ptr<credit_flow> flow_;
+    bool flow_initiator_ = false;
+
+    // the time spent in the handlers, see take_busy_time()
+    bool busy_measured_ = false;
+    clock_type::duration busy_{ 0 };
+
+    // moving to another loop, see hand_off()
+    handoff_sink handoff_;
+    // the part of the write cancelled by the hand-off not written yet
+    std::string unwritten_;
+    bool read_parked_ = false;
+    bool taken_over_ = false;
 
     tcp::endpoint remote_endpoint_;
     std::any user_;
@@ -8,15 +8,19 @@ namespace protoserv
 @description
 A client TCP/IP session. Performs all async IO operation on demand only.
 */
-template <typename Server>
-class basic_client_session : public basic_session<basic_client_session<Server>>
+template <typename Server, typename Policy = default_session_policy>
+class basic_client_session : public basic_session <
+    basic_client_session<Server, Policy>,
+    protobuf_packet<basic_client_session<Server, Policy>>,
+    Policy >
 {
 public:
-    using self_type = basic_client_session<Server>;
+    using self_type = basic_client_session<Server, Policy>;
+    using base_type = basic_session<self_type, protobuf_packet<self_type>, Policy>;
     using tcp = boost::asio::ip::tcp;
 
     basic_client_session(tcp::socket socket, Server& server)
-        : basic_session<basic_client_session<Server>>(std::move(socket))
+        : base_type(std::move(socket))
         , server_(server)
     {
     }
@@ -48,6 +52,15 @@ public:
         server_.notify_message(*this, message);
     }
 
+    /*
+    @description
+    Tells the server all messages of the last read were passed on.
+    */
+    void notify_read_complete()
+    {
+        server_.notify_read_complete(*this);
+    }
+
     /*
     @description
     Removes the session from the server if there are no more
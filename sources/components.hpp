@@ -2,6 +2,8 @@
 #include "server.hpp"
 #include "boost/format.hpp"
 #include "dispatch_table.hpp"
+#include "message_batch.hpp"
+#include "wire_view.hpp"
 #include <string>
 
 namespace meta
@@ -29,6 +31,17 @@ struct reply_message<Module, void>
     }
 };
 
+// @brief Returning the deferred reply is not supported, the token dropped here would cancel it
+template <typename Module>
+struct reply_message<Module, protoserv::deferred_reply>
+{
+    template <typename F, typename Conn>
+    static void call(F&&, Conn&)
+    {
+        static_assert(sizeof(F) == 0, "keep the token of defer_reply() and return void");
+    }
+};
+
 inline void throw_with_buffer(const void* buf, int len)
 {
     //FIXME:temporarily logging
@@ -136,6 +149,34 @@ auto call_on_message(Comp& comp, Connection& conn, const void* buf, int len, lon
     return call_on_message_alt<Msg, Module>(comp, conn, buf, len, 0);
 }
 
+//
+// call_on_message_view
+//
+
+// @brief Calls component's onMessage(Connection&, View) if present, check the parsing alternatives
+// @description
+// The view is generated by protoserv_viewgen and reads the fields right from the
+// receive buffer, the message is not parsed. The view takes precedence over
+// all the alternatives of call_on_message.
+template <typename Msg, typename Module, typename Comp, typename Connection>
+auto call_on_message_view(Comp& comp, Connection& conn, const void* buf, int len, int)
+-> decltype(comp.onMessage(conn, std::declval<typename protoserv::view_of<Msg>::type>()), void())
+{
+    auto func = [&comp, &conn, buf, len]() -> decltype(auto)
+    {
+        return comp.onMessage(conn, typename protoserv::view_of<Msg>::type(buf, len));
+    };
+
+    reply_message<Module, decltype(func())>::call(func, conn);
+}
+
+template <typename Msg, typename Module, typename Comp, typename Connection>
+auto call_on_message_view(Comp& comp, Connection& conn, const void* buf, int len, long) // NOLINT(runtime/int)
+{
+    // no view handler, parse the message
+    return call_on_message<Msg, Module>(comp, conn, buf, len, 0);
+}
+
 //
 // call_on_connected_alt
 //
@@ -315,7 +356,7 @@ struct dispatcher<Module, Protocol, T, Ts...>
         if (id == meta::identify<Protocol, T>())
         {
             // message id matches the type index
-            return call_on_message<T, Module>(comp, conn, buf, len, 0);
+            return call_on_message_view<T, Module>(comp, conn, buf, len, 0);
         }
         else
         {
@@ -325,6 +366,100 @@ struct dispatcher<Module, Protocol, T, Ts...>
     }
 };
 
+//
+// call_on_messages
+//
+
+// @brief Parses the pending batch and calls module's onMessages(Connection&, span<const Msg>)
+template <typename Msg, typename Module, typename Connection>
+void call_on_messages(Module& mod, protoserv::message_batch<Module>& batch)
+{
+    auto messages = batch.messages();
+    auto& parsed = batch.template parsed_storage<Msg>();
+    if (parsed.size() < messages.size())
+    {
+        parsed.resize(messages.size());
+    }
+
+    for (size_t i = 0; i < messages.size(); ++i)
+    {
+        auto& m = messages[i];
+        if (!parsed[i].ParseFromArray(m.data, m.size))
+        {
+            throw_with_buffer(m.data, m.size);
+        }
+    }
+
+    auto& conn = *static_cast<Connection*>(batch.connection());
+    mod.onMessages(conn, protoserv::span<const Msg>(parsed.data(), messages.size()));
+}
+
+//
+// batch_on_message
+//
+
+// @brief Defers the message to the batch if module defines onMessages(Connection&, span<const Msg>)
+template <typename Msg, typename Module, typename Connection>
+auto batch_on_message(Module& mod, protoserv::message_batch<Module>& batch,
+                      Connection& conn, int id, const void* buf, int len, int)
+-> decltype(mod.onMessages(conn, std::declval<protoserv::span<const Msg>>()), void())
+{
+    // the session passes the timestamp of the read being parsed to the unbatched handlers too
+    batch.append(mod, &conn, &call_on_messages<Msg, Module, Connection>,
+                 protoserv::Message{ id, buf, len, conn.rx_time(), protoserv::current_deadline() });
+}
+
+template <typename Msg, typename Module, typename Connection>
+void batch_on_message(Module& mod, protoserv::message_batch<Module>& batch,
+                      Connection& conn, int, const void* buf, int len, long) // NOLINT(runtime/int)
+{
+    // no batch handler, deliver the pending messages first to preserve the order
+    batch.flush(mod);
+    call_on_message_view<Msg, Module>(mod, conn, buf, len, 0);
+}
+
+//
+// batch_dispatcher
+//
+
+// @brief Protocol message dispatcher aware of batch message handlers
+// @description
+// Same as dispatcher, but messages with onMessages() handler are collected
+// in the batch. The batch is flushed as soon as a message of another type
+// arrives, or by the caller once the read buffer is parsed.
+template <class Module, class... Ts>
+struct batch_dispatcher;
+
+template<class Module, class Protocol>
+struct batch_dispatcher<Module, Protocol>
+{
+    template <typename Connection>
+    static void dispatch(Module& mod, protoserv::message_batch<Module>& batch,
+                         Connection&, int, const void*, int)
+    {
+        // unknown message is ignored, but it still breaks the batch
+        batch.flush(mod);
+    }
+};
+
+template <class Module, class Protocol, class T, class... Ts>
+struct batch_dispatcher<Module, Protocol, T, Ts...>
+{
+    template <typename Connection>
+    static void dispatch(Module& mod, protoserv::message_batch<Module>& batch,
+                         Connection& conn, int id, const void* buf, int len)
+    {
+        if (id == meta::identify<Protocol, T>())
+        {
+            batch_on_message<T, Module>(mod, batch, conn, id, buf, len, 0);
+        }
+        else
+        {
+            batch_dispatcher<Module, Protocol, Ts...>::dispatch(mod, batch, conn, id, buf, len);
+        }
+    }
+};
+
 //
 // dispatch_component_message
 //
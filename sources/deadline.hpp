@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+namespace protoserv
+{
+/*
+@description
+The message type of the deadline frames. A deadline frame carries the wall
+clock time (int64_t nanoseconds since epoch) the next frame of the session
+expires at; it is never passed to the handlers. A request past its deadline
+is dropped before it is parsed.
+*/
+constexpr uint16_t deadline_message_type = 0xfffe;
+
+// @brief Size of the deadline frame, the header included
+constexpr size_t deadline_frame_size = 2 * sizeof(uint16_t) + sizeof(int64_t);
+
+// @brief Wall clock time in nanoseconds, the deadlines are compared against
+inline int64_t deadline_clock_ns()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+// @brief Converts the time point into a deadline
+inline int64_t deadline_ns(std::chrono::system_clock::time_point deadline)
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(deadline.time_since_epoch()).count();
+}
+
+// @brief Checks if the deadline has passed, zero means no deadline
+inline bool deadline_expired(int64_t deadline, int64_t now)
+{
+    return deadline != 0 && now > deadline;
+}
+
+/*
+@description
+The deadline of the request being handled on this thread, zero if none.
+The upstream requests sent meanwhile inherit it, see deadline_scope.
+*/
+inline int64_t& current_deadline()
+{
+    static thread_local int64_t deadline = 0;
+    return deadline;
+}
+
+// @brief Makes the deadline current for the lifetime of the object, restores the previous one
+class deadline_scope
+{
+public:
+    explicit deadline_scope(int64_t deadline)
+        : previous_(current_deadline())
+    {
+        current_deadline() = deadline;
+    }
+
+    deadline_scope(const deadline_scope&) = delete;
+    deadline_scope& operator =(const deadline_scope&) = delete;
+
+    ~deadline_scope()
+    {
+        current_deadline() = previous_;
+    }
+
+private:
+    int64_t previous_;
+};
+
+} // namespace protoserv
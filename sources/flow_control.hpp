@@ -0,0 +1,243 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "message.hpp"
+
+namespace protoserv
+{
+// @brief The message type of the credit grant frames, never passed to the handlers
+constexpr uint16_t credit_message_type = 0xffff;
+
+/*
+@brief Body of the credit grant frame
+@description
+Both figures are increments. The very first grant of a session tells the window:
+zero bytes mean the receiver counts messages only.
+*/
+struct credit_grant
+{
+    uint32_t messages;
+    uint32_t bytes;
+};
+
+/*
+@class credit_flow
+@description
+Credit-based flow control of a single session, both directions.
+
+Receiving: with the window set, the session grants the peer as many credits
+as it has consumed, i.e. passed to the handlers. The grants go out in batches
+of a quarter of the window.
+
+Sending: a session becomes credit-limited once it receives the first grant,
+so the peers unaware of the protocol are never limited. Out of credit, the
+frames are parked in order. A frame of a conflated type replaces the parked
+frame of the same type instead, the receiver gets the latest value only.
+The byte credit may go negative by a single frame, so a frame larger than
+the window still makes progress. The parked frames are limited in bytes,
+a peer which never grants credit must not make the session buffer forever.
+*/
+class credit_flow
+{
+public:
+    // @brief The parked bytes limit unless set otherwise
+    static constexpr size_t default_park_limit = 16 * 1024 * 1024;
+
+    // @brief Sets the receive window, zero messages turn the granting off
+    void set_window(uint32_t messages, uint32_t bytes)
+    {
+        window_ = credit_grant{ messages, bytes };
+    }
+
+    // @brief Checks if the session grants credits to the peer
+    bool receiving() const
+    {
+        return window_.messages > 0;
+    }
+
+    // @brief Returns the grant which opens the whole window
+    credit_grant initial_grant() const
+    {
+        return window_;
+    }
+
+    // @brief Accounts for a frame passed to the handlers, the control frames count the bytes only
+    void consumed(size_t bytes, uint32_t messages = 1)
+    {
+        consumed_.messages += messages;
+        consumed_.bytes += static_cast<uint32_t>(bytes);
+    }
+
+    // @brief Checks if enough was consumed to send a grant
+    bool grant_due() const
+    {
+        return receiving() && consumed_.messages >= std::max<uint32_t>(1, window_.messages / 4);
+    }
+
+    // @brief Returns the consumed credits and starts counting over
+    credit_grant take_grant()
+    {
+        auto ret = consumed_;
+        if (!window_.bytes)
+        {
+            ret.bytes = 0;
+        }
+        consumed_ = credit_grant{ 0, 0 };
+        return ret;
+    }
+
+    // @brief Checks if the outgoing frames are limited by the peer grants
+    bool limited() const
+    {
+        return limited_;
+    }
+
+    // @brief Adds the granted credits, the first grant turns the limit on
+    void granted(const credit_grant& grant)
+    {
+        if (!limited_)
+        {
+            limited_ = true;
+            bytes_limited_ = grant.bytes > 0;
+        }
+        messages_ += grant.messages;
+        bytes_ += grant.bytes;
+    }
+
+    // @brief Checks if a frame may go out now, the parked ones go first
+    bool can_send() const
+    {
+        return !limited_ || (messages_ > 0 && (!bytes_limited_ || bytes_ > 0));
+    }
+
+    // @brief Takes the credits for a frame sent
+    void sent(size_t bytes)
+    {
+        if (limited_)
+        {
+            --messages_;
+            bytes_ -= static_cast<int64_t>(bytes);
+        }
+    }
+
+    // @brief Marks the message type as conflated, only the latest parked frame is kept
+    void set_conflated(uint16_t type, bool conflated)
+    {
+        if (type >= conflated_.size())
+        {
+            conflated_.resize(type + 1);
+        }
+        conflated_[type] = conflated;
+    }
+
+    // @brief Sets the limit of the parked bytes, see park()
+    void set_park_limit(size_t bytes)
+    {
+        park_limit_ = bytes;
+    }
+
+    /*
+    @description
+    Parks the frame until the credits arrive, replaces the parked one of a conflated type.
+    The type is that of the message, past the deadline and sequence prefixes.
+    Returns false, parking nothing, if the parked bytes would exceed the limit.
+    */
+    bool park(const void* buf, size_t len)
+    {
+        auto type = sent_message_type(buf, len);
+        if (type < conflated_.size() && conflated_[type])
+        {
+            auto it = std::find_if(parked_.begin(), parked_.end(), [type](const std::string & f)
+            {
+                return sent_message_type(f.data(), f.size()) == type;
+            });
+            if (it != parked_.end())
+            {
+                if (parked_bytes_ - it->size() + len > park_limit_)
+                {
+                    return false;
+                }
+                parked_bytes_ = parked_bytes_ - it->size() + len;
+                it->assign(static_cast<const char*>(buf), len);
+                ++conflated_count_;
+                return true;
+            }
+        }
+
+        if (parked_bytes_ + len > park_limit_)
+        {
+            return false;
+        }
+        parked_bytes_ += len;
+        parked_.emplace_back(static_cast<const char*>(buf), len);
+        return true;
+    }
+
+    // @brief Passes the parked frames on while the credits last
+    template <typename Func>
+    void flush(Func&& send)
+    {
+        while (!parked_.empty() && can_send())
+        {
+            auto& frame = parked_.front();
+            sent(frame.size());
+            parked_bytes_ -= frame.size();
+            send(frame.data(), frame.size());
+            parked_.pop_front();
+        }
+    }
+
+    // @brief Returns the number of parked frames
+    size_t parked() const
+    {
+        return parked_.size();
+    }
+
+    // @brief Returns the number of parked bytes
+    size_t parked_bytes() const
+    {
+        return parked_bytes_;
+    }
+
+    // @brief Returns the number of frames replaced by newer ones of the same type
+    uint64_t conflated() const
+    {
+        return conflated_count_;
+    }
+
+    // @brief Forgets the credits and the parked frames, keeps the configuration
+    void reset()
+    {
+        consumed_ = credit_grant{ 0, 0 };
+        limited_ = false;
+        bytes_limited_ = false;
+        messages_ = 0;
+        bytes_ = 0;
+        parked_.clear();
+        parked_bytes_ = 0;
+    }
+
+private:
+    // receiving side
+    credit_grant window_{ 0, 0 };
+    credit_grant consumed_{ 0, 0 };
+
+    // sending side
+    bool limited_ = false;
+    bool bytes_limited_ = false;
+    int64_t messages_ = 0;
+    int64_t bytes_ = 0;
+    std::deque<std::string> parked_;
+    size_t parked_bytes_ = 0;
+    size_t park_limit_ = default_park_limit;
+    std::vector<bool> conflated_;
+    uint64_t conflated_count_ = 0;
+};
+
+} // namespace protoserv
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "latency_stats.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+
+namespace protoserv
+{
+/*
+@class hedge_policy
+@description
+Decides when a read-only upstream request gets a duplicate sent to another
+upstream: once the reply is later than the configured percentile of the
+primary reply latencies. The percentile comes from the last complete window
+of samples, so the delay follows the upstream as it speeds up or slows down.
+
+The hedges are paid for with a budget, a fraction of the requests: every
+request adds the fraction to the balance, every hedge takes one off, and
+the balance is capped so that a quiet period doesn't buy a burst of hedges.
+*/
+class hedge_policy
+{
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    static constexpr uint64_t window = 1024;
+    static constexpr uint64_t warmup = 32;
+    static constexpr double max_balance = 10.0;
+
+    // @brief Sets the percentile of the hedge delay, its floor and the hedges per request allowed
+    void configure(double percentile, std::chrono::nanoseconds min_delay, double budget)
+    {
+        percentile_ = percentile;
+        min_delay_ = min_delay;
+        budget_ = budget;
+    }
+
+    // @brief Returns how long to wait for the reply before hedging
+    std::chrono::nanoseconds delay() const
+    {
+        auto ns = delay_;
+        if (!ns && recent_.count() >= warmup)
+        {
+            // the first window is not complete yet
+            ns = recent_.percentile(percentile_);
+        }
+        return std::max(min_delay_, std::chrono::nanoseconds(ns));
+    }
+
+    // @brief Accounts for the reply latency of a primary upstream
+    void record(std::chrono::nanoseconds latency)
+    {
+        recent_.record(latency.count());
+        if (recent_.count() >= window)
+        {
+            delay_ = recent_.percentile(percentile_);
+            recent_.clear();
+        }
+    }
+
+    // @brief Accounts for a request sent, adds to the hedge budget
+    void started()
+    {
+        ++requests_;
+        balance_ = std::min(max_balance, balance_ + budget_);
+    }
+
+    // @brief Takes a hedge off the budget, false if spent
+    bool try_hedge()
+    {
+        if (balance_ < 1.0)
+        {
+            ++suppressed_;
+            return false;
+        }
+        balance_ -= 1.0;
+        ++hedges_;
+        return true;
+    }
+
+    // @brief Accounts for a hedge answered before the primary upstream
+    void hedge_won()
+    {
+        ++hedge_wins_;
+    }
+
+    // @brief Returns the number of requests sent with hedging
+    uint64_t requests() const
+    {
+        return requests_;
+    }
+
+    // @brief Returns the number of hedges sent
+    uint64_t hedges() const
+    {
+        return hedges_;
+    }
+
+    // @brief Returns the number of hedges answered first
+    uint64_t hedge_wins() const
+    {
+        return hedge_wins_;
+    }
+
+    // @brief Returns the number of hedges not sent for the budget was spent
+    uint64_t suppressed() const
+    {
+        return suppressed_;
+    }
+
+private:
+    double percentile_ = 95.0;
+    std::chrono::nanoseconds min_delay_ = std::chrono::microseconds(500);
+    double budget_ = 0.05;
+
+    latency_histogram recent_;
+    uint64_t delay_ = 0;
+    double balance_ = 0.0;
+
+    uint64_t requests_ = 0;
+    uint64_t hedges_ = 0;
+    uint64_t hedge_wins_ = 0;
+    uint64_t suppressed_ = 0;
+};
+
+} // namespace protoserv
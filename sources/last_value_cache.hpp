@@ -0,0 +1,221 @@
+#pragma once
+
+#include <boost/asio/buffer.hpp>
+
+#include <google/protobuf/message.h>
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace protoserv
+{
+/*
+@class last_value_cache
+@description
+The latest frame of every key of a stream (an instrument, a topic etc.),
+kept encoded, the size and type header included. The slots live in an
+open-addressed table with linear probing; a slot keeps its buffer when
+the value is replaced, so the steady state updates do not allocate.
+
+A new subscriber gets the whole snapshot with snapshot(): the frames are
+appended to its write buffer at once and go out in a single gather write,
+nothing is serialized again.
+*/
+class last_value_cache
+{
+public:
+    explicit last_value_cache(size_t capacity = 64)
+    {
+        size_t n = 16;
+        while (n < capacity + capacity / 2)
+        {
+            n *= 2;
+        }
+        slots_.resize(n);
+    }
+
+    // @brief Replaces the latest value of the key with the message, serialized in place
+    void update(uint64_t key, int messageType, const google::protobuf::Message& msg)
+    {
+        const auto size = 2 * sizeof(uint16_t) + msg.ByteSize();
+        assert(size <= std::numeric_limits<uint16_t>::max());
+
+        auto& frame = slot_for(key).frame;
+        frame.resize(size);
+        auto buf = reinterpret_cast<uint16_t*>(&frame[0]);
+        buf[0] = static_cast<uint16_t>(size);
+        buf[1] = static_cast<uint16_t>(messageType);
+        msg.SerializePartialToArray(&buf[2], static_cast<int>(size - 2 * sizeof(uint16_t)));
+    }
+
+    // @brief Replaces the latest value of the key with the frame encoded elsewhere
+    void update(uint64_t key, const void* frame, size_t len)
+    {
+        slot_for(key).frame.assign(static_cast<const char*>(frame), len);
+    }
+
+    // @brief Returns the latest frame of the key, nullptr if none
+    const std::string* find(uint64_t key) const
+    {
+        auto mask = slots_.size() - 1;
+        for (auto i = hash(key) & mask; slots_[i].used; i = (i + 1) & mask)
+        {
+            if (slots_[i].key == key)
+            {
+                return &slots_[i].frame;
+            }
+        }
+        return nullptr;
+    }
+
+    // @brief Forgets the key, the following keys of the probe sequence are shifted back
+    bool erase(uint64_t key)
+    {
+        auto mask = slots_.size() - 1;
+        auto i = hash(key) & mask;
+        for (; slots_[i].used; i = (i + 1) & mask)
+        {
+            if (slots_[i].key == key)
+            {
+                break;
+            }
+        }
+        if (!slots_[i].used)
+        {
+            return false;
+        }
+
+        // backward shift deletion, no tombstones
+        for (auto j = (i + 1) & mask; slots_[j].used; j = (j + 1) & mask)
+        {
+            auto home = hash(slots_[j].key) & mask;
+            // the entry at j may fill the hole at i unless its home lies in (i, j]
+            if (((j - home) & mask) >= ((j - i) & mask))
+            {
+                std::swap(slots_[i], slots_[j]);
+                i = j;
+            }
+        }
+        slots_[i].used = false;
+        slots_[i].frame.clear();
+        --size_;
+        return true;
+    }
+
+    // @brief Returns the number of keys
+    size_t size() const
+    {
+        return size_;
+    }
+
+    // @brief Returns the total size of the frames, i.e. of the snapshot
+    size_t bytes() const
+    {
+        size_t ret = 0;
+        for (auto& s : slots_)
+        {
+            ret += s.used ? s.frame.size() : 0;
+        }
+        return ret;
+    }
+
+    // @brief Visits the latest frame of every key, in no particular order
+    template <typename F>
+    void foreach (F&& f) const
+    {
+        for (auto& s : slots_)
+        {
+            if (s.used)
+            {
+                f(s.key, s.frame);
+            }
+        }
+    }
+
+    // @brief Sends the latest frame of every key to the connection in a single write
+    template <typename Connection>
+    void snapshot(Connection& conn) const
+    {
+        std::vector<boost::asio::const_buffer> frames;
+        frames.reserve(size_);
+        foreach([&frames](uint64_t, const std::string & frame)
+        {
+            frames.emplace_back(frame.data(), frame.size());
+        });
+        conn.send_encoded(frames);
+    }
+
+private:
+    struct slot
+    {
+        uint64_t key = 0;
+        bool used = false;
+        std::string frame;
+    };
+
+    // @brief The splitmix64 finalizer, spreads the sequential keys over the table
+    static uint64_t hash(uint64_t key)
+    {
+        key ^= key >> 30;
+        key *= 0xbf58476d1ce4e5b9ULL;
+        key ^= key >> 27;
+        key *= 0x94d049bb133111ebULL;
+        key ^= key >> 31;
+        return key;
+    }
+
+    // @brief Finds the slot of the key, takes a free one if the key is new
+    slot& slot_for(uint64_t key)
+    {
+        if ((size_ + 1) * 10 > slots_.size() * 7)
+        {
+            grow();
+        }
+
+        auto mask = slots_.size() - 1;
+        auto i = hash(key) & mask;
+        for (; slots_[i].used; i = (i + 1) & mask)
+        {
+            if (slots_[i].key == key)
+            {
+                return slots_[i];
+            }
+        }
+
+        slots_[i].key = key;
+        slots_[i].used = true;
+        ++size_;
+        return slots_[i];
+    }
+
+    // @brief Doubles the table, the frame buffers are moved over
+    void grow()
+    {
+        std::vector<slot> old(slots_.size() * 2);
+        old.swap(slots_);
+
+        auto mask = slots_.size() - 1;
+        for (auto& s : old)
+        {
+            if (s.used)
+            {
+                auto i = hash(s.key) & mask;
+                while (slots_[i].used)
+                {
+                    i = (i + 1) & mask;
+                }
+                slots_[i] = std::move(s);
+            }
+        }
+    }
+
+    std::vector<slot> slots_;
+    size_t size_ = 0;
+};
+
+} // namespace protoserv
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <vector>
+#include <ostream>
+#include <iomanip>
+#include <cstdint>
+#include <algorithm>
+
+namespace protoserv
+{
+// @brief Histogram of durations in nanoseconds with power-of-two buckets
+class latency_histogram
+{
+public:
+    static constexpr int bucket_count = 48;
+
+    // @brief Accounts for the given duration, negative durations are clamped to zero
+    void record(int64_t ns)
+    {
+        auto v = static_cast<uint64_t>(std::max<int64_t>(ns, 0));
+        ++buckets_[bucket(v)];
+        ++count_;
+        sum_ += v;
+        max_ = std::max(max_, v);
+    }
+
+    // @brief Returns the number of recorded durations
+    uint64_t count() const
+    {
+        return count_;
+    }
+
+    // @brief Returns the sum of all recorded durations
+    uint64_t sum() const
+    {
+        return sum_;
+    }
+
+    // @brief Returns the longest recorded duration
+    uint64_t max() const
+    {
+        return max_;
+    }
+
+    // @brief Returns the number of durations in the given bucket
+    uint64_t bucket_size(int index) const
+    {
+        return buckets_[index];
+    }
+
+    // @brief Returns the upper bound (inclusive) of the given bucket
+    static uint64_t bucket_bound(int index)
+    {
+        return index == 0 ? 0 : (uint64_t(1) << index) - 1;
+    }
+
+    // @brief Returns an upper bound estimate of the given percentile, 0 < p <= 100
+    uint64_t percentile(double p) const
+    {
+        auto rank = static_cast<uint64_t>(count_ * p / 100.0 + 0.5);
+        uint64_t seen = 0;
+        for (int i = 0; i < bucket_count; ++i)
+        {
+            seen += buckets_[i];
+            if (seen >= rank && seen > 0)
+            {
+                return std::min(bucket_bound(i), max_);
+            }
+        }
+        return max_;
+    }
+
+    // @brief Forgets all recorded durations
+    void clear()
+    {
+        *this = latency_histogram();
+    }
+
+private:
+    // @brief Returns the bucket index for the value, bucket i holds [2^(i-1), 2^i)
+    static int bucket(uint64_t v)
+    {
+        int i = 0;
+        while (v && i < bucket_count - 1)
+        {
+            v >>= 1;
+            ++i;
+        }
+        return i;
+    }
+
+    uint64_t buckets_[bucket_count] = { 0 };
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+};
+
+// @brief Latency breakdown of a single message type
+struct message_latency
+{
+    // kernel receive timestamp to the moment the read completes
+    latency_histogram kernel_to_read;
+
+    // read completion to the moment the message is passed to the handler
+    latency_histogram read_to_dispatch;
+
+    // time spent in the message handler
+    latency_histogram handler;
+
+    // send() call to the moment the write operation completes
+    latency_histogram send_to_write;
+};
+
+// @brief Per message type latency breakdown, not thread-safe
+class latency_stats
+{
+public:
+    // @brief Returns the latency breakdown of the given message type
+    message_latency& get(int type)
+    {
+        if (static_cast<size_t>(type) >= types_.size())
+        {
+            types_.resize(type + 1);
+        }
+        return types_[type];
+    }
+
+    // @brief Visits every message type with at least one recorded duration
+    template <typename Func>
+    void foreach (Func && func) const
+    {
+        for (size_t i = 0; i < types_.size(); ++i)
+        {
+            auto& t = types_[i];
+            if (t.kernel_to_read.count() || t.read_to_dispatch.count() ||
+                    t.handler.count() || t.send_to_write.count())
+            {
+                func(static_cast<int>(i), t);
+            }
+        }
+    }
+
+    // @brief Prints the summary table
+    void print(std::ostream& os) const
+    {
+        os << std::left << std::setw(6) << "type" << std::setw(18) << "phase"
+           << std::right << std::setw(10) << "count" << std::setw(12) << "p50 ns"
+           << std::setw(12) << "p99 ns" << std::setw(12) << "max ns" << "\r\n";
+
+        foreach ([&os](int type, const message_latency & t)
+        {
+            print_row(os, type, "kernel_to_read", t.kernel_to_read);
+            print_row(os, type, "read_to_dispatch", t.read_to_dispatch);
+            print_row(os, type, "handler", t.handler);
+            print_row(os, type, "send_to_write", t.send_to_write);
+        });
+    }
+
+private:
+    // @brief Prints a single histogram summary
+    static void print_row(std::ostream& os, int type, const char* phase, const latency_histogram& h)
+    {
+        if (h.count())
+        {
+            os << std::left << std::setw(6) << type << std::setw(18) << phase
+               << std::right << std::setw(10) << h.count() << std::setw(12) << h.percentile(50)
+               << std::setw(12) << h.percentile(99) << std::setw(12) << h.max() << "\r\n";
+        }
+    }
+
+    std::vector<message_latency> types_;
+};
+
+} // namespace protoserv
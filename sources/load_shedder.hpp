@@ -0,0 +1,119 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+namespace protoserv
+{
+/*
+@class load_shedder
+@description
+Rejects the requests of the marked message types while the server is overloaded,
+before they are parsed. Overloaded means the event loop lags behind its timers
+by more than the configured threshold, or the session has more received bytes
+queued behind the request than configured. A shed request gets the reply encoded
+beforehand, or nothing at all; the other message types are always served.
+
+The loop lag comes from a periodic probe, see tick(): the delay between
+the deadline the probe was scheduled on and the moment it ran.
+*/
+class load_shedder
+{
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    // @brief Sets the thresholds, zero turns the check off
+    void configure(std::chrono::nanoseconds max_lag, size_t max_queued_bytes)
+    {
+        max_lag_ = max_lag;
+        max_queued_bytes_ = max_queued_bytes;
+    }
+
+    // @brief Marks the message type as sheddable, with the encoded reply frame, none if empty
+    void mark(int type, std::string reply = std::string())
+    {
+        if (type >= static_cast<int>(marked_.size()))
+        {
+            marked_.resize(type + 1);
+        }
+        marked_[type] = entry{ true, std::move(reply) };
+    }
+
+    // @brief Checks if the message type may be shed
+    bool marked(int type) const
+    {
+        return type < static_cast<int>(marked_.size()) && marked_[type].marked;
+    }
+
+    // @brief Measures the loop lag, called by a periodic timer with the deadline of the tick, see tick_schedule
+    void tick(clock_type::time_point now, clock_type::time_point deadline)
+    {
+        record_lag(std::max(std::chrono::nanoseconds(0), std::chrono::nanoseconds(now - deadline)));
+    }
+
+    // @brief Sets the loop lag measured elsewhere
+    void record_lag(std::chrono::nanoseconds lag)
+    {
+        lag_ = lag;
+    }
+
+    // @brief Returns the last measured loop lag
+    std::chrono::nanoseconds loop_lag() const
+    {
+        return lag_;
+    }
+
+    // @brief Checks the thresholds, given the bytes queued behind the request
+    bool overloaded(size_t queued_bytes) const
+    {
+        return (max_lag_.count() > 0 && lag_ > max_lag_)
+               || (max_queued_bytes_ > 0 && queued_bytes > max_queued_bytes_);
+    }
+
+    /*
+    @description
+    Sheds the request if its type is marked and the server is overloaded,
+    sends the reply if any. Returns false if the request is to be served.
+    */
+    template <typename Connection>
+    bool try_shed(Connection& conn, int type)
+    {
+        if (!marked(type) || !overloaded(conn.queued_read_bytes()))
+        {
+            return false;
+        }
+
+        ++shed_;
+        auto& reply = marked_[type].reply;
+        if (!reply.empty())
+        {
+            conn.send_encoded(reply.data(), reply.size());
+        }
+        return true;
+    }
+
+    // @brief Returns the number of requests shed so far
+    uint64_t shed_count() const
+    {
+        return shed_;
+    }
+
+private:
+    struct entry
+    {
+        bool marked = false;
+        std::string reply;
+    };
+
+    std::chrono::nanoseconds max_lag_{ 0 };
+    size_t max_queued_bytes_ = 0;
+
+    std::vector<entry> marked_;
+    std::chrono::nanoseconds lag_{ 0 };
+    uint64_t shed_ = 0;
+};
+
+} // namespace protoserv
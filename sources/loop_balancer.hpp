@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+
+namespace protoserv
+{
+/*
+@class loop_balancer
+@description
+Evens out the load of the loops, i.e. the server instances running in threads
+of their own. Every interval a loop reports its utilisation: the share of the
+interval its handlers spent on the client messages. If the busiest loop is busier
+than the least busy one by more than the threshold, it moves a client session
+over, see basic_app_server::migrate(). The session moved is the heaviest one
+which narrows the gap without reversing it, so the sessions do not bounce
+between the loops. One session per loop and interval at most.
+
+The loops join before any of them runs, see basic_app_server::balance().
+*/
+template <typename Server>
+class loop_balancer
+{
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    // @brief Sets the utilisation gap tolerated (0.2 is 20% of the interval) and the reporting interval
+    loop_balancer(double threshold, clock_type::duration interval)
+        : threshold_(threshold)
+        , interval_(interval)
+    {
+    }
+
+    loop_balancer(const loop_balancer&) = delete;
+    loop_balancer& operator =(const loop_balancer&) = delete;
+
+    // @brief Adds the loop, returns its slot
+    size_t join(Server& loop)
+    {
+        loops_.emplace_back(loop);
+        return loops_.size() - 1;
+    }
+
+    clock_type::duration interval() const
+    {
+        return interval_;
+    }
+
+    double threshold() const
+    {
+        return threshold_;
+    }
+
+    // @brief Returns the number of loops joined
+    size_t loops() const
+    {
+        return loops_.size();
+    }
+
+    // @brief Returns the utilisation last reported by the loop
+    double utilisation(size_t slot) const
+    {
+        return loops_[slot].utilisation.load(std::memory_order_relaxed);
+    }
+
+    /*
+    @description
+    Records the utilisation of the loop. Returns the loop to move the load over to,
+    and the utilisation gap between the two; nullptr if another loop is busier,
+    or the gap is within the threshold.
+    */
+    Server* report(size_t slot, double utilisation, double& gap)
+    {
+        loops_[slot].utilisation.store(utilisation, std::memory_order_relaxed);
+
+        auto idlest = &loops_[slot];
+        auto lowest = utilisation;
+        for (auto& l : loops_)
+        {
+            auto u = l.utilisation.load(std::memory_order_relaxed);
+            if (u > utilisation)
+            {
+                return nullptr;
+            }
+            if (u < lowest)
+            {
+                idlest = &l;
+                lowest = u;
+            }
+        }
+
+        gap = utilisation - lowest;
+        return gap > threshold_ ? &idlest->loop : nullptr;
+    }
+
+private:
+    struct loop_state
+    {
+        explicit loop_state(Server& s)
+            : loop(s)
+        {
+        }
+
+        Server& loop;
+        std::atomic<double> utilisation{ 0 };
+    };
+
+    double threshold_;
+    clock_type::duration interval_;
+    // the loops report from their own threads, the deque keeps the states in place
+    std::deque<loop_state> loops_;
+};
+
+} // namespace protoserv
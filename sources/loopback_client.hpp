@@ -0,0 +1,212 @@
+#pragma once
+
+#include "client_session.hpp"
+#include "message.hpp"
+#include "messagebuf.hpp"
+#include "meta_protocol.hpp"
+#include <memory>
+#include <list>
+
+namespace protoserv
+{
+/*
+@class loopback_client
+@description
+A protobuf-aware client wired to the server in-process, no sockets involved.
+Both ends are regular sessions: the bytes one of them sends are fed to the other
+with basic_session::loopback_receive, so the framing, the parsing and the module
+dispatch are exercised as they are with TCP, minus the kernel. Everything runs
+in the calling thread, synchronously: a reply sent by the message handler is
+queued by the time send() returns. The server must not be running in another thread.
+*/
+template <typename Server>
+class loopback_client
+{
+public:
+    using tcp = boost::asio::ip::tcp;
+    using protocol_pack = typename Server::protocol_pack;
+    using self_type = loopback_client<Server>;
+    using session_type = basic_client_session<self_type>;
+    using peer_type = typename Server::client_session;
+
+    explicit loopback_client(Server& server)
+        : server_(server)
+    {
+    }
+
+    // @brief Disconnects the client, the server is notified
+    ~loopback_client()
+    {
+        disconnect();
+    }
+
+    loopback_client(const loopback_client&) = delete;
+    loopback_client& operator =(const loopback_client&) = delete;
+
+    // @brief Creates the session pair, the server is notified about the new connection
+    void connect()
+    {
+        assert(!session_);
+
+        session_ = std::make_unique<session_type>(tcp::socket(service_), *this);
+        session_->start_loopback([this](const void* buf, size_t len)
+        {
+            peer_->loopback_receive(buf, len);
+        });
+
+        // the server may greet the client right from the connected event
+        peer_ = &server_.connect_loopback([this](const void* buf, size_t len)
+        {
+            session_->loopback_receive(buf, len);
+        });
+    }
+
+    // @brief Disconnects from the server, the server is notified
+    void disconnect()
+    {
+        if (session_)
+        {
+            session_->close();
+            session_.reset();
+            peer_ = nullptr;
+        }
+    }
+
+    // @brief Checks if the server side of the connection is alive
+    bool connected() const
+    {
+        return session_ && session_->connected();
+    }
+
+    // @brief Returns the server side of the connection
+    peer_type& peer()
+    {
+        assert(peer_ != nullptr);
+        return *peer_;
+    }
+
+    template <typename T>
+    static constexpr int get_message_id()
+    {
+        return meta::identify<protocol_pack, std::remove_cv_t<T>>();
+    }
+
+    // @brief Sends protobuf message to the server, the server handles it before the call returns
+    template <typename T>
+    void send(const T& message)
+    {
+        session_->send(get_message_id<T>(), message);
+    }
+
+    // @brief Sends protobuf message the server drops unhandled once the deadline passes
+    template <typename T>
+    void send(const T& message, std::chrono::system_clock::time_point deadline)
+    {
+        session_->send(get_message_id<T>(), message, deadline_ns(deadline));
+    }
+
+    // @brief Sends protobuf message of the given type to the server
+    void send(int messageId, const google::protobuf::Message& message)
+    {
+        session_->send(messageId, message);
+    }
+
+    // @brief Checks if there is a message of given type T on the queue
+    // @description
+    // Lets the server run its ready handlers (timers, posted work) first
+    template <typename T>
+    bool try_receive(T& t)
+    {
+        if (take(t))
+        {
+            return true;
+        }
+
+        server_.poll();
+        return take(t);
+    }
+
+    // @brief Waits for message of given type T, runs the server handlers meanwhile
+    template <typename T>
+    void wait_message(T& t)
+    {
+        while (!try_receive(t))
+        {
+        }
+    }
+
+    // @brief Waits for incoming message of type T
+    template <typename T>
+    T wait_message()
+    {
+        T t;
+        wait_message(t);
+        return t;
+    }
+
+    // @brief Returns the number of received messages not taken yet
+    size_t pending() const
+    {
+        return queue_.size();
+    }
+
+    // @brief Connection event handler. TODO: remove from public
+    void notify_connected(session_type&)
+    {
+    }
+
+    // @brief Disconnected event handler. TODO: remove from public
+    void notify_disconnected(session_type&)
+    {
+    }
+
+    // @brief Message event handler. TODO: remove from public
+    void notify_message(session_type&, const Message& msg)
+    {
+        queue_.push_back(messagebuf::copy(msg));
+    }
+
+    // @brief Read completion event handler. TODO: remove from public
+    void notify_read_complete(session_type&)
+    {
+    }
+
+    // @brief The session is owned by the client, destroyed on disconnect. TODO: remove from public
+    void remove_session(session_type*)
+    {
+    }
+
+    // TODO: remove from public
+    bool is_valid_session(const session_type* session) const
+    {
+        return session == session_.get();
+    }
+
+private:
+    // @brief Takes the first queued message of type T
+    template <typename T>
+    bool take(T& t)
+    {
+        for (auto i = queue_.begin(); i != queue_.end(); ++i)
+        {
+            auto& m = **i;
+            if (get_message_id<T>() == m.type)
+            {
+                t.ParseFromArray(m.data, m.size);
+                queue_.erase(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    Server& server_;
+
+    // the session needs an io_service to be constructed, it never runs
+    boost::asio::io_service service_;
+    std::unique_ptr<session_type> session_;
+    peer_type* peer_ = nullptr;
+    std::list<messagebuf> queue_;
+};
+
+} // namespace protoserv
@@ -1,7 +1,36 @@
 #pragma once
 
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
 namespace protoserv
 {
+// @brief The framework control frames take the types from here on, they never reach the handlers
+constexpr uint16_t first_control_message_type = 0xfff0;
+
+/*
+@description
+Returns the type of the message a send carries. The control frames prefixing
+a message in the same send (deadline, sequence number) are skipped, a control
+frame sent on its own is returned as is.
+*/
+inline uint16_t sent_message_type(const void* buf, size_t len)
+{
+    auto frame = static_cast<const uint8_t*>(buf);
+    for (;;)
+    {
+        uint16_t header[2];
+        std::memcpy(header, frame, sizeof(header));
+        if (header[1] < first_control_message_type || header[0] < sizeof(header) || header[0] + sizeof(header) > len)
+        {
+            return header[1];
+        }
+        frame += header[0];
+        len -= header[0];
+    }
+}
+
 /*
 @brief A structure representing the protobuf message
 */
@@ -15,6 +44,12 @@ struct Message
 
     // message buffer size, does not include the id/size header
     int size;
+
+    // kernel receive timestamp (nanoseconds since epoch), zero if unknown
+    int64_t rx_time = 0;
+
+    // the time the sender gives up on the message (nanoseconds since epoch), zero if none
+    int64_t deadline = 0;
 };
 
 }//namespace protoserv
@@ -0,0 +1,207 @@
+#pragma once
+#include "message.hpp"
+#include "deadline.hpp"
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cassert>
+#include <algorithm>
+
+namespace protoserv
+{
+// @brief A non-owning view over a contiguous sequence of objects
+template <typename T>
+class span
+{
+public:
+    span() noexcept = default;
+
+    span(T* data, size_t size) noexcept
+        : data_(data)
+        , size_(size)
+    {
+    }
+
+    // @brief Returns pointer to the first element
+    T* data() const noexcept
+    {
+        return data_;
+    }
+
+    // @brief Returns the number of elements
+    size_t size() const noexcept
+    {
+        return size_;
+    }
+
+    // @brief Checks if there are no elements
+    bool empty() const noexcept
+    {
+        return size_ == 0;
+    }
+
+    // @brief Returns pointer to the first element
+    T* begin() const noexcept
+    {
+        return data_;
+    }
+
+    // @brief Returns pointer past the last element
+    T* end() const noexcept
+    {
+        return data_ + size_;
+    }
+
+    // @brief Returns the element by its index
+    T& operator[](size_t index) const noexcept
+    {
+        assert(index < size_);
+        return data_[index];
+    }
+
+private:
+    T* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+/*
+@description
+Consecutive messages of the same type, received on the same connection
+within a single read. The messages point into the session read buffer,
+thus the batch has to be flushed before the read buffer is consumed.
+*/
+template <typename Module>
+class message_batch
+{
+public:
+    using flush_type = void (*)(Module&, message_batch&);
+
+    message_batch() = default;
+    message_batch(const message_batch&) = delete;
+    message_batch& operator =(const message_batch&) = delete;
+
+    // @brief Appends the message, flushes the pending messages first if type or connection differ
+    void append(Module& mod, void* conn, flush_type flush_func, const Message& msg)
+    {
+        if (!messages_.empty() && (type_ != msg.type || conn_ != conn))
+        {
+            flush(mod);
+        }
+
+        if (messages_.empty())
+        {
+            type_ = msg.type;
+            conn_ = conn;
+            flush_ = flush_func;
+        }
+
+        messages_.push_back(msg);
+    }
+
+    /*
+    @description
+    Passes all pending messages to the handler at once. The messages past
+    their deadline are dropped first, the earliest deadline left is current
+    while the handler runs.
+    */
+    void flush(Module& mod)
+    {
+        if (!messages_.empty())
+        {
+            struct clear_on_exit
+            {
+                ~clear_on_exit()
+                {
+                    messages.clear();
+                }
+                std::vector<Message>& messages;
+            } guard{ messages_ };
+
+            deadline_scope scope(drop_expired());
+            if (!messages_.empty())
+            {
+                flush_(mod, *this);
+            }
+        }
+    }
+
+    // @brief Returns the number of messages dropped since their deadline had passed
+    uint64_t expired() const
+    {
+        return expired_;
+    }
+
+    // @brief Checks if there are any pending messages
+    bool empty() const
+    {
+        return messages_.empty();
+    }
+
+    // @brief Returns the connection the pending messages were received on
+    void* connection() const
+    {
+        return conn_;
+    }
+
+    // @brief Returns the pending messages
+    span<const Message> messages() const
+    {
+        return span<const Message>(messages_.data(), messages_.size());
+    }
+
+    // @brief Returns reusable storage for the parsed messages of the given type
+    template <typename T>
+    std::vector<T>& parsed_storage()
+    {
+        if (static_cast<size_t>(type_) >= storage_.size())
+        {
+            storage_.resize(type_ + 1);
+        }
+
+        auto& slot = storage_[type_];
+        if (!slot)
+        {
+            slot = std::make_shared<std::vector<T>>();
+        }
+        return *static_cast<std::vector<T>*>(slot.get());
+    }
+
+private:
+    // @brief Removes the expired messages, returns the earliest deadline of the rest, zero if none
+    int64_t drop_expired()
+    {
+        int64_t now = 0;
+        int64_t earliest = 0;
+        auto it = std::remove_if(messages_.begin(), messages_.end(), [&now, &earliest](const Message & m)
+        {
+            if (!m.deadline)
+            {
+                return false;
+            }
+            if (!now)
+            {
+                now = deadline_clock_ns();
+            }
+            if (deadline_expired(m.deadline, now))
+            {
+                return true;
+            }
+            earliest = earliest ? std::min(earliest, m.deadline) : m.deadline;
+            return false;
+        });
+
+        expired_ += messages_.end() - it;
+        messages_.erase(it, messages_.end());
+        return earliest;
+    }
+
+    std::vector<Message> messages_;
+    std::vector<std::shared_ptr<void>> storage_;
+    void* conn_ = nullptr;
+    int type_ = 0;
+    flush_type flush_ = nullptr;
+    uint64_t expired_ = 0;
+};
+
+} // namespace protoserv
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <google/protobuf/message.h>
+
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace protoserv
+{
+/*
+@class message_template
+@description
+A message encoded once, the size and type header included, with some of its
+fixed-width fields (fixed32, fixed64, sfixed32, sfixed64, float, double)
+patched in place before every send. Sending a copy with new values costs
+the stores and a copy into the write buffer, nothing is serialized again.
+
+The patched fields are found in the prototype encoding by field number,
+so the prototype has to carry them: set them, to any value.
+*/
+class message_template
+{
+public:
+    // @brief Encodes the prototype, finds the fields to patch, throws if one is missing or not fixed-width
+    message_template(int messageType, const google::protobuf::Message& prototype,
+                     std::initializer_list<int> fields)
+    {
+        const auto size = 2 * sizeof(uint16_t) + prototype.ByteSize();
+        if (size > std::numeric_limits<uint16_t>::max())
+        {
+            throw std::length_error("message_template");
+        }
+
+        frame_.resize(size);
+        auto header = reinterpret_cast<uint16_t*>(&frame_[0]);
+        header[0] = static_cast<uint16_t>(size);
+        header[1] = static_cast<uint16_t>(messageType);
+        prototype.SerializePartialToArray(&header[2], static_cast<int>(size - 2 * sizeof(uint16_t)));
+
+        for (auto field : fields)
+        {
+            slots_.push_back(find_field(field));
+        }
+    }
+
+    // @brief Stores the value of the i-th field given to the constructor, the size must match the field
+    template <typename T>
+    message_template& set(size_t i, T value)
+    {
+        static_assert(sizeof(T) == 4 || sizeof(T) == 8, "fixed-width fields only");
+        // the wire format is little endian, so is the host
+        auto& s = slots_[i];
+        if (s.width != sizeof(T))
+        {
+            throw std::invalid_argument("message_template: field width mismatch");
+        }
+        std::memcpy(&frame_[s.offset], &value, sizeof(T));
+        return *this;
+    }
+
+    // @brief Sends the frame as it is now
+    template <typename Connection>
+    void send(Connection& conn) const
+    {
+        conn.send_encoded(frame_.data(), frame_.size());
+    }
+
+    // @brief Returns the encoded frame, the header included
+    const std::string& frame() const
+    {
+        return frame_;
+    }
+
+private:
+    struct slot
+    {
+        size_t offset;
+        size_t width;
+    };
+
+    // @brief Walks the top level fields of the encoding, returns the value slot of the field
+    slot find_field(int number) const
+    {
+        size_t pos = 2 * sizeof(uint16_t);
+        while (pos < frame_.size())
+        {
+            auto key = read_varint(pos);
+            auto wire_type = static_cast<int>(key & 7);
+            auto field = static_cast<int>(key >> 3);
+
+            size_t width = 0;
+            switch (wire_type)
+            {
+            case 0:
+                read_varint(pos);
+                break;
+            case 1:
+                width = 8;
+                break;
+            case 2:
+                pos += read_varint(pos);
+                break;
+            case 5:
+                width = 4;
+                break;
+            default:
+                throw std::invalid_argument("message_template: groups are not supported");
+            }
+
+            if (field == number)
+            {
+                if (!width)
+                {
+                    throw std::invalid_argument("message_template: field " + std::to_string(number) + " is not fixed-width");
+                }
+                return slot{ pos, width };
+            }
+            pos += width;
+        }
+        throw std::invalid_argument("message_template: field " + std::to_string(number) + " is not set in the prototype");
+    }
+
+    uint64_t read_varint(size_t& pos) const
+    {
+        uint64_t ret = 0;
+        for (int shift = 0; pos < frame_.size() && shift < 64; shift += 7)
+        {
+            auto b = static_cast<uint8_t>(frame_[pos++]);
+            ret |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80))
+            {
+                break;
+            }
+        }
+        return ret;
+    }
+
+    std::string frame_;
+    std::vector<slot> slots_;
+};
+
+} // namespace protoserv
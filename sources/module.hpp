@@ -22,3 +22,7 @@ class module_base< Module, meta::complete_protocol<Ts...> > :
 template <class Module, class Protocol, template <class> class ... Comp>
 class module_component
     : public module_pack<Module, cpack<Module, Comp...>, Protocol> {};
+
+template <class Module, class Policy, class ... Ts>
+class module_policy
+    : public module_pack<Module, cpack<Module>, meta::complete_protocol<Ts...>, Policy> {};
@@ -3,22 +3,32 @@
 #include "meta_protocol.hpp"
 #include "dispatch_table.hpp"
 #include "components.hpp"
+#include "scratch_arena.hpp"
+#include "load_shedder.hpp"
+#include "last_value_cache.hpp"
+#include "single_flight.hpp"
+#include "response_cache.hpp"
+#include "message_template.hpp"
 #include <string>
 #include <iostream>
 
 using application_server = protoserv::app_server;
 
 // @brief A protobuf message types aware TCP/IP server
-template <class Module, class ComponentPack, class ... Protocol>
+// @description
+// Policy defines the session buffer layout, see session_policy
+template <class Module, class ComponentPack, class Protocol,
+          class Policy = protoserv::default_session_policy>
 class module_pack;
 
-template <class Module, class ComponentPack, class Protocol, class ... Messages>
-class module_pack<Module, ComponentPack, meta::subprotocol<Protocol, Messages...>> :
-            public application_server, public ComponentPack
+template <class Module, class ComponentPack, class Protocol, class ... Messages, class Policy>
+class module_pack<Module, ComponentPack, meta::subprotocol<Protocol, Messages...>, Policy> :
+            public protoserv::basic_app_server<Policy>, public ComponentPack
 {
 public:
-    using ServerConnection = application_server::ServerConnection;
-    using ClientConnection = application_server::ClientConnection;
+    using server_type = protoserv::basic_app_server<Policy>;
+    using ServerConnection = typename server_type::ServerConnection;
+    using ClientConnection = typename server_type::ClientConnection;
     using protocol_pack = meta::subprotocol<Protocol, Messages...>;
 
     // @brief A wrapper around server connection
@@ -56,10 +66,12 @@ public:
         }
 
         // @brief Sends protobuf message to the server
+        // @description
+        // Sent from within a request handler, the message inherits the request deadline
         template <typename Message>
         void send(Message& msg)
         {
-            module_pack::send_message(*conn_, msg);
+            conn_->send(meta::identify<Protocol, std::decay_t<Message>>(), msg, protoserv::current_deadline());
         }
 
         // @brief Sends protobuf message to the server
@@ -68,7 +80,7 @@ public:
         // to bypass the message checking mechanism
         void send(int messageid, google::protobuf::Message& message)
         {
-            conn_->send(messageid, message);
+            conn_->send(messageid, message, protoserv::current_deadline());
         }
 
         // @brief Passes the server connection event to the handler
@@ -148,6 +160,12 @@ public:
             dispatcher_.dispatch(msg);
         }
 
+        // @brief Checks if the server connection is up
+        bool connected() const
+        {
+            return connected_;
+        }
+
         template <typename MessageHandler>
         void receive(MessageHandler&& handler)
         {
@@ -179,6 +197,82 @@ public:
         send_message(*conn, message);
     }
 
+    // @brief Keeps only the latest message of type T parked on a connection out of credit
+    template <typename T, typename Connection>
+    static void conflate(Connection& conn)
+    {
+        conn.conflate(meta::identify<Protocol, T>());
+    }
+
+    // @brief Encodes the prototype of type T once, the given fixed-width fields are patched before sends
+    template <typename T>
+    static protoserv::message_template make_template(const T& prototype, std::initializer_list<int> fields)
+    {
+        return protoserv::message_template(meta::identify<Protocol, T>(), prototype, fields);
+    }
+
+    // @brief Stores the message as the latest value of the key, see last_value_cache
+    template <typename T>
+    static void cache_message(protoserv::last_value_cache& cache, uint64_t key, const T& message)
+    {
+        cache.update(key, meta::identify<Protocol, T>(), message);
+    }
+
+    // @brief Drops the client requests of type T while the server is overloaded, see load_shedder
+    template <typename T>
+    void shed_when_overloaded()
+    {
+        shedder_.mark(meta::identify<Protocol, T>());
+    }
+
+    // @brief Answers the client requests of type T with the reply while the server is overloaded
+    // @description
+    // The reply is serialized once, here, shedding a request costs a copy into the write buffer.
+    template <typename T, typename Reply>
+    void shed_when_overloaded(const Reply& reply)
+    {
+        shedder_.mark(meta::identify<Protocol, T>(),
+                      protoserv::encode_packet(meta::identify<Protocol, Reply>(), reply));
+    }
+
+    // @brief Answers the client requests of type T from the response cache for the given time
+    // @description
+    // The request bytes are looked up before parsing, a hit sends the cached reply frame as is.
+    // On a miss, the reply the handler sends while handling the request is kept, if a single frame.
+    template <typename T, typename Duration>
+    void cache_responses(Duration ttl)
+    {
+        responses_.enable(meta::identify<Protocol, T>(),
+                          std::chrono::duration_cast<protoserv::response_cache::clock_type::duration>(ttl));
+    }
+
+    // @brief Forgets the cached reply to the request
+    template <typename T>
+    void invalidate_response(const T& request)
+    {
+        auto bytes = request.SerializePartialAsString();
+        responses_.invalidate(meta::identify<Protocol, T>(), bytes.data(), bytes.size());
+    }
+
+    // @brief Forgets the cached replies to all the requests of type T
+    template <typename T>
+    void invalidate_responses()
+    {
+        responses_.invalidate(meta::identify<Protocol, T>());
+    }
+
+    // @brief Returns the response cache, its size comes from the ResponseCacheSize option
+    protoserv::response_cache& response_cache()
+    {
+        return responses_;
+    }
+
+    // @brief Returns the load shedding state, the thresholds come from the options
+    protoserv::load_shedder& load_shedding()
+    {
+        return shedder_;
+    }
+
     // @brief Create synchronous server connection handler
     template <typename Handler>
     auto handle_server(Handler& handler, const std::string& ip, uint16_t port)
@@ -194,7 +288,7 @@ public:
     {
         auto client = std::make_shared<Client<Handler>>(handler);
         auto ptr = client.get();
-        auto& conn = connect_to_server(ip, port,
+        auto& conn = this->connect_to_server(ip, port,
                                        [ptr](auto & conn, auto && message)
         {
             ptr->handle_message(conn, std::forward<decltype(message)>(message));
@@ -218,7 +312,7 @@ public:
     {
         auto ptr = &client;
 
-        auto& conn = async_connect(ip, port,
+        auto& conn = this->async_connect(ip, port,
                                    [ptr](auto & conn, auto & message)
         {
             ptr->handle_message(conn, message);
@@ -252,6 +346,127 @@ public:
         return handle_server<AsyncHandler>(ip, port);
     }
 
+    // @brief Sends the read-only request to the primary upstream, and to the backup one if the reply is late
+    // @description
+    // The duplicate goes out once the reply is later than the hedge delay and the budget allows,
+    // see hedge_policy. The first reply is passed to the handler, the other one is consumed and
+    // ignored, so that the replies of the slower upstream stay in order. The handler gets an error
+    // only if no reply is going to come. Both upstreams come from handle_server_async.
+    template <typename Reply, typename Upstream, typename Request, typename ReplyHandler>
+    void send_hedged(std::shared_ptr<Upstream> primary, std::shared_ptr<Upstream> backup,
+                     Request& request, ReplyHandler&& handler)
+    {
+        using error_code = boost::system::error_code;
+        using clock_type = protoserv::hedge_policy::clock_type;
+
+        struct hedged_request
+        {
+            std::function<void(Reply&, error_code)> handler;
+            Request request;
+            clock_type::time_point started;
+            int pending = 1;
+            bool done = false;
+        };
+
+        auto& policy = this->hedging();
+        policy.started();
+
+        auto state = std::make_shared<hedged_request>();
+        state->handler = std::forward<ReplyHandler>(handler);
+        state->started = clock_type::now();
+
+        auto on_reply = [&policy, state](bool hedge)
+        {
+            return std::function<void(Reply&, error_code)>([&policy, state, hedge](Reply & reply, error_code err)
+            {
+                --state->pending;
+                if (!err && !hedge)
+                {
+                    // the primary latencies, won or lost, make the delay
+                    policy.record(clock_type::now() - state->started);
+                }
+                if (state->done || (err && state->pending))
+                {
+                    return;
+                }
+
+                state->done = true;
+                if (!err && hedge)
+                {
+                    policy.hedge_won();
+                }
+                state->handler(reply, err);
+            });
+        };
+
+        primary->send(request);
+        primary->receive(on_reply(false));
+        if (state->done)
+        {
+            // the primary upstream is down
+            return;
+        }
+
+        state->request = request;
+        this->async_wait(policy.delay(), [&policy, state, backup, on_reply]()
+        {
+            if (state->done || !policy.try_hedge())
+            {
+                return;
+            }
+            ++state->pending;
+            backup->send(state->request);
+            backup->receive(on_reply(true));
+        });
+    }
+
+    // @brief Passes the upstream reply to the request on to the connection, joins an identical call in flight
+    // @description
+    // Only the first of the identical concurrent requests goes upstream, the reply is encoded once
+    // and the frame is sent to every connection waiting for it. The upstream comes from
+    // handle_server_async; if it fails, the waiting connections get nothing. A connection
+    // gone meanwhile gets nothing either, its waiter is dropped.
+    template <typename Reply, typename Upstream, typename Request, typename Connection>
+    static void send_coalesced(protoserv::single_flight& flights, std::shared_ptr<Upstream> upstream,
+                               Request& request, Connection& conn)
+    {
+        auto key = protoserv::single_flight::key_of(meta::identify<Protocol, Request>(), request);
+        auto leader = flights.join(key, [&conn, alive = conn.alive_token()](const std::string * frame)
+        {
+            if (frame && !alive.expired())
+            {
+                conn.send_encoded(frame->data(), frame->size());
+            }
+        });
+        if (!leader)
+        {
+            return;
+        }
+
+        upstream->send(request);
+        upstream->receive(std::function<void(Reply&, boost::system::error_code)>(
+                              [&flights, key](Reply & reply, boost::system::error_code err)
+        {
+            if (err)
+            {
+                flights.fail(key);
+            }
+            else
+            {
+                flights.complete(key, protoserv::encode_packet(meta::identify<Protocol, Reply>(), reply));
+            }
+        }));
+    }
+
+    // @brief Returns the per-loop scratch memory for request-scoped temporaries
+    // @description
+    // The memory is reclaimed once all messages of the current read are dispatched,
+    // nothing allocated here may be kept beyond the message handler.
+    std::pmr::memory_resource* scratch_memory()
+    {
+        return &scratch_;
+    }
+
     // @brief Create asynchronous server connection handler
     auto handle_server_async(ServerConnection& conn)
     {
@@ -277,48 +492,57 @@ public:
     // @brief Construct server and subscribes to server events
     module_pack()
     {
-        subscribe_client([this](auto & conn, auto msg)
+        this->subscribe_client([this](auto & conn, auto msg)
         {
             dispatch_client(conn, msg);
         });
-        subscribe_server([this](auto & conn, auto msg)
+        this->subscribe_server([this](auto & conn, auto msg)
         {
             dispatch_server(conn, msg);
         });
 
-        onClientConnected = [this](auto & session)
+        this->onClientConnected = [this](auto & session)
         {
             dispatch_connected(session);
         };
-        onClientDisconnected = [this](auto & session)
+        this->onClientDisconnected = [this](auto & session)
         {
             dispatch_disconnected(session);
         };
 
-        onServerConnected = [this](auto & session)
+        this->onServerConnected = [this](auto & session)
         {
             dispatch_connected(session);
         };
-        onServerDisconnected = [this](auto & session)
+        this->onServerDisconnected = [this](auto & session)
         {
             dispatch_disconnected(session);
         };
 
-        onCommandReceived = [this](auto cmd)
+        this->onClientReadComplete = [this](auto&)
+        {
+            dispatch_read_complete();
+        };
+        this->onServerReadComplete = [this](auto&)
+        {
+            dispatch_read_complete();
+        };
+
+        this->onCommandReceived = [this](auto cmd)
         {
             dispatch_command(cmd);
         };
 
-        onApplicationInitialized = [this]()
+        this->onApplicationInitialized = [this]()
         {
             dispatch_initialized();
         };
-        onApplicationDeinitialized = [this]()
+        this->onApplicationDeinitialized = [this]()
         {
             dispatch_deinitialized();
         };
 
-        onConfigurationLoaded = [this](auto && conf)
+        this->onConfigurationLoaded = [this](auto && conf)
         {
             dispatch_configuration(conf);
         };
@@ -328,15 +552,47 @@ private:
     // @brief Dispatches client message to the derived class and its components
     void dispatch_client(ClientConnection& conn, const protoserv::Message& msg)
     {
+        // a cached reply is cheaper than a shed one, served even when overloaded
+        auto cached = responses_.enabled(msg.type);
+        auto now = cached ? protoserv::response_cache::clock_type::now() : protoserv::response_cache::clock_type::time_point();
+        if (cached)
+        {
+            auto reply = responses_.find(msg.type, msg.data, msg.size, now);
+            if (reply)
+            {
+                conn.send_encoded(reply->data(), reply->size());
+                return;
+            }
+        }
+
+        if (shedder_.try_shed(conn, msg.type))
+        {
+            return;
+        }
+
+        if (cached)
+        {
+            reply_capture_.clear();
+            conn.capture_sent(&reply_capture_);
+        }
+
+        protoserv::deadline_scope scope(msg.deadline);
         dispatch_message(conn, msg.type, msg.data, msg.size);
 
         ComponentPack::template dispatch_component_message<protocol_pack, Messages...>(
             conn, msg.type, msg.data, msg.size);
+
+        if (cached)
+        {
+            conn.capture_sent(nullptr);
+            responses_.store(msg.type, msg.data, msg.size, reply_capture_, now);
+        }
     }
 
     // @brief Dispatches server message to the derived class, server handler and components
     void dispatch_server(ServerConnection& conn, const protoserv::Message& msg)
     {
+        protoserv::deadline_scope scope(msg.deadline);
         dispatch_message(conn, msg.type, msg.data, msg.size);
 
         ComponentPack::template dispatch_component_message<protocol_pack, Messages...>(
@@ -349,7 +605,14 @@ private:
     void dispatch_message(Connection& conn, int id, const void* buf, int len)
     {
         auto& mod = static_cast<Module&>(*this);
-        meta::dispatcher<Module, Protocol, Messages...>::dispatch(mod, conn, id, buf, len);
+        meta::batch_dispatcher<Module, Protocol, Messages...>::dispatch(mod, batch_, conn, id, buf, len);
+    }
+
+    // @brief Passes the batched messages of the last read to the derived class
+    void dispatch_read_complete()
+    {
+        batch_.flush(static_cast<Module&>(*this));
+        scratch_.reset();
     }
 
     // @brief Dispatches connection event to the derived class and components
@@ -396,8 +659,38 @@ private:
     // @brief Dispaches configuration change event to the derived class and components
     void dispatch_configuration(const protoserv::Options& conf)
     {
+        configure_load_shedding(conf);
+        responses_.resize(boost::lexical_cast<size_t>(protoserv::get_opt(conf, "ResponseCacheSize", "1024")));
+
         auto& mod = static_cast<Module&>(*this);
         meta::call_on_configuration(mod, conf, 0);
         ComponentPack::configure_component(conf);
     }
+
+    // @brief Sets the shedding thresholds, starts the loop lag probe if needed
+    void configure_load_shedding(const protoserv::Options& conf)
+    {
+        using protoserv::get_opt;
+
+        auto max_lag = std::chrono::microseconds(
+                           boost::lexical_cast<int64_t>(get_opt(conf, "ShedLoopLag", "0")));
+        auto max_queued = boost::lexical_cast<size_t>(get_opt(conf, "ShedQueuedBytes", "0"));
+        shedder_.configure(max_lag, max_queued);
+
+        if (max_lag.count() > 0)
+        {
+            auto interval = std::chrono::milliseconds(
+                                boost::lexical_cast<int>(get_opt(conf, "ShedProbeInterval", "10")));
+            this->async_wait_period(interval, [this]()
+            {
+                shedder_.tick(protoserv::load_shedder::clock_type::now(), this->tick_deadline());
+            });
+        }
+    }
+
+    protoserv::message_batch<Module> batch_;
+    protoserv::scratch_arena scratch_;
+    protoserv::load_shedder shedder_;
+    protoserv::response_cache responses_;
+    std::string reply_capture_;
 };
@@ -219,6 +219,20 @@ public:
         }
     }
 
+    // @brief Returns the number of slabs, each holding up to N objects
+    size_t slab_count() const
+    {
+        return slabs_.size();
+    }
+
+    // @brief Visits allocated objects of the given slab only
+    template <typename Func>
+    void foreach_in_slab(size_t slab, Func && func)
+    {
+        assert(slab < slabs_.size());
+        slabs_[slab]->foreach(std::forward<Func>(func));
+    }
+
     // @brief Desctoys all objects, clears memory
     void destroy_all()
     {
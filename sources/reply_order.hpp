@@ -0,0 +1,286 @@
+#pragma once
+
+#include <google/protobuf/message.h>
+
+#include <cassert>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace protoserv
+{
+/*
+@class reply_order
+@description
+The per-session reorder buffer of the deferred replies. A handler that can't
+answer right away reserves a slot (see basic_session::defer_reply()). From then
+on, everything the session sends is held behind the slot, and it goes out
+once the slots before it are complete. The requests keep being handled
+meanwhile, only their replies wait.
+
+The slots are released in the order they were reserved, a slot completed
+early waits for the ones ahead of it. With no slot pending the frames pass
+straight through. The frames held are limited in bytes, a reply which never
+comes must not make the session buffer forever. Single threaded: complete
+the replies on the session loop.
+*/
+class reply_order
+{
+public:
+    // @brief Takes the frames released, in order
+    using sink_type = std::function<void(const void*, size_t)>;
+
+    // @brief The held bytes limit unless set otherwise
+    static constexpr size_t default_hold_limit = 16 * 1024 * 1024;
+
+    explicit reply_order(sink_type sink)
+        : sink_(std::move(sink))
+    {
+    }
+
+    // @brief Sets the limit of the held bytes, see send()
+    void set_hold_limit(size_t bytes)
+    {
+        hold_limit_ = bytes;
+    }
+
+    // @brief Reserves the slot of a reply to come, returns its number
+    uint64_t reserve()
+    {
+        slots_.emplace_back();
+        ++deferred_;
+        return base_ + slots_.size() - 1;
+    }
+
+    // @brief Adds the frame to the reserved slot, or sends it as any other frame once the slot is complete
+    void add(uint64_t slot, const void* buf, size_t len)
+    {
+        if (auto s = find(slot))
+        {
+            s->append(buf, len);
+            held_bytes_ += len;
+            return;
+        }
+        send(buf, len);
+    }
+
+    // @brief Completes the reserved slot, releases the slots complete from the head on
+    void complete(uint64_t slot)
+    {
+        auto s = find(slot);
+        if (!s)
+        {
+            return;
+        }
+        s->done = true;
+        --deferred_;
+        release();
+    }
+
+    /*
+    @description
+    Sends the frame, holds it behind the pending slots if any.
+    Returns false, holding nothing, if the held bytes would exceed the limit.
+    */
+    bool send(const void* buf, size_t len)
+    {
+        if (slots_.empty())
+        {
+            sink_(buf, len);
+            return true;
+        }
+        if (held_bytes_ + len > hold_limit_)
+        {
+            return false;
+        }
+
+        if (!slots_.back().done)
+        {
+            // a new slot for the frames sent after the pending reply
+            slots_.emplace_back();
+            slots_.back().done = true;
+        }
+        slots_.back().append(buf, len);
+        held_bytes_ += len;
+        ++held_;
+        return true;
+    }
+
+    // @brief Checks if the reserved slot waits for its reply
+    bool pending(uint64_t slot) const
+    {
+        return slot >= base_ && slot - base_ < slots_.size() && !slots_[slot - base_].done;
+    }
+
+    // @brief Checks if the frames are held
+    bool holding() const
+    {
+        return !slots_.empty();
+    }
+
+    // @brief Returns the number of the replies reserved, not complete yet
+    size_t deferred() const
+    {
+        return deferred_;
+    }
+
+    // @brief Returns the number of the frames held behind a pending reply so far
+    uint64_t held() const
+    {
+        return held_;
+    }
+
+    // @brief Returns the number of bytes held now
+    size_t held_bytes() const
+    {
+        return held_bytes_;
+    }
+
+private:
+    struct slot
+    {
+        bool done = false;
+        std::string bytes;
+        // the sizes of the frames sent, a frame goes on as it was sent
+        std::vector<size_t> chunks;
+
+        void append(const void* buf, size_t len)
+        {
+            bytes.append(static_cast<const char*>(buf), len);
+            chunks.push_back(len);
+        }
+    };
+
+    // @brief Returns the slot unless released or complete already
+    slot* find(uint64_t n)
+    {
+        return pending(n) ? &slots_[n - base_] : nullptr;
+    }
+
+    void release()
+    {
+        while (!slots_.empty() && slots_.front().done)
+        {
+            // the sink may send again, take the slot out first
+            auto s = std::move(slots_.front());
+            slots_.pop_front();
+            ++base_;
+            held_bytes_ -= s.bytes.size();
+
+            size_t pos = 0;
+            for (auto len : s.chunks)
+            {
+                sink_(s.bytes.data() + pos, len);
+                pos += len;
+            }
+        }
+    }
+
+    sink_type sink_;
+    std::deque<slot> slots_;
+    uint64_t base_ = 0;
+    size_t deferred_ = 0;
+    uint64_t held_ = 0;
+    size_t held_bytes_ = 0;
+    size_t hold_limit_ = default_hold_limit;
+};
+
+/*
+@class deferred_reply
+@description
+The reply to a request a handler answers later, e.g. once the upstream
+replies. Keep a copy (it is cheap to copy) and send the reply through it
+with send_message(), the reply goes out in the request order. Sending
+completes it; the last copy dropped completes it as well, with no reply.
+Does nothing once the session is gone.
+*/
+class deferred_reply
+{
+public:
+    deferred_reply() = default;
+
+    deferred_reply(std::weak_ptr<reply_order> order, uint64_t slot)
+        : state_(std::make_shared<state>(std::move(order), slot))
+    {
+    }
+
+    // @brief Sends the reply and completes it, see module_pack::send_message()
+    void send(int messageType, const google::protobuf::Message& msg)
+    {
+        constexpr auto header_size = 2 * sizeof(uint16_t);
+        const auto message_size = msg.ByteSize();
+        const auto size = header_size + message_size;
+        assert(size <= std::numeric_limits<uint16_t>::max());
+
+        std::string frame(size, '\0');
+        auto header = reinterpret_cast<uint16_t*>(&frame[0]);
+        header[0] = static_cast<uint16_t>(size);
+        header[1] = static_cast<uint16_t>(messageType);
+        msg.SerializePartialToArray(&header[2], message_size);
+        send_encoded(frame.data(), frame.size());
+    }
+
+    // @brief Sends the reply encoded beforehand and completes it
+    void send_encoded(const void* frame, size_t len)
+    {
+        if (!state_)
+        {
+            return;
+        }
+        if (auto order = state_->order.lock())
+        {
+            order->add(state_->slot, frame, len);
+            order->complete(state_->slot);
+        }
+    }
+
+    // @brief Completes the reply with nothing sent, lets the replies behind it go
+    void cancel()
+    {
+        if (state_)
+        {
+            state_->complete();
+        }
+    }
+
+    // @brief Checks if the reply still waits to be sent
+    bool pending() const
+    {
+        auto order = state_ ? state_->order.lock() : nullptr;
+        return order && order->pending(state_->slot);
+    }
+
+private:
+    struct state
+    {
+        state(std::weak_ptr<reply_order> order, uint64_t slot)
+            : order(std::move(order))
+            , slot(slot)
+        {
+        }
+
+        ~state()
+        {
+            complete();
+        }
+
+        void complete()
+        {
+            if (auto o = order.lock())
+            {
+                o->complete(slot);
+            }
+        }
+
+        std::weak_ptr<reply_order> order;
+        uint64_t slot;
+    };
+
+    std::shared_ptr<state> state_;
+};
+
+} // namespace protoserv
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace protoserv
+{
+/*
+@class response_cache
+@description
+The encoded reply frames of the idempotent requests, by the message type and
+the raw request bytes, looked up before the request is parsed. Every message
+type has its own time to live, the types not enabled are never cached.
+
+The table is bounded: open addressing, a key lives within a short probe
+window of its home slot. A new key takes a free or an expired slot of the
+window, or evicts the entry of the window expiring first. The slots keep
+their buffers, so the steady state does not allocate.
+*/
+class response_cache
+{
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    static constexpr size_t probe_window = 8;
+
+    explicit response_cache(size_t capacity = 1024)
+    {
+        resize(capacity);
+    }
+
+    // @brief Drops everything, makes room for about the given number of replies
+    void resize(size_t capacity)
+    {
+        size_t n = probe_window;
+        while (n < capacity)
+        {
+            n *= 2;
+        }
+        slots_.assign(n, slot());
+    }
+
+    // @brief Caches the replies to the requests of the type for the given time
+    void enable(int type, clock_type::duration ttl)
+    {
+        if (type >= static_cast<int>(ttl_.size()))
+        {
+            ttl_.resize(type + 1, clock_type::duration::zero());
+        }
+        ttl_[type] = ttl;
+    }
+
+    // @brief Checks if the replies to the requests of the type are cached
+    bool enabled(int type) const
+    {
+        return type < static_cast<int>(ttl_.size()) && ttl_[type] > clock_type::duration::zero();
+    }
+
+    // @brief Returns the reply frame to the request, nullptr if none or expired
+    const std::string* find(int type, const void* request, size_t len, clock_type::time_point now)
+    {
+        auto h = hash(type, request, len);
+        auto s = lookup(h, type, request, len);
+        if (s && s->expires > now)
+        {
+            ++hits_;
+            return &s->reply;
+        }
+        ++misses_;
+        return nullptr;
+    }
+
+    // @brief Keeps the reply to the request, false unless the reply is a single frame
+    bool store(int type, const void* request, size_t len, const std::string& reply, clock_type::time_point now)
+    {
+        if (!enabled(type) || reply.size() < 2 * sizeof(uint16_t) ||
+                *reinterpret_cast<const uint16_t*>(reply.data()) != reply.size())
+        {
+            return false;
+        }
+
+        auto h = hash(type, request, len);
+        auto& s = slot_for(h, type, request, len, now);
+        s.used = true;
+        s.hash = h;
+        s.type = type;
+        s.request.assign(static_cast<const char*>(request), len);
+        s.reply = reply;
+        s.expires = now + ttl_[type];
+        return true;
+    }
+
+    // @brief Forgets the reply to the request
+    bool invalidate(int type, const void* request, size_t len)
+    {
+        auto s = lookup(hash(type, request, len), type, request, len);
+        if (s)
+        {
+            s->used = false;
+        }
+        return s != nullptr;
+    }
+
+    // @brief Forgets the replies to all the requests of the type
+    void invalidate(int type)
+    {
+        for (auto& s : slots_)
+        {
+            if (s.type == type)
+            {
+                s.used = false;
+            }
+        }
+    }
+
+    // @brief Returns the number of requests answered from the cache
+    uint64_t hits() const
+    {
+        return hits_;
+    }
+
+    // @brief Returns the number of requests of the enabled types not found in the cache
+    uint64_t misses() const
+    {
+        return misses_;
+    }
+
+private:
+    struct slot
+    {
+        uint64_t hash = 0;
+        int type = -1;
+        bool used = false;
+        clock_type::time_point expires;
+        std::string request;
+        std::string reply;
+    };
+
+    // @brief Hashes the type and the request bytes, a word at a time
+    static uint64_t hash(int type, const void* request, size_t len)
+    {
+        auto p = static_cast<const uint8_t*>(request);
+        uint64_t h = 0x9e3779b97f4a7c15ULL ^ (static_cast<uint64_t>(type) << 32 | len);
+
+        for (; len >= sizeof(uint64_t); len -= sizeof(uint64_t), p += sizeof(uint64_t))
+        {
+            uint64_t w;
+            std::memcpy(&w, p, sizeof(w));
+            h = (h ^ mix(w)) * 0xff51afd7ed558ccdULL;
+        }
+        uint64_t tail = 0;
+        if (len)
+        {
+            std::memcpy(&tail, p, len);
+        }
+        return mix(h ^ tail);
+    }
+
+    // @brief The splitmix64 finalizer
+    static uint64_t mix(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+    slot* lookup(uint64_t h, int type, const void* request, size_t len)
+    {
+        auto mask = slots_.size() - 1;
+        for (size_t i = 0; i < probe_window; ++i)
+        {
+            auto& s = slots_[(h + i) & mask];
+            if (s.used && s.hash == h && s.type == type && s.request.size() == len &&
+                    std::memcmp(s.request.data(), request, len) == 0)
+            {
+                return &s;
+            }
+        }
+        return nullptr;
+    }
+
+    // @brief Finds the slot of the key, or the free, expired or expiring first one of the window
+    slot& slot_for(uint64_t h, int type, const void* request, size_t len, clock_type::time_point now)
+    {
+        if (auto s = lookup(h, type, request, len))
+        {
+            return *s;
+        }
+
+        auto mask = slots_.size() - 1;
+        slot* victim = nullptr;
+        for (size_t i = 0; i < probe_window; ++i)
+        {
+            auto& s = slots_[(h + i) & mask];
+            if (!s.used || s.expires <= now)
+            {
+                return s;
+            }
+            if (!victim || s.expires < victim->expires)
+            {
+                victim = &s;
+            }
+        }
+        return *victim;
+    }
+
+    std::vector<slot> slots_;
+    std::vector<clock_type::duration> ttl_;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
+
+} // namespace protoserv
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <memory_resource>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+namespace protoserv
+{
+/*
+@description
+Bump allocator for request-scoped temporaries. Allocation is a pointer
+increment, deallocation does nothing, and reset() makes all the memory
+available again at once. If one chunk was not enough between two resets,
+the chunks are merged into a single bigger one on reset, so the arena settles
+at the high-water mark. Debug builds count live allocations and the ones
+still alive when the arena is reset, see outlived().
+*/
+class scratch_arena : public std::pmr::memory_resource
+{
+public:
+    explicit scratch_arena(size_t chunk_size = 64 * 1024)
+        : chunk_size_(chunk_size)
+    {
+    }
+
+    scratch_arena(const scratch_arena&) = delete;
+    scratch_arena& operator =(const scratch_arena&) = delete;
+
+    // @brief Makes all previously allocated memory available for reuse
+    void reset()
+    {
+#ifndef NDEBUG
+        outlived_ += live_;
+        live_ = 0;
+#endif
+
+        if (chunks_.size() > 1)
+        {
+            // merge the chunks, so that the next round fits into a single one
+            size_t total = 0;
+            for (auto& c : chunks_)
+            {
+                total += c.size;
+            }
+            chunks_.clear();
+            add_chunk(total);
+        }
+
+        if (!chunks_.empty())
+        {
+            cur_ = chunks_.back().data.get();
+            end_ = cur_ + chunks_.back().size;
+        }
+    }
+
+    // @brief Returns the number of bytes handed out since the last reset
+    size_t used() const
+    {
+        size_t used = 0;
+        for (auto& c : chunks_)
+        {
+            used += c.size;
+        }
+        return used - (end_ - cur_);
+    }
+
+    // @brief Returns the number of bytes held by the arena
+    size_t capacity() const
+    {
+        size_t capacity = 0;
+        for (auto& c : chunks_)
+        {
+            capacity += c.size;
+        }
+        return capacity;
+    }
+
+    // @brief Returns the number of allocations which outlived a reset, debug builds only
+    size_t outlived() const
+    {
+        return outlived_;
+    }
+
+protected:
+    // @brief Bumps the pointer, allocates another chunk if the current one is used up
+    void* do_allocate(size_t bytes, size_t alignment) override
+    {
+        auto p = align(cur_, alignment);
+        if (!cur_ || p + bytes > end_)
+        {
+            add_chunk(std::max(chunk_size_, bytes + alignment));
+            p = align(cur_, alignment);
+        }
+
+        cur_ = p + bytes;
+#ifndef NDEBUG
+        ++live_;
+#endif
+        return p;
+    }
+
+    // @brief The memory is reclaimed by reset() only
+    void do_deallocate(void*, size_t, size_t) override
+    {
+#ifndef NDEBUG
+        if (live_ > 0)
+        {
+            --live_;
+        }
+#endif
+    }
+
+    // @brief Arenas are interchangeable with themselves only
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override
+    {
+        return this == &other;
+    }
+
+private:
+    struct chunk
+    {
+        std::unique_ptr<uint8_t[]> data;
+        size_t size;
+    };
+
+    // @brief Rounds the pointer up to the given alignment
+    static uint8_t* align(uint8_t* p, size_t alignment)
+    {
+        auto addr = reinterpret_cast<uintptr_t>(p);
+        addr = (addr + alignment - 1) & ~(alignment - 1);
+        return reinterpret_cast<uint8_t*>(addr);
+    }
+
+    // @brief Allocates new chunk and makes it the current one
+    void add_chunk(size_t size)
+    {
+        chunks_.push_back(chunk{ std::unique_ptr<uint8_t[]>(new uint8_t[size]), size });
+        cur_ = chunks_.back().data.get();
+        end_ = cur_ + size;
+    }
+
+    std::vector<chunk> chunks_;
+    uint8_t* cur_ = nullptr;
+    uint8_t* end_ = nullptr;
+    size_t chunk_size_;
+    size_t live_ = 0;
+    size_t outlived_ = 0;
+};
+
+} // namespace protoserv
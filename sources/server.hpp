@@ -5,8 +5,14 @@
 #include "object_pool.hpp"
 #include "timer.hpp"
 #include "async_stdin.hpp"
+#include "admin_endpoint.hpp"
+#include "stats_segment.hpp"
+#include "hedging.hpp"
+#include "loop_balancer.hpp"
 #include <string>
+#include <thread>
 #include <vector>
+#include <type_traits>
 
 namespace protoserv
 {
@@ -16,19 +22,53 @@ using Option = Options::value_type;
 
 class server_error : public std::exception {};
 
+// @brief The loop the servers constructed in the calling thread share, see basic_app_server::add_listener()
+inline boost::asio::io_service*& borrowed_loop()
+{
+    static thread_local boost::asio::io_service* loop = nullptr;
+    return loop;
+}
+
+// @brief Lends the loop to the servers constructed in its scope, see borrowed_loop()
+class loop_loan
+{
+public:
+    explicit loop_loan(boost::asio::io_service* loop)
+        : previous_(borrowed_loop())
+    {
+        borrowed_loop() = loop;
+    }
+
+    ~loop_loan()
+    {
+        borrowed_loop() = previous_;
+    }
+
+    loop_loan(const loop_loan&) = delete;
+    loop_loan& operator =(const loop_loan&) = delete;
+
+private:
+    boost::asio::io_service* previous_;
+};
+
 // @brief Single-threaded, asynchronous TCP/IP server
-class app_server
+// @description
+// Policy defines the session buffer layout, see session_policy
+template <typename Policy = default_session_policy>
+class basic_app_server
 {
 public:
     using tcp = boost::asio::ip::tcp;
     using error_code = boost::system::error_code;
+    using policy_type = Policy;
 
-    using client_session = basic_client_session<app_server>;
+    using client_session = basic_client_session<basic_app_server, Policy>;
+    using server_session = basic_server_session<Policy>;
     using ClientConnection = client_session;
     using ServerConnection = server_session;
 
-    app_server();
-    ~app_server();
+    basic_app_server();
+    ~basic_app_server();
 
     // @brief Runs server in the current thread
     void run_server(const std::string& app_name, const Options& opts);
@@ -36,19 +76,59 @@ public:
     // @brief When passed false, terminates the server
     void set_active(bool active);
 
+    // @brief Declares the listener of the given name, served by a module of its own
+    // @description
+    // The listener is configured with the Listener.<name>.* options, the keys are those
+    // of the server (Port, ReadBufferSize, FlowControlWindow...) with the prefix. Without
+    // Listener.<name>.Port there is no listener. The module runs on the loop of this server,
+    // or, with Listener.<name>.Loop set to "dedicated", on a loop thread of its own: the bulk
+    // traffic of one listener then adds no latency to the others. The module is created
+    // as the server runs, init (if any) is called on it before it starts. A module sharing
+    // the loop stops it for the server as well, see set_active(). An exception escaping
+    // the dedicated loop is rethrown on the loop of this server, as on the shared one.
+    template <typename Module>
+    void add_listener(const std::string& name, std::function<void(Module&)> init = nullptr)
+    {
+        static_assert(std::is_base_of<basic_app_server, Module>::value, "a module of the same session policy expected");
+
+        listeners_.emplace_back();
+        listeners_.back().name = name;
+        listeners_.back().create = [init](boost::asio::io_service * loop)
+        {
+            std::shared_ptr<Module> module;
+            {
+                // the module constructor picks the loop up, see basic_app_server()
+                loop_loan loan(loop);
+                module = std::make_shared<Module>();
+            }
+
+            module->listener_ = true;
+            if (init)
+            {
+                init(*module);
+            }
+            return std::shared_ptr<basic_app_server>(std::move(module));
+        };
+    }
+
     // @brief Client events
     std::function<void(client_session&, const Message&)> onClientMessage;
     std::function<void(client_session&)> onClientConnected;
     std::function<void(client_session&)> onClientDisconnected;
+    std::function<void(client_session&)> onClientReadComplete;
 
     // @brief Server events
     std::function<void(server_session&, const Message&)> onServerMessage;
     std::function<void(server_session&)> onServerConnected;
     std::function<void(server_session&)> onServerDisconnected;
+    std::function<void(server_session&)> onServerReadComplete;
 
     // @brief Stdin command event
     std::function<void(const command&)> onCommandReceived;
 
+    // @brief Metrics scrape event, lets the application add its own metrics
+    std::function<void(metrics_writer&)> onMetricsScraped;
+
     // @brief Application events
     std::function<void(void)> onApplicationInitialized;
     std::function<void(void)> onApplicationDeinitialized;
@@ -57,12 +137,14 @@ public:
     // @brief Notifies about new protobuf message incoming from the client
     void notify_message(client_session& session, const Message& msg)
     {
+        ++client_messages_;
         onClientMessage(session, msg);
     }
 
     // @brief Notifies about client connection being established
     void notify_connected(client_session& session)
     {
+        ++client_connections_;
         onClientConnected(session);
     }
 
@@ -72,9 +154,16 @@ public:
         onClientDisconnected(session);
     }
 
+    // @brief Notifies that all messages of the last client read were passed on
+    void notify_read_complete(client_session& session)
+    {
+        onClientReadComplete(session);
+    }
+
     // @brief Notifies about new server message
     void notify_message(server_session& session, const Message& msg)
     {
+        ++server_messages_;
         onServerMessage(session, msg);
     }
 
@@ -132,6 +221,22 @@ public:
         decltype(onServerDisconnected) disconnectHandler
     );
 
+    // @brief Creates a client session on the in-process transport, see basic_session::start_loopback
+    // @description
+    // The session bytes go to the sink, the peer bytes are fed with loopback_receive() of the
+    // returned session. Everything runs in the calling thread, the server must not be running
+    // in another one. Handy for socket-free tests and benchmarks, see loopback_client
+    client_session& connect_loopback(typename client_session::loopback_sink sink);
+
+    // @brief Runs the handlers which are ready to run, returns the number of handlers run
+    // @description
+    // Lets a server driven over the loopback transport fire its timers and posted handlers
+    size_t poll()
+    {
+        service_.reset();
+        return service_.poll();
+    }
+
     // @brief Asynchronously waits for timer event and fires the give handler
     template <typename Timeout>
     void async_wait(Timeout timeout, std::function<void()> handler)
@@ -153,15 +258,25 @@ public:
     }
 
     // @brief Creates periodic asynchronous timer event
+    // @description
+    // The ticks are due on absolute deadlines, the handler time does not shift them.
+    // The late and missed ticks are counted, see write_metrics().
     template <typename Period>
-    void async_wait_period(Period period, std::function<void()> handler)
+    void async_wait_period(Period period, std::function<void()> handler, tick_policy policy = tick_policy::skip)
     {
-        auto timer = std::make_shared<boost::asio::deadline_timer>(service_);
-
-        auto microsec = std::chrono::duration_cast<std::chrono::microseconds>(period);
+        auto p = std::make_shared<periodic_wait>(service_);
+        p->handler = std::move(handler);
+        p->schedule.set_policy(policy);
+        p->schedule.set_slack(timer_slack_);
+        p->schedule.start(std::chrono::duration_cast<tick_schedule::clock_type::duration>(period),
+                          tick_schedule::clock_type::now());
+        do_async_wait_period(std::move(p));
+    }
 
-        auto pp = boost::posix_time::microseconds(microsec.count());
-        do_async_wait_period(std::move(timer), pp, handler);
+    // @brief Returns the deadline of the periodic tick being run, valid in an async_wait_period() handler
+    tick_schedule::clock_type::time_point tick_deadline() const
+    {
+        return tick_deadline_;
     }
 
     // @brief Closes inactive client connections
@@ -184,15 +299,97 @@ public:
         });
     }
 
+    // @brief Returns read buffer memory of sessions quiet for longer than the given duration
+    template <typename Duration>
+    void async_release_idle_read_buffers(Duration duration)
+    {
+        service_.dispatch([this, duration]()
+        {
+            release_idle_read_buffers(duration);
+        });
+    }
+
+    // @brief Returns the number of bytes held by all session read buffers
+    // @description
+    // Not thread-safe, to be called from within the server thread only
+    size_t read_buffer_bytes()
+    {
+        size_t bytes = 0;
+        clients_.foreach([&bytes](auto session)
+        {
+            bytes += session->read_buffer_bytes();
+        });
+        servers_.foreach([&bytes](auto session)
+        {
+            bytes += session->read_buffer_bytes();
+        });
+        return bytes;
+    }
+
+    // @brief Summarizes the last TCP_INFO samples of client and server sessions
+    // @description
+    // The samples are taken every TcpInfoInterval milliseconds, one slab of sessions
+    // at a time. Not thread-safe, to be called from within the server thread only
+    tcp_summary tcp_info_summary()
+    {
+        tcp_summary summary;
+        clients_.foreach([&summary](auto session)
+        {
+            summary.add(session->tcp_info());
+        });
+        servers_.foreach([&summary](auto session)
+        {
+            summary.add(session->tcp_info());
+        });
+        return summary;
+    }
+
+    // @brief Writes the server metrics, then lets the application add its own
+    // @description
+    // Not thread-safe, to be called from within the server thread only
+    void write_metrics(metrics_writer& writer);
+
+    // @brief Returns the per message type latency breakdown
+    // @description
+    // Collected when the LatencyStats option is set, the kernel-to-read phase requires
+    // RxTimestamps as well. Not thread-safe, to be called from within the server thread only
+    const latency_stats& latency() const
+    {
+        return latency_;
+    }
+
+    // @brief Returns the hedging state of the upstream requests, see module_pack::send_hedged
+    // @description
+    // Configured with the HedgePercentile, HedgeMinDelay and HedgeBudget options.
+    // Not thread-safe, to be called from within the server thread only
+    hedge_policy& hedging()
+    {
+        return hedging_;
+    }
+
     // @brief Creates asynchronous timer
     template <typename Period>
     std::shared_ptr<Timer> create_timer(Period period, std::function<void(void)> handler)
     {
         auto timer = std::make_shared<Timer>(service_);
+        timer->set_slack(timer_slack_);
         timer->start(period, handler);
         return std::move(timer);
     }
 
+    // @brief Moves the client session over to the other loop, see basic_session::hand_off()
+    // @description
+    // The session leaves between its read batches, the other loop carries on with the socket,
+    // the bytes not parsed or not sent yet and the user data. The handlers of this loop see
+    // a disconnect, those of the other one a connect. Returns false if the session can't move.
+    // Not thread-safe, to be called from within the server thread only, the other loop may run anywhere
+    bool migrate(client_session& session, basic_app_server& target);
+
+    // @brief Joins the balancer, which moves the client sessions between the loops, see loop_balancer
+    // @description
+    // To be called before any of the loops runs, the balancer must outlive them
+    void balance(loop_balancer<basic_app_server>& balancer);
+
     // @brief Destroys the client session
     void remove_session(client_session* session)
     {
@@ -234,6 +431,53 @@ public:
     }
 
 private:
+    /*
+    @description
+    Turns on the latency instrumentation, TLS, flow control and resumable streams
+    of the session, as configured. The upstream sessions initiate the credit protocol,
+    the client ones serve the streams.
+    */
+    template <typename Session>
+    void instrument_session(Session& session)
+    {
+        constexpr bool upstream = std::is_same<Session, server_session>::value;
+
+        if (rx_timestamps_)
+        {
+            session.enable_rx_timestamps();
+        }
+        if (latency_stats_)
+        {
+            session.set_latency_stats(&latency_);
+        }
+
+        auto& tls = upstream ? tls_upstream_ : tls_listener_;
+        if (tls)
+        {
+            session.enable_tls(*tls);
+        }
+        if (flow_window_)
+        {
+            session.enable_flow_control(flow_window_, flow_bytes_, upstream);
+        }
+        if (flow_park_limit_)
+        {
+            session.limit_parked_bytes(flow_park_limit_);
+        }
+        if (reply_hold_limit_)
+        {
+            session.limit_held_bytes(reply_hold_limit_);
+        }
+        if (!upstream && streams_)
+        {
+            session.enable_resume(*streams_);
+        }
+        if (!upstream && balancer_)
+        {
+            session.measure_busy_time(true);
+        }
+    }
+
     // @brief Disconnects any stale client connections
     template <typename Duration>
     void disconnect_inactive_clients(Duration duration)
@@ -254,25 +498,99 @@ private:
         });
     }
 
-    // @brief Schedules a recurring timer event
-    template <typename Timer, typename Period>
-    static void do_async_wait_period(
-        Timer&& timer, Period period, std::function<void()> handler)
+    // @brief Shrinks read buffers of quiet client and server connections
+    template <typename Duration>
+    void release_idle_read_buffers(Duration duration)
+    {
+        clients_.foreach([duration](auto session)
+        {
+            session->release_idle_read_buffer(duration);
+        });
+        servers_.foreach([duration](auto session)
+        {
+            session->release_idle_read_buffer(duration);
+        });
+    }
+
+    // @brief Samples TCP_INFO of the next slab of client and server sessions
+    // @description
+    // A slab holds up to 256 sessions, which bounds the number of syscalls per call,
+    // the whole population is covered in a round-robin fashion
+    void sample_tcp_info()
+    {
+        sample_tcp_info(clients_, next_client_slab_);
+        sample_tcp_info(servers_, next_server_slab_);
+    }
+
+    // @brief Samples TCP_INFO of a single slab of the pool
+    template <typename Pool>
+    static void sample_tcp_info(Pool& pool, size_t& next_slab)
+    {
+        if (pool.slab_count())
+        {
+            next_slab %= pool.slab_count();
+            pool.foreach_in_slab(next_slab++, [](auto session)
+            {
+                session->sample_tcp_info();
+            });
+        }
+    }
+
+    // @brief A recurring timer event, see async_wait_period()
+    struct periodic_wait
     {
-        timer->expires_from_now(period);
+        explicit periodic_wait(boost::asio::io_service& svc)
+            : timer(svc)
+        {
+        }
+
+        boost::asio::steady_timer timer;
+        tick_schedule schedule;
+        std::function<void()> handler;
+    };
+
+    // @brief Schedules a recurring timer event on the next deadline
+    void do_async_wait_period(std::shared_ptr<periodic_wait> p)
+    {
+        p->timer.expires_at(p->schedule.next());
 
         using boost::system::error_code;
-        auto& t = *timer;
-        t.async_wait([t{ std::move(timer) }, h{ std::move(handler) }, period](error_code e) mutable
+        auto& t = p->timer;
+        t.async_wait([this, p{ std::move(p) }](error_code e) mutable
         {
             if (!e)
             {
-                h();
-                do_async_wait_period(std::move(t), period, h);
+                auto late = p->schedule.late();
+                auto missed = p->schedule.missed();
+                tick_deadline_ = p->schedule.next();
+                p->schedule.advance(tick_schedule::clock_type::now());
+                late_ticks_ += p->schedule.late() - late;
+                missed_ticks_ += p->schedule.missed() - missed;
+
+                p->handler();
+                do_async_wait_period(std::move(p));
             }
         });
     }
 
+    // @brief Continues the client session handed off by another loop, see migrate()
+    void adopt(session_handoff&& handoff);
+
+    // @brief Reports the utilisation to the balancer, moves a client session over if the loop is too busy
+    void rebalance();
+
+    // @brief Configures the server and starts accepting, see run_server()
+    void start_server(const std::string& app_name, const Options& opts);
+
+    // @brief Lets the sessions and the application know the server is gone, see run_server()
+    void stop_server();
+
+    // @brief Creates and starts the modules of the listeners configured, see add_listener()
+    void start_listeners(const std::string& app_name, const Options& opts);
+
+    // @brief Stops the modules of the listeners, joins the dedicated loop threads
+    void stop_listeners();
+
     // @brief Asynchrounously reads from the stream and calls the handler once a well formatted command is read
     void async_read_stream(std::istream& stream, std::function<void(const command&)> handler);
 
@@ -286,9 +604,23 @@ private:
     void close_all_connections_and_stop();
 
     // @brief Handles some well-known stdin commands common to all appliations
-    void handle_default_command(const command& cmd);
+    void handle_default_command(const command& cmd, std::ostream& out);
+
+    // @brief Starts the admin listeners if configured
+    void start_admin_endpoints(const Options& opts);
 
-    boost::asio::io_service service_;
+    // @brief Loads the TLS contexts of the listener and the upstream connections if configured
+    void load_tls(const Options& opts);
+
+    // @brief Opens the shared memory stats segment and starts publishing if configured
+    void start_stats_publishing(const Options& opts);
+
+    // @brief Copies the server figures to the shared memory stats segment
+    void publish_stats();
+
+    // the loop is the server's own unless the server serves a listener on another server loop
+    std::unique_ptr<boost::asio::io_service> own_service_;
+    boost::asio::io_service& service_;
     tcp::acceptor acceptor_;
     tcp::socket next_socket_;
     tcp::resolver resolver_;
@@ -296,6 +628,74 @@ private:
 
     object_pool<client_session> clients_;
     object_pool<server_session> servers_;
+    size_t read_buffer_size_ = Policy::read_buffer_size;
+    // zero keeps the chunk size of the policy
+    size_t write_chunk_size_ = 0;
+
+    latency_stats latency_;
+    bool latency_stats_ = false;
+    bool rx_timestamps_ = false;
+
+    // credit flow control window, zero messages turn it off
+    uint32_t flow_window_ = 0;
+    uint32_t flow_bytes_ = 0;
+    // the bytes a session may park out of credit, zero keeps the default
+    size_t flow_park_limit_ = 0;
+    size_t reply_hold_limit_ = 0;
+    std::unique_ptr<stream_registry> streams_;
+
+    hedge_policy hedging_;
+
+    // the periodic waits, see async_wait_period()
+    tick_schedule::clock_type::duration timer_slack_ = std::chrono::microseconds(100);
+    uint64_t late_ticks_ = 0;
+    uint64_t missed_ticks_ = 0;
+    tick_schedule::clock_type::time_point tick_deadline_;
+
+    // the session migration, see migrate() and balance()
+    loop_balancer<basic_app_server>* balancer_ = nullptr;
+    size_t balancer_slot_ = 0;
+    uint64_t sessions_migrated_out_ = 0;
+    uint64_t sessions_migrated_in_ = 0;
+
+    size_t next_client_slab_ = 0;
+    size_t next_server_slab_ = 0;
+
+    using local_protocol = boost::asio::local::stream_protocol;
+    std::unique_ptr<admin_endpoint<tcp>> admin_tcp_;
+    std::unique_ptr<admin_endpoint<local_protocol>> admin_local_;
+
+    std::unique_ptr<tls_context> tls_listener_;
+    std::unique_ptr<tls_context> tls_upstream_;
+
+    std::unique_ptr<stats_segment> stats_segment_;
+    stats_layout::loop_figures* stats_loop_ = nullptr;
+
+    uint64_t client_connections_ = 0;
+    uint64_t client_messages_ = 0;
+    uint64_t server_messages_ = 0;
+
+    // @brief A listener of its own module, see add_listener()
+    struct listener
+    {
+        std::string name;
+        // creates the module on the given loop, on a loop of its own if nullptr
+        std::function<std::shared_ptr<basic_app_server>(boost::asio::io_service*)> create;
+        std::shared_ptr<basic_app_server> server;
+        // the dedicated loop thread, if any
+        std::thread thread;
+    };
+    std::vector<listener> listeners_;
+    // the server serves a listener of another one, it leaves stdin to it
+    bool listener_ = false;
 };
 
+// @brief Server with the default session buffer layout
+using app_server = basic_app_server<>;
+
+// the default server is compiled in server.cpp
+extern template class basic_app_server<default_session_policy>;
+
 } // namespace protoserv
+
+#include "server_impl.hpp"
@@ -0,0 +1,855 @@
+#pragma once
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/filesystem.hpp>
+
+#include <iomanip>
+#include <cstdio>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/prctl.h>
+#endif
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+namespace protoserv
+{
+
+inline void set_real_time_process_priority()
+{
+    // TODO
+}
+
+template <typename Policy>
+basic_app_server<Policy>::basic_app_server()
+    : own_service_(borrowed_loop() ? nullptr : std::make_unique<boost::asio::io_service>())
+    , service_(borrowed_loop() ? *borrowed_loop() : *own_service_)
+    , acceptor_(service_)
+    , next_socket_(service_)
+    , resolver_(service_)
+    , stdin_(service_)
+{
+    // set empty client/server event handlers
+    onClientConnected = [](auto&) {};
+    onClientMessage = [](auto&, auto) {};
+    onClientDisconnected = [](auto&) {};
+    onClientReadComplete = [](auto&) {};
+
+    onServerConnected = [](auto&) {};
+    onServerMessage = [](auto&, auto) {};
+    onServerDisconnected = [](auto&) {};
+    onServerReadComplete = [](auto&) {};
+
+    onCommandReceived = [](auto) {};
+    onMetricsScraped = [](auto&) {};
+
+    onApplicationInitialized = [] {};
+    onApplicationDeinitialized = [] {};
+
+    onConfigurationLoaded = [](auto&) {};
+}
+
+template <typename Policy>
+basic_app_server<Policy>::~basic_app_server()
+{
+    // the server did not stop in order, e.g. a listener failed, its loop threads still run
+    for (auto& l : listeners_)
+    {
+        if (l.thread.joinable())
+        {
+            l.server->set_active(false);
+            l.thread.join();
+        }
+    }
+}
+
+inline std::string get_opt(const Options& opts, std::string key, std::string default_value = "")
+{
+    auto it = opts.find(key);
+    if (it != opts.end())
+    {
+        return it->second;
+    }
+
+    return default_value;
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::run_server(const std::string&  app_name, const Options& opts)
+{
+    start_server(app_name, opts);
+    service_.run();
+    stop_server();
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::start_server(const std::string& app_name, const Options& opts)
+{
+    auto ip = get_opt(opts, "Ip", "127.0.0.1");
+    auto port_str = get_opt(opts, "Port", "0");
+    auto port = boost::lexical_cast<uint16_t>(port_str);
+
+
+    auto readbuf_str = get_opt(opts, "ReadBufferSize", "0");
+    read_buffer_size_ = std::max(read_buffer_size_, boost::lexical_cast<size_t>(readbuf_str));
+    write_chunk_size_ = boost::lexical_cast<size_t>(get_opt(opts, "WriteChunkSize", "0"));
+
+    auto idle_str = get_opt(opts, "ReadBufferIdleTimeout", "0");
+    auto idle_ms = std::chrono::milliseconds(boost::lexical_cast<int>(idle_str));
+
+    rx_timestamps_ = get_opt(opts, "RxTimestamps", "0") != "0";
+    latency_stats_ = rx_timestamps_ || get_opt(opts, "LatencyStats", "0") != "0";
+
+    auto tcpinfo_str = get_opt(opts, "TcpInfoInterval", "0");
+    auto tcpinfo_ms = std::chrono::milliseconds(boost::lexical_cast<int>(tcpinfo_str));
+
+    flow_window_ = boost::lexical_cast<uint32_t>(get_opt(opts, "FlowControlWindow", "0"));
+    flow_bytes_ = boost::lexical_cast<uint32_t>(get_opt(opts, "FlowControlBytes", "0"));
+    flow_park_limit_ = boost::lexical_cast<size_t>(get_opt(opts, "FlowControlParkLimit", "0"));
+    reply_hold_limit_ = boost::lexical_cast<size_t>(get_opt(opts, "DeferredReplyHoldLimit", "0"));
+
+    auto stream_ring = boost::lexical_cast<size_t>(get_opt(opts, "StreamResume", "0"));
+    if (stream_ring)
+    {
+        auto retention = std::chrono::milliseconds(boost::lexical_cast<int>(get_opt(opts, "StreamRetention", "60000")));
+        streams_ = std::make_unique<stream_registry>(stream_ring, retention);
+    }
+
+    auto slack_ns = boost::lexical_cast<int64_t>(get_opt(opts, "TimerSlack", "0"));
+    if (slack_ns > 0)
+    {
+        // a tick within the slack after its deadline is on time
+        timer_slack_ = std::chrono::nanoseconds(slack_ns);
+#ifdef __linux__
+        // and the kernel may defer the wakeups of the loop thread as much, no more
+        ::prctl(PR_SET_TIMERSLACK, static_cast<unsigned long>(slack_ns), 0, 0, 0); // NOLINT(runtime/int)
+#endif
+    }
+
+    hedging_.configure(boost::lexical_cast<double>(get_opt(opts, "HedgePercentile", "95")),
+                       std::chrono::microseconds(boost::lexical_cast<int64_t>(get_opt(opts, "HedgeMinDelay", "500"))),
+                       boost::lexical_cast<double>(get_opt(opts, "HedgeBudget", "5")) / 100.0);
+
+    load_tls(opts);
+
+    // the connections initiated before the server runs have not started yet
+    servers_.foreach([this](auto session)
+    {
+        if (!session->connected())
+        {
+            instrument_session(*session);
+        }
+    });
+
+    acceptor_ = tcp::acceptor(service_, tcp::endpoint(tcp::v4(), port));
+    if (rx_timestamps_)
+    {
+        // timestamp the data arriving before the accepted session is started
+        set_rx_timestamping(acceptor_.native_handle());
+    }
+    do_accept();
+
+    if (idle_ms.count() > 0)
+    {
+        // give the memory of quiet sessions back, check twice per timeout
+        async_wait_period(idle_ms / 2, [this, idle_ms]()
+        {
+            release_idle_read_buffers(idle_ms);
+        });
+    }
+    if (tcpinfo_ms.count() > 0)
+    {
+        async_wait_period(tcpinfo_ms, [this]()
+        {
+            sample_tcp_info();
+        });
+    }
+    if (balancer_)
+    {
+        async_wait_period(balancer_->interval(), [this]()
+        {
+            rebalance();
+        });
+    }
+    start_admin_endpoints(opts);
+    start_stats_publishing(opts);
+    if (!listener_)
+    {
+        do_read_stdin();
+    }
+
+    set_real_time_process_priority();
+
+    onApplicationInitialized();
+    onConfigurationLoaded(opts);
+
+    start_listeners(app_name, opts);
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::stop_server()
+{
+    stop_listeners();
+
+    clients_.foreach([](auto session)
+    {
+        if (session->connected())
+        {
+            session->notify_disconnected();
+        }
+    });
+
+    servers_.foreach([](auto session)
+    {
+        if (session->connected())
+        {
+            session->notify_disconnected();
+        }
+    });
+
+    if (stats_loop_)
+    {
+        // let the readers know the loop is gone
+        stats_layout::set(stats_loop_->pid, 0);
+    }
+
+    onApplicationDeinitialized();
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::set_active(bool active)
+{
+    if (!active)
+    {
+        service_.dispatch([this]()
+        {
+            close_all_connections_and_stop();
+        });
+    }
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::start_listeners(const std::string& app_name, const Options& opts)
+{
+    for (auto& l : listeners_)
+    {
+        // the listener options go without the prefix
+        Options listener_opts;
+        auto prefix = "Listener." + l.name + ".";
+        for (auto& o : opts)
+        {
+            if (boost::starts_with(o.first, prefix))
+            {
+                listener_opts[o.first.substr(prefix.size())] = o.second;
+            }
+        }
+        if (!listener_opts.count("Port"))
+        {
+            continue;
+        }
+
+        if (get_opt(listener_opts, "Loop", "shared") == "dedicated")
+        {
+            auto server = l.server = l.create(nullptr);
+            l.thread = std::thread([this, server, app_name, listener_opts]()
+            {
+                try
+                {
+                    server->run_server(app_name, listener_opts);
+                }
+                catch (...)
+                {
+                    // an escaping exception would terminate the process, the host decides instead
+                    auto error = std::current_exception();
+                    boost::asio::post(service_, [error]()
+                    {
+                        std::rethrow_exception(error);
+                    });
+                }
+            });
+        }
+        else
+        {
+            l.server = l.create(&service_);
+            l.server->start_server(app_name, listener_opts);
+        }
+    }
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::stop_listeners()
+{
+    for (auto& l : listeners_)
+    {
+        if (l.thread.joinable())
+        {
+            l.server->set_active(false);
+            l.thread.join();
+        }
+        else if (l.server)
+        {
+            // the loop is stopped already, it was this one
+            l.server->stop_server();
+        }
+    }
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::async_read_stream(
+    std::istream& stream, std::function<void(const command&)> handler)
+{
+    stdin_.async_read(stream, handler);
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::do_accept()
+{
+    acceptor_.async_accept(next_socket_,
+                           [this](boost::system::error_code err)
+    {
+        if (!err)
+        {
+            auto nativeHandle = next_socket_.native_handle();
+            auto session = clients_.create(std::move(next_socket_), *this);
+            session->reserve_read_buffer(read_buffer_size_);
+            session->set_write_chunk_size(write_chunk_size_);
+            instrument_session(*session);
+            session->start();
+
+            do_accept();
+        }
+    });
+}
+
+template <typename Policy>
+bool basic_app_server<Policy>::migrate(client_session& session, basic_app_server& target)
+{
+    if (&target == this)
+    {
+        return false;
+    }
+
+    return session.hand_off([this, &target](session_handoff && handoff)
+    {
+        ++sessions_migrated_out_;
+
+        // the other loop may run in another thread, let it take the session over there
+        auto h = std::make_shared<session_handoff>(std::move(handoff));
+        boost::asio::post(target.service_, [&target, h]()
+        {
+            target.adopt(std::move(*h));
+        });
+    });
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::adopt(session_handoff&& handoff)
+{
+    if (handoff.fd < 0)
+    {
+        return;
+    }
+
+    // the listener may be bound to either family, the descriptor knows
+    sockaddr_storage local{};
+    socklen_t local_len = sizeof(local);
+    if (::getsockname(handoff.fd, reinterpret_cast<sockaddr*>(&local), &local_len) != 0)
+    {
+        return;
+    }
+
+    boost::system::error_code ec;
+    tcp::socket socket(service_);
+    socket.assign(local.ss_family == AF_INET6 ? tcp::v6() : tcp::v4(), handoff.fd, ec);
+    if (ec)
+    {
+        return;
+    }
+    handoff.release();
+
+    auto session = clients_.create(std::move(socket), *this);
+    session->reserve_read_buffer(read_buffer_size_);
+    session->set_write_chunk_size(write_chunk_size_);
+    instrument_session(*session);
+    session->take_over(std::move(handoff));
+    ++sessions_migrated_in_;
+    session->start();
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::balance(loop_balancer<basic_app_server>& balancer)
+{
+    balancer_ = &balancer;
+    balancer_slot_ = balancer.join(*this);
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::rebalance()
+{
+    using duration = typename client_session::clock_type::duration;
+
+    auto busy = duration::zero();
+    std::vector<std::pair<client_session*, duration>> movable;
+    clients_.foreach([&busy, &movable](auto session)
+    {
+        auto t = session->take_busy_time();
+        busy += t;
+        if (t.count() && session->can_hand_off())
+        {
+            movable.emplace_back(session, t);
+        }
+    });
+
+    auto interval = std::chrono::duration_cast<duration>(balancer_->interval()).count();
+    auto utilisation = static_cast<double>(busy.count()) / std::max<decltype(interval)>(interval, 1);
+
+    double gap = 0;
+    auto target = balancer_->report(balancer_slot_, utilisation, gap);
+    if (!target)
+    {
+        return;
+    }
+
+    // more than half of the gap moved over would make the other loop the busiest
+    auto limit = gap / 2 * interval;
+    client_session* heaviest = nullptr;
+    auto heaviest_time = duration::zero();
+    for (auto& m : movable)
+    {
+        if (m.second.count() <= limit && m.second > heaviest_time)
+        {
+            heaviest = m.first;
+            heaviest_time = m.second;
+        }
+    }
+
+    if (heaviest)
+    {
+        migrate(*heaviest, *target);
+    }
+}
+
+template <typename Policy>
+typename basic_app_server<Policy>::client_session& basic_app_server<Policy>::connect_loopback(
+    typename client_session::loopback_sink sink)
+{
+    auto session = clients_.create(tcp::socket(service_), *this);
+    session->reserve_read_buffer(read_buffer_size_);
+    session->set_write_chunk_size(write_chunk_size_);
+    instrument_session(*session);
+    session->start_loopback(std::move(sink));
+    return *session;
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::do_read_stdin()
+{
+    stdin_.async_read(std::cin,
+                      [this](const command & cmd)
+    {
+        handle_default_command(cmd, std::cout);
+        onCommandReceived(cmd);
+        do_read_stdin();
+    });
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::start_admin_endpoints(const Options& opts)
+{
+    auto setup = [this](auto & admin)
+    {
+        admin.onCommand = [this](const command & cmd, std::ostream & out)
+        {
+            handle_default_command(cmd, out);
+            onCommandReceived(cmd);
+        };
+        admin.onScrape = [this](metrics_writer & writer)
+        {
+            write_metrics(writer);
+        };
+    };
+
+    auto port = boost::lexical_cast<uint16_t>(get_opt(opts, "AdminPort", "0"));
+    if (port)
+    {
+        auto ip = boost::asio::ip::address::from_string(get_opt(opts, "AdminIp", "127.0.0.1"));
+        admin_tcp_ = std::make_unique<admin_endpoint<tcp>>(service_, tcp::endpoint(ip, port));
+        setup(*admin_tcp_);
+    }
+
+    auto path = get_opt(opts, "AdminSocket");
+    if (!path.empty())
+    {
+        // a stale socket file of a previous run would fail the bind, anything else is left alone
+        struct stat st;
+        if (::lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        {
+            std::remove(path.c_str());
+        }
+        admin_local_ = std::make_unique<admin_endpoint<local_protocol>>(service_, local_protocol::endpoint(path));
+        setup(*admin_local_);
+    }
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::load_tls(const Options& opts)
+{
+    auto kernel_tls = get_opt(opts, "KernelTls", "1") != "0";
+
+    auto certificate = get_opt(opts, "TlsCertificate");
+    if (!certificate.empty())
+    {
+        tls_listener_ = tls_context::server(certificate, get_opt(opts, "TlsPrivateKey", certificate), kernel_tls);
+    }
+
+    if (get_opt(opts, "TlsUpstream", "0") != "0")
+    {
+        tls_upstream_ = tls_context::client(get_opt(opts, "TlsCaFile"), get_opt(opts, "TlsServerName"),
+                                            get_opt(opts, "TlsVerifyPeer", "1") != "0");
+    }
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::start_stats_publishing(const Options& opts)
+{
+    auto name = get_opt(opts, "StatsSegment");
+    if (name.empty())
+    {
+        return;
+    }
+
+    auto loop = boost::lexical_cast<uint32_t>(get_opt(opts, "StatsLoop", "0"));
+    auto interval_ms = std::chrono::milliseconds(boost::lexical_cast<int>(get_opt(opts, "StatsInterval", "1000")));
+    if (loop >= stats_layout::max_loops)
+    {
+        throw std::out_of_range("StatsLoop");
+    }
+
+    stats_segment_ = stats_segment::create(name);
+    stats_loop_ = &stats_segment_->data().loops[loop];
+
+    publish_stats();
+    async_wait_period(interval_ms, [this]()
+    {
+        publish_stats();
+    });
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::publish_stats()
+{
+    using namespace stats_layout;
+    auto& loop = *stats_loop_;
+    auto now = std::chrono::steady_clock::now();
+
+    uint32_t slot = 0;
+    auto publish_session = [&loop, &slot, now](auto session, uint32_t server)
+    {
+        if (slot < max_sessions)
+        {
+            write_locked(loop.sessions[slot++], [session, server, now](session_figures & s)
+            {
+                auto& ep = session->remote_endpoint();
+                auto& net = session->tcp_info();
+                auto idle = std::chrono::duration_cast<std::chrono::milliseconds>(now - session->last_activity());
+
+                set(s.server, server);
+                set(s.address, ep.address().is_v4() ? ep.address().to_v4().to_ulong() : 0);
+                set(s.port, ep.port());
+                set(s.idle_ms, idle.count());
+                set(s.read_buffer_bytes, session->read_buffer_bytes());
+                set(s.rtt_us, net.rtt_us);
+                set(s.unacked, net.unacked);
+                set(s.notsent_bytes, net.notsent_bytes);
+                set(s.retransmits, net.retransmits);
+            });
+        }
+    };
+
+    uint64_t clients = 0;
+    uint64_t bytes = 0;
+    clients_.foreach([&](auto session)
+    {
+        ++clients;
+        bytes += session->read_buffer_bytes();
+        publish_session(session, 0);
+    });
+
+    uint64_t servers = 0;
+    servers_.foreach([&](auto session)
+    {
+        ++servers;
+        bytes += session->read_buffer_bytes();
+        publish_session(session, 1);
+    });
+
+    set(loop.session_count, slot);
+    set(loop.client_sessions, clients);
+    set(loop.server_sessions, servers);
+    set(loop.read_buffer_bytes, bytes);
+    set(loop.client_connections, client_connections_);
+    set(loop.client_messages, client_messages_);
+    set(loop.server_messages, server_messages_);
+
+    latency_.foreach ([&loop](int type, const message_latency & t)
+    {
+        if (static_cast<uint32_t>(type) < max_types)
+        {
+            auto publish = [](phase_figures & f, const latency_histogram & h)
+            {
+                set(f.count, h.count());
+                set(f.sum, h.sum());
+                set(f.p50, h.percentile(50));
+                set(f.p99, h.percentile(99));
+                set(f.max, h.max());
+            };
+
+            auto& figures = loop.types[type];
+            publish(figures.phases[kernel_to_read], t.kernel_to_read);
+            publish(figures.phases[read_to_dispatch], t.read_to_dispatch);
+            publish(figures.phases[handler], t.handler);
+            publish(figures.phases[send_to_write], t.send_to_write);
+        }
+    });
+
+    using namespace std::chrono;
+    set(loop.updated_ns, duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count());
+    set(loop.pid, ::getpid());
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::write_metrics(metrics_writer& writer)
+{
+    size_t clients = 0;
+    clients_.foreach([&clients](auto)
+    {
+        ++clients;
+    });
+
+    size_t servers = 0;
+    servers_.foreach([&servers](auto)
+    {
+        ++servers;
+    });
+
+    writer.family("protoserv_client_sessions", "gauge", "Client sessions alive");
+    writer.sample("protoserv_client_sessions", "", clients);
+    writer.family("protoserv_server_sessions", "gauge", "Server sessions alive");
+    writer.sample("protoserv_server_sessions", "", servers);
+    writer.family("protoserv_client_connections_total", "counter", "Client connections accepted");
+    writer.sample("protoserv_client_connections_total", "", client_connections_);
+    writer.family("protoserv_client_messages_total", "counter", "Messages received from clients");
+    writer.sample("protoserv_client_messages_total", "", client_messages_);
+    writer.family("protoserv_server_messages_total", "counter", "Messages received from servers");
+    writer.sample("protoserv_server_messages_total", "", server_messages_);
+    writer.family("protoserv_read_buffer_bytes", "gauge", "Memory held by the session read buffers");
+    writer.sample("protoserv_read_buffer_bytes", "", read_buffer_bytes());
+
+    writer.family("protoserv_timer_late_ticks_total", "counter", "Periodic ticks run later than the timer slack");
+    writer.sample("protoserv_timer_late_ticks_total", "", late_ticks_);
+    writer.family("protoserv_timer_missed_ticks_total", "counter", "Periodic ticks skipped, the loop was a period behind");
+    writer.sample("protoserv_timer_missed_ticks_total", "", missed_ticks_);
+
+    if (balancer_)
+    {
+        writer.family("protoserv_loop_utilisation", "gauge", "Share of the balancing interval spent in the handlers");
+        writer.sample("protoserv_loop_utilisation", "", balancer_->utilisation(balancer_slot_));
+    }
+    if (balancer_ || sessions_migrated_out_ || sessions_migrated_in_)
+    {
+        writer.family("protoserv_sessions_migrated_total", "counter", "Client sessions moved between the loops");
+        writer.sample("protoserv_sessions_migrated_total", "direction=\"out\"", sessions_migrated_out_);
+        writer.sample("protoserv_sessions_migrated_total", "direction=\"in\"", sessions_migrated_in_);
+    }
+
+    if (latency_stats_)
+    {
+        writer.family("protoserv_latency_nanoseconds", "histogram", "Message latency breakdown by phase");
+        latency_.foreach ([&writer](int type, const message_latency & t)
+        {
+            auto labels = [type](const char* phase)
+            {
+                return "type=\"" + std::to_string(type) + "\",phase=\"" + phase + "\"";
+            };
+            writer.histogram("protoserv_latency_nanoseconds", labels("kernel_to_read"), t.kernel_to_read);
+            writer.histogram("protoserv_latency_nanoseconds", labels("read_to_dispatch"), t.read_to_dispatch);
+            writer.histogram("protoserv_latency_nanoseconds", labels("handler"), t.handler);
+            writer.histogram("protoserv_latency_nanoseconds", labels("send_to_write"), t.send_to_write);
+        });
+    }
+
+    if (hedging_.requests())
+    {
+        writer.family("protoserv_hedged_requests_total", "counter", "Upstream requests sent with hedging");
+        writer.sample("protoserv_hedged_requests_total", "", hedging_.requests());
+        writer.family("protoserv_hedges_total", "counter", "Duplicate requests sent to another upstream");
+        writer.sample("protoserv_hedges_total", "", hedging_.hedges());
+        writer.family("protoserv_hedge_wins_total", "counter", "Duplicate requests answered first");
+        writer.sample("protoserv_hedge_wins_total", "", hedging_.hedge_wins());
+        writer.family("protoserv_hedges_suppressed_total", "counter", "Duplicate requests not sent, over budget");
+        writer.sample("protoserv_hedges_suppressed_total", "", hedging_.suppressed());
+        writer.family("protoserv_hedge_delay_nanoseconds", "gauge", "Reply delay before a duplicate request is sent");
+        writer.sample("protoserv_hedge_delay_nanoseconds", "", hedging_.delay().count());
+    }
+
+    auto net = tcp_info_summary();
+    if (net.sessions)
+    {
+        writer.family("protoserv_tcp_rtt_nanoseconds", "histogram", "Round trip time of the sampled sessions");
+        writer.histogram("protoserv_tcp_rtt_nanoseconds", "", net.rtt);
+        writer.family("protoserv_tcp_retransmits", "gauge", "Segments retransmitted by the sampled sessions");
+        writer.sample("protoserv_tcp_retransmits", "", net.retransmits);
+        writer.family("protoserv_tcp_notsent_bytes", "gauge", "Bytes queued, but not sent by the sampled sessions");
+        writer.sample("protoserv_tcp_notsent_bytes", "", net.notsent_bytes);
+    }
+
+    onMetricsScraped(writer);
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::close_all_connections_and_stop()
+{
+    acceptor_.close();
+    if (admin_tcp_)
+    {
+        admin_tcp_->close();
+    }
+    if (admin_local_)
+    {
+        admin_local_->close();
+    }
+    service_.stop();
+}
+
+template <typename Policy>
+void basic_app_server<Policy>::handle_default_command(const command& cmd, std::ostream& out)
+{
+    auto& key = cmd.name();
+
+    if (!key.compare("help"))
+    {
+        out
+                << std::left << std::setw(12) << "help" << " show this message\r\n"
+                << std::left << std::setw(12) << "exit" << " terminate server\r\n"
+                << std::left << std::setw(12) << "exception" << " raise an exception\r\n"
+                << std::left << std::setw(12) << "latency" << " show latency breakdown per message type\r\n"
+                << std::left << std::setw(12) << "tcpinfo" << " show network health of the sessions\r\n"
+                << "\r\n";
+
+    }
+    else if (!key.compare("latency"))
+    {
+        latency_.print(out);
+    }
+    else if (!key.compare("tcpinfo"))
+    {
+        tcp_info_summary().print(out);
+    }
+    else if (!key.compare("exit"))
+    {
+        set_active(false);
+    }
+    else if (!key.compare("die"))
+    {
+    }
+}
+
+template <typename Policy>
+typename basic_app_server<Policy>::ServerConnection& basic_app_server<Policy>::connect_to_server(
+    const std::string& ip, uint16_t port,
+    decltype(onServerMessage) handler)
+{
+    return connect_to_server(ip, port, handler,
+                             [this](auto & session)
+    {
+        notify_connected(session);
+    },
+    [this](auto & session)
+    {
+        notify_disconnected(session);
+    });
+}
+
+template <typename Policy>
+typename basic_app_server<Policy>::ServerConnection& basic_app_server<Policy>::connect_to_server(
+    const std::string& ip, uint16_t port,
+    decltype(onServerMessage) messageHandler,
+    decltype(onServerConnected) connectHandler,
+    decltype(onServerDisconnected) disconnectHandler
+)
+{
+    auto ipaddr = boost::asio::ip::address::from_string(ip);
+    auto endpoint = tcp::endpoint(ipaddr, port);
+
+    tcp::socket socket(service_);
+    socket.connect(endpoint);
+    auto session = servers_.create(std::move(socket), service_);
+    session->reserve_read_buffer(read_buffer_size_);
+    session->set_write_chunk_size(write_chunk_size_);
+    instrument_session(*session);
+    session->onMessage = messageHandler;
+    session->onConnected = connectHandler;
+    session->onDisconnected = disconnectHandler;
+    session->onReadComplete = [this](auto & session)
+    {
+        onServerReadComplete(session);
+    };
+    session->start();
+
+    return *session;
+}
+
+template <typename Policy>
+typename basic_app_server<Policy>::ServerConnection& basic_app_server<Policy>::connect_to_server(
+    const std::string& ip, uint16_t port)
+{
+    return connect_to_server(ip, port, onServerMessage, onServerConnected, onServerDisconnected);
+}
+
+template <typename Policy>
+typename basic_app_server<Policy>::ServerConnection& basic_app_server<Policy>::async_connect(
+    const std::string& ip, uint16_t port,
+    decltype(onServerMessage) handler)
+{
+    return async_connect(ip, port, handler, [](auto&) {}, [](auto&) {});
+}
+
+template <typename Policy>
+typename basic_app_server<Policy>::ServerConnection& basic_app_server<Policy>::async_connect(
+    const std::string& ip, uint16_t port,
+    decltype(onServerMessage) messageHandler,
+    decltype(onServerConnected) connectHandler,
+    decltype(onServerDisconnected) disconnectHandler
+)
+{
+    tcp::socket socket(service_);
+    auto session = servers_.create(std::move(socket), service_);
+    session->reserve_read_buffer(read_buffer_size_);
+    session->set_write_chunk_size(write_chunk_size_);
+    instrument_session(*session);
+    session->onMessage = messageHandler;
+    session->onConnected = connectHandler;
+    session->onDisconnected = disconnectHandler;
+    session->onReadComplete = [this](auto & session)
+    {
+        onServerReadComplete(session);
+    };
+
+    auto ipaddr = boost::asio::ip::address::from_string(ip);
+    auto endpoint = tcp::endpoint(ipaddr, port);
+    session->connect(endpoint);
+
+    return *session;
+}
+
+template <typename Policy>
+typename basic_app_server<Policy>::ServerConnection& basic_app_server<Policy>::async_connect(const std::string& ip, uint16_t port)
+{
+    return async_connect(ip, port, onServerMessage, onServerConnected, onServerDisconnected);
+}
+} // namespace protoserv
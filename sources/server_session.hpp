@@ -8,17 +8,27 @@ namespace protoserv
 @description
 Asynchronous server session
 */
-class server_session : public basic_session<server_session>
+template <typename Policy = default_session_policy>
+class basic_server_session : public basic_session <
+    basic_server_session<Policy>,
+    protobuf_packet<basic_server_session<Policy>>,
+    Policy >
 {
 public:
+    using server_session = basic_server_session<Policy>;
+    using base_type = basic_session<server_session, protobuf_packet<server_session>, Policy>;
+    using tcp = boost::asio::ip::tcp;
+
     std::function<void(server_session&)> onConnected;
     std::function<void(server_session&)> onDisconnected;
     std::function<void(server_session&, const Message&)> onMessage;
+    std::function<void(server_session&)> onReadComplete;
 
-    explicit server_session(tcp::socket socket, boost::asio::io_service& svc)
-        : basic_session(std::move(socket))
+    explicit basic_server_session(tcp::socket socket, boost::asio::io_service& svc)
+        : base_type(std::move(socket))
         , service_(svc)
     {
+        onReadComplete = [](auto&) {};
     }
 
     /*
@@ -41,6 +51,12 @@ public:
         onMessage(*this, message);
     }
 
+    // @brief Notifies the subscribed party that all messages of the last read were passed on
+    void notify_read_complete()
+    {
+        onReadComplete(*this);
+    }
+
     // @brief Attemps the re-establish the connection
     void handle_disconnected_session()
     {
@@ -60,12 +76,12 @@ public:
         using boost::system::error_code;
 
         auto addr = remote_endpoint_;
-        async_connect(addr, [addr, this](error_code ec)
+        this->async_connect(addr, [addr, this](error_code ec)
         {
             if (!ec)
             {
                 // if successful, starts asynchronous IO
-                start();
+                this->start();
             }
             else
             {
@@ -88,4 +104,7 @@ private:
     tcp::endpoint remote_endpoint_;
 };
 
+// @brief Server session with the default buffer layout
+using server_session = basic_server_session<>;
+
 } // namespace protoserv
@@ -12,11 +12,32 @@
 
 namespace protoserv
 {
-// @brief An intrusive-list-ready block of memory of fixed size
-template <int N>
+// @brief An intrusive-list-ready block of memory, the capacity is set on creation
 class chunkbuf : public boost::intrusive::list_base_hook<>
 {
 public:
+    chunkbuf(uint8_t* buf, size_t capacity) noexcept
+        : capacity_(capacity)
+        , buf_(buf)
+    {
+    }
+
+    chunkbuf(const chunkbuf&) = delete;
+    chunkbuf& operator =(const chunkbuf&) = delete;
+
+    // @brief Allocates a chunk along with its memory in one go
+    static chunkbuf* create(size_t capacity)
+    {
+        auto mem = static_cast<uint8_t*>(::operator new(sizeof(chunkbuf) + capacity));
+        return new (mem) chunkbuf(mem + sizeof(chunkbuf), capacity);
+    }
+
+    // @brief Frees a chunk allocated by create()
+    static void destroy(chunkbuf* chunk) noexcept
+    {
+        chunk->~chunkbuf();
+        ::operator delete(chunk);
+    }
 
     // @brief Returns pointer to the memory
     uint8_t* begin() noexcept
@@ -49,9 +70,9 @@ public:
     }
 
     // @brief Returs the capacity of the buffer in bytes
-    static size_t capacity() noexcept
+    size_t capacity() const noexcept
     {
-        return N;
+        return capacity_;
     }
 
     // @brief Returns the number of free bytes in the buffer
@@ -71,21 +92,40 @@ public:
 
 private:
     size_t size_ = 0;
-    uint8_t buf_[N];
+    size_t capacity_;
+    uint8_t* buf_;
 };
 
-// @brief Intrusive list of fixed size memory chunks
-class writebuf
+// @brief A chunk holding its memory in-place, N bytes
+template <int N>
+class inline_chunkbuf : public chunkbuf
+{
+public:
+    inline_chunkbuf() noexcept
+        : chunkbuf(mem_, N)
+    {
+    }
+
+private:
+    uint8_t mem_[N];
+};
+
+// @brief Intrusive list of memory chunks
+// @description
+// The first chunk of ChunkSize bytes is held in-place, the ones added when it is full
+// are of ChunkSize bytes too, unless set_chunk_size() tells otherwise.
+template <int ChunkSize>
+class basic_writebuf
 {
 public:
     // @brief Initiates the list with single chunk
-    writebuf() noexcept
+    basic_writebuf() noexcept
     {
         list_.push_back(init_buf_);
     }
 
     // @brief Frees allocated memory
-    ~writebuf()
+    ~basic_writebuf()
     {
         clear();
         assert(list_.size() == 1 && &list_.front() == &init_buf_);
@@ -94,10 +134,10 @@ public:
     }
 
     // @brief The list is nor copyable nor moveable
-    writebuf(const writebuf&) = delete;
-    writebuf& operator =(const writebuf&) = delete;
-    writebuf(writebuf&&) = delete;
-    writebuf& operator =(writebuf&&) = delete;
+    basic_writebuf(const basic_writebuf&) = delete;
+    basic_writebuf& operator =(const basic_writebuf&) = delete;
+    basic_writebuf(basic_writebuf&&) = delete;
+    basic_writebuf& operator =(basic_writebuf&&) = delete;
 
     // @brienf Appends data to the list tail, allocates new memory if needed
     void append(const void* buf, size_t len)
@@ -122,6 +162,18 @@ public:
         return init_buf_.empty();
     }
 
+    // @brief Sets the size of the chunks allocated from now on, zero restores the default
+    void set_chunk_size(size_t size) noexcept
+    {
+        chunk_size_ = size ? size : ChunkSize;
+    }
+
+    // @brief Returns the size of the chunks allocated when the buffer grows
+    size_t chunk_size() const noexcept
+    {
+        return chunk_size_;
+    }
+
     // @brief Frees all memory
     void clear() noexcept
     {
@@ -146,7 +198,7 @@ public:
     }
 
 private:
-    using chunk_type = chunkbuf<1024>;
+    using chunk_type = chunkbuf;
     using list_type = boost::intrusive::list<chunk_type>;
 
     // @brief Allocates and initializes new list node
@@ -154,8 +206,7 @@ private:
     {
         if (free_list_.empty())
         {
-            auto* chunk = new chunk_type;
-            list_.push_back(*chunk);
+            list_.push_back(*chunk_type::create(chunk_size_));
         }
         else
         {
@@ -186,29 +237,36 @@ private:
             auto& l = list.front();
             list.pop_front();
 
-            delete &l;
+            chunk_type::destroy(&l);
         }
     }
 
     list_type list_;
     list_type free_list_;
-    chunk_type init_buf_;
+    inline_chunkbuf<ChunkSize> init_buf_;
+    size_t chunk_size_ = ChunkSize;
 };
 
+// @brief Write buffer with the default chunk size
+using writebuf = basic_writebuf<1024>;
+
 // @brief Double write buffer
 // @description
 // Hold a pair of buffers, at any given moment only one of them
 // may be used for writing.
-class double_writebuf
+template <int ChunkSize>
+class basic_double_writebuf
 {
 public:
-    double_writebuf() = default;
+    using buffer_type = basic_writebuf<ChunkSize>;
+
+    basic_double_writebuf() = default;
 
     // @brief The double_writebuf is nor copyable nor moveable
-    double_writebuf(const double_writebuf&) = delete;
-    double_writebuf& operator =(const double_writebuf&) = delete;
-    double_writebuf(double_writebuf&&) = delete;
-    double_writebuf& operator =(double_writebuf&&) = delete;
+    basic_double_writebuf(const basic_double_writebuf&) = delete;
+    basic_double_writebuf& operator =(const basic_double_writebuf&) = delete;
+    basic_double_writebuf(basic_double_writebuf&&) = delete;
+    basic_double_writebuf& operator =(basic_double_writebuf&&) = delete;
 
     // @brief Appends data on the currently active buffer
     void append(const void* buf, size_t len)
@@ -228,8 +286,15 @@ public:
         return current().clear();
     }
 
+    // @brief Sets the size of the chunks both buffers allocate from now on
+    void set_chunk_size(size_t size) noexcept
+    {
+        buf_[0].set_chunk_size(size);
+        buf_[1].set_chunk_size(size);
+    }
+
     // @brief Makes the seconds buffer active
-    writebuf& flip()
+    buffer_type& flip()
     {
         auto& ret = current();
         cur_ ^= 1;
@@ -247,21 +312,24 @@ public:
 
 private:
     // @brief Returns the currently active buffer
-    writebuf& current()
+    buffer_type& current()
     {
         return buf_[cur_];
     }
 
     // @brief Returns the currently active buffer
-    const writebuf& current() const
+    const buffer_type& current() const
     {
         return buf_[cur_];
     }
 
-    writebuf buf_[2];
+    buffer_type buf_[2];
     int cur_ = 0;
 };
 
+// @brief Double write buffer with the default chunk size
+using double_writebuf = basic_double_writebuf<1024>;
+
 // @brief A fixed size statically allocated read buffer
 template <int N>
 class read_buffer
@@ -476,7 +544,10 @@ public:
     // @brief Reserves capacity
     void reserve(size_t sz)
     {
-        buf_.resize(sz);
+        if (sz > buf_.size())
+        {
+            buf_.resize(sz);
+        }
     }
 
     // @brief Returns pointer to the first bytes
@@ -542,6 +613,28 @@ public:
         tail_ += sz;
     }
 
+    // @brief The buffer does not care about frame sizes
+    void expect(size_t)
+    {
+    }
+
+    // @brief The buffer never asks for resizing, it grows only when full
+    bool wants_resize() const
+    {
+        return false;
+    }
+
+    // @brief The buffer never gives memory back
+    void release()
+    {
+    }
+
+    // @brief The buffer never gives memory back
+    bool releasable() const
+    {
+        return false;
+    }
+
     // @brief Grows buffer capacity if needed
     void grow_capacity()
     {
@@ -572,4 +665,203 @@ private:
     std::vector<uint8_t> buf_;
 };
 
+// @brief A read buffer which adapts its capacity to the observed traffic
+// @description
+// Capacity follows a decaying peak of recent read sizes instead of doubling
+// forever. A frame larger than the buffer gets a dedicated allocation sized for it,
+// which is dropped again once the frame is consumed. Memory is never zero-filled.
+// Any reallocation happens in grow_capacity() or release(), which the caller
+// invokes only while no read operation is pending on the buffer.
+class adaptive_buffer
+{
+public:
+    // @brief The smallest capacity the buffer is allowed to shrink to
+    static constexpr size_t min_capacity = 256;
+
+    // @brief Constructs buffer with the minimal capacity
+    adaptive_buffer()
+    {
+        reallocate(min_capacity);
+    }
+
+    // @brief Buffer is neither copyable nor moveable
+    adaptive_buffer(const adaptive_buffer&) = delete;
+    adaptive_buffer& operator =(const adaptive_buffer&) = delete;
+    adaptive_buffer(adaptive_buffer&&) = delete;
+    adaptive_buffer& operator =(adaptive_buffer&&) = delete;
+
+    // @brief Ensures the given capacity, keeps the used bytes
+    void reserve(size_t sz)
+    {
+        if (sz > capacity_)
+        {
+            reallocate(sz);
+        }
+    }
+
+    // @brief Returns pointer to the first used byte
+    uint8_t* begin()
+    {
+        return buf_.get() + tail_;
+    }
+
+    // @brief Returns pointer to the first free byte
+    uint8_t* end()
+    {
+        return buf_.get() + head_;
+    }
+
+    // @brief Returns the buffer capacity
+    size_t capacity() const
+    {
+        return capacity_;
+    }
+
+    // @brief Returns the number of used bytes
+    size_t size() const
+    {
+        assert(head_ >= tail_);
+        return head_ - tail_;
+    }
+
+    // @brief Returns the number of free bytes
+    size_t free_capacity() const
+    {
+        return capacity_ - head_;
+    }
+
+    // @brief Checks if any portion of the buffer was used
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    // @brief Increments the number of used bytes, accounts for the read size
+    void grow(size_t sz)
+    {
+        assert(head_ + sz <= capacity_);
+        head_ += sz;
+        read_estimate_ = std::max(sz, read_estimate_ - read_estimate_ / 8);
+    }
+
+    // @brief Decrements the number of used bytes
+    void shrink(size_t sz)
+    {
+        head_ -= sz;
+        assert(head_ >= tail_);
+    }
+
+    // @brief Sets the number of used bytes to zero
+    void clear()
+    {
+        head_ = tail_ = 0;
+    }
+
+    // @brief Marks memory in the beginning of the buffer as unused
+    void erase(size_t sz)
+    {
+        tail_ += sz;
+    }
+
+    // @brief Tells the buffer the size of the partially received frame, zero if none
+    void expect(size_t frame_size)
+    {
+        pending_frame_ = frame_size;
+    }
+
+    // @brief Checks if the buffer would like to be resized before the next read
+    bool wants_resize() const
+    {
+        return pending_frame_ > capacity_ || capacity_ > shrink_threshold();
+    }
+
+    // @brief Adapts the buffer capacity, must not be called with a read in flight
+    void grow_capacity()
+    {
+        const auto target = target_capacity();
+
+        if (pending_frame_ > capacity_)
+        {
+            // dedicated allocation for the frame, no smaller than the recent reads call for
+            reallocate(std::max(pending_frame_, target));
+        }
+        else if (capacity_ > shrink_threshold() && size() <= target / 2 && pending_frame_ <= target)
+        {
+            reallocate(target);
+        }
+        else if (tail_ > 0)
+        {
+            compact();
+        }
+        else if (head_ == capacity_)
+        {
+            reallocate(std::max(capacity_ * 2, target));
+        }
+    }
+
+    // @brief Returns the memory back to the allocator if nothing is buffered
+    void release()
+    {
+        if (empty() && capacity_ > min_capacity)
+        {
+            read_estimate_ = 0;
+            reallocate(min_capacity);
+        }
+    }
+
+    // @brief Checks if release() would free any memory
+    bool releasable() const
+    {
+        return empty() && capacity_ > min_capacity;
+    }
+
+    // @brief Moves the used memory to the beginning of the buffer
+    void compact()
+    {
+        memmove(buf_.get(), buf_.get() + tail_, head_ - tail_);
+        head_ -= tail_;
+        tail_ = 0;
+    }
+
+private:
+    // @brief The capacity the recent read sizes call for
+    size_t target_capacity() const
+    {
+        size_t target = min_capacity;
+        while (target < 2 * read_estimate_)
+        {
+            target *= 2;
+        }
+        return target;
+    }
+
+    // @brief The capacity above which the buffer is considered oversized
+    size_t shrink_threshold() const
+    {
+        return 4 * target_capacity();
+    }
+
+    // @brief Moves the used bytes into a newly allocated memory of the given size
+    void reallocate(size_t sz)
+    {
+        assert(sz >= size());
+        std::unique_ptr<uint8_t[]> buf(new uint8_t[sz]);
+        if (buf_)
+        {
+            memcpy(buf.get(), begin(), size());
+        }
+        head_ = size();
+        tail_ = 0;
+        capacity_ = sz;
+        buf_ = std::move(buf);
+    }
+
+    size_t head_ = 0;
+    size_t tail_ = 0;
+    size_t capacity_ = 0;
+    size_t pending_frame_ = 0;
+    size_t read_estimate_ = 0;
+    std::unique_ptr<uint8_t[]> buf_;
+};
+
 } // namespace protoserv
@@ -0,0 +1,33 @@
+#pragma once
+#include "session_buffers.hpp"
+
+namespace protoserv
+{
+/*
+@description
+Compile-time buffer layout of a session.
+ReadBuffer - the read buffer type, adaptive_buffer or rolling_buffer
+WriteChunkSize - the size of a single write buffer chunk, the chunks added
+when the first one is full may be sized with the WriteChunkSize option at runtime
+ReadBufferSize - the initial read buffer capacity, may be raised with
+the ReadBufferSize option at runtime
+*/
+template <class ReadBuffer, int WriteChunkSize, size_t ReadBufferSize>
+struct session_policy
+{
+    using read_buffer_type = ReadBuffer;
+    using write_buffer_type = basic_double_writebuf<WriteChunkSize>;
+
+    static constexpr size_t read_buffer_size = ReadBufferSize;
+};
+
+// @brief The default layout, suits mixed traffic
+using default_session_policy = session_policy<adaptive_buffer, 1024, 2 * 1024>;
+
+// @brief Tiny requests and replies, lots of sessions
+using small_message_policy = session_policy<adaptive_buffer, 256, 512>;
+
+// @brief Large frames, e.g. snapshots, few sessions
+using large_message_policy = session_policy<rolling_buffer, 16 * 1024, 64 * 1024>;
+
+} // namespace protoserv
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <google/protobuf/message.h>
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace protoserv
+{
+/*
+@class single_flight
+@description
+The upstream calls in flight by request: the message type and the serialized
+request bytes. Only the first of the identical concurrent requests makes the
+call, the others wait for it; the reply frame, encoded once, is passed to all
+of them. The key keeps the whole request, a hash collision never merges
+different requests.
+*/
+class single_flight
+{
+public:
+    // @brief Gets the encoded reply frame, nullptr if the call failed
+    using waiter = std::function<void(const std::string*)>;
+
+    // @brief Returns the key of the request: the message type followed by the serialized message
+    static std::string key_of(int messageType, const google::protobuf::Message& request)
+    {
+        std::string key(sizeof(uint16_t), '\0');
+        *reinterpret_cast<uint16_t*>(&key[0]) = static_cast<uint16_t>(messageType);
+        request.AppendPartialToString(&key);
+        return key;
+    }
+
+    // @brief Waits for the call of the request, true if there was none and the caller has to make it
+    bool join(const std::string& key, waiter w)
+    {
+        auto it = flights_.find(key);
+        if (it != flights_.end())
+        {
+            it->second.push_back(std::move(w));
+            ++coalesced_;
+            return false;
+        }
+
+        flights_[key].push_back(std::move(w));
+        return true;
+    }
+
+    // @brief Passes the reply frame to all the waiters of the call, ends the call
+    void complete(const std::string& key, const std::string& frame)
+    {
+        finish(key, &frame);
+    }
+
+    // @brief Lets all the waiters of the call know it failed, ends the call
+    void fail(const std::string& key)
+    {
+        finish(key, nullptr);
+    }
+
+    // @brief Returns the number of calls in flight
+    size_t in_flight() const
+    {
+        return flights_.size();
+    }
+
+    // @brief Returns the number of requests which joined a call in flight
+    uint64_t coalesced() const
+    {
+        return coalesced_;
+    }
+
+private:
+    void finish(const std::string& key, const std::string* frame)
+    {
+        auto it = flights_.find(key);
+        if (it == flights_.end())
+        {
+            return;
+        }
+
+        // a waiter asking again starts a new call
+        auto waiters = std::move(it->second);
+        flights_.erase(it);
+
+        for (auto& w : waiters)
+        {
+            w(frame);
+        }
+    }
+
+    std::unordered_map<std::string, std::vector<waiter>> flights_;
+    uint64_t coalesced_ = 0;
+};
+
+} // namespace protoserv
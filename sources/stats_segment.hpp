@@ -0,0 +1,268 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <cstdint>
+#include <new>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace protoserv
+{
+/*
+@description
+Layout of the shared memory stats segment. Every loop (a server instance) owns
+a slot and is the only writer of it, the readers live in other processes.
+The counters are relaxed atomics, the session figures are guarded by a seqlock
+since they only make sense together. Any change to the layout bumps the version.
+*/
+namespace stats_layout
+{
+constexpr uint32_t magic = 0x76727370; // "psrv"
+constexpr uint32_t version = 1;
+
+constexpr uint32_t max_loops = 8;
+constexpr uint32_t max_types = 256;
+constexpr uint32_t max_sessions = 1024;
+
+using counter = std::atomic<uint64_t>;
+
+// @brief Summary of a latency histogram
+struct phase_figures
+{
+    counter count;
+    counter sum;
+    counter p50;
+    counter p99;
+    counter max;
+};
+
+enum phase
+{
+    kernel_to_read,
+    read_to_dispatch,
+    handler,
+    send_to_write,
+    phase_count
+};
+
+// @brief Latency breakdown of a message type, see message_latency
+struct type_figures
+{
+    phase_figures phases[phase_count];
+};
+
+// @brief Figures of a single session, written under the seqlock
+struct session_figures
+{
+    std::atomic<uint32_t> seq;
+    std::atomic<uint32_t> server; // 0 for a client session, 1 for a server one
+    std::atomic<uint32_t> address; // IPv4, host byte order
+    std::atomic<uint32_t> port;
+    counter idle_ms;
+    counter read_buffer_bytes;
+    counter rtt_us;
+    counter unacked;
+    counter notsent_bytes;
+    counter retransmits;
+};
+
+// @brief Figures of a single loop
+struct loop_figures
+{
+    counter pid; // zero if the slot was never used
+    counter updated_ns; // wall clock of the last update
+    counter client_sessions;
+    counter server_sessions;
+    counter client_connections;
+    counter client_messages;
+    counter server_messages;
+    counter read_buffer_bytes;
+    counter session_count; // number of valid entries in sessions
+    type_figures types[max_types];
+    session_figures sessions[max_sessions];
+};
+
+struct header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t max_loops;
+    uint32_t max_types;
+    uint32_t max_sessions;
+    uint32_t size;
+};
+
+struct segment
+{
+    header head;
+    loop_figures loops[max_loops];
+};
+
+// @brief Stores the value, the single writer does not need anything stronger
+template <typename T, typename V>
+void set(std::atomic<T>& a, V v)
+{
+    a.store(static_cast<T>(v), std::memory_order_relaxed);
+}
+
+// @brief Loads the value
+template <typename T>
+T get(const std::atomic<T>& a)
+{
+    return a.load(std::memory_order_relaxed);
+}
+
+// @brief Updates the session figures, the readers retry until the update is over
+template <typename Func>
+void write_locked(session_figures& s, Func&& func)
+{
+    auto seq = s.seq.load(std::memory_order_relaxed);
+    s.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    func(s);
+    s.seq.store(seq + 2, std::memory_order_release);
+}
+
+// @brief Reads a consistent copy of the session figures, returns false if the writer kept interfering
+template <typename Func>
+bool read_locked(const session_figures& s, Func&& func)
+{
+    for (int attempt = 0; attempt < 100; ++attempt)
+    {
+        auto seq = s.seq.load(std::memory_order_acquire);
+        if (seq & 1)
+        {
+            continue;
+        }
+
+        func(s);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (s.seq.load(std::memory_order_relaxed) == seq)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+} // namespace stats_layout
+
+// @brief POSIX shared memory segment holding stats_layout::segment
+class stats_segment
+{
+public:
+    using segment_type = stats_layout::segment;
+
+    // @brief Creates the named segment or opens the existing one for writing
+    static std::unique_ptr<stats_segment> create(const std::string& name)
+    {
+        auto fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0)
+        {
+            throw std::system_error(errno, std::system_category(), "shm_open " + name);
+        }
+
+        // a fresh segment is zero-filled by the kernel
+        if (::ftruncate(fd, sizeof(segment_type)) != 0)
+        {
+            auto err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::system_category(), "ftruncate " + name);
+        }
+
+        std::unique_ptr<stats_segment> ret(new stats_segment(fd, PROT_READ | PROT_WRITE));
+        auto& head = ret->data().head;
+        if (head.magic != stats_layout::magic || head.version != stats_layout::version)
+        {
+            // left by an older build, or brand new: value-initialized, i.e. zeroed, in place
+            new (&ret->data()) segment_type();
+            head.version = stats_layout::version;
+            head.max_loops = stats_layout::max_loops;
+            head.max_types = stats_layout::max_types;
+            head.max_sessions = stats_layout::max_sessions;
+            head.size = sizeof(segment_type);
+            std::atomic_thread_fence(std::memory_order_release);
+            head.magic = stats_layout::magic;
+        }
+        return ret;
+    }
+
+    // @brief Opens the existing segment for reading, nullptr if missing or of another version
+    static std::unique_ptr<stats_segment> open(const std::string& name)
+    {
+        auto fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0)
+        {
+            return nullptr;
+        }
+
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(segment_type))
+        {
+            ::close(fd);
+            return nullptr;
+        }
+
+        std::unique_ptr<stats_segment> ret(new stats_segment(fd, PROT_READ));
+        auto& head = ret->data().head;
+        if (head.magic != stats_layout::magic || head.version != stats_layout::version)
+        {
+            return nullptr;
+        }
+        return ret;
+    }
+
+    // @brief Removes the segment name, the mappings stay valid
+    static void unlink(const std::string& name)
+    {
+        ::shm_unlink(name.c_str());
+    }
+
+    stats_segment(const stats_segment&) = delete;
+    stats_segment& operator =(const stats_segment&) = delete;
+
+    ~stats_segment()
+    {
+        if (data_)
+        {
+            ::munmap(data_, sizeof(segment_type));
+        }
+        ::close(fd_);
+    }
+
+    // @brief Returns the mapped segment
+    segment_type& data()
+    {
+        return *data_;
+    }
+
+    // @brief Returns the mapped segment
+    const segment_type& data() const
+    {
+        return *data_;
+    }
+
+private:
+    stats_segment(int fd, int prot)
+        : fd_(fd)
+    {
+        auto p = ::mmap(nullptr, sizeof(segment_type), prot, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            auto err = errno;
+            ::close(fd);
+            throw std::system_error(err, std::system_category(), "mmap");
+        }
+        data_ = static_cast<segment_type*>(p);
+    }
+
+    int fd_;
+    segment_type* data_ = nullptr;
+};
+
+} // namespace protoserv
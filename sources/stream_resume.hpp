@@ -0,0 +1,193 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace protoserv
+{
+// @brief The sequence frame carries the uint64_t sequence number of the next frame
+constexpr uint16_t sequence_message_type = 0xfffd;
+
+// @brief The resume request: uint64_t stream id, uint64_t sequence number the receiver expects next
+constexpr uint16_t resume_message_type = 0xfffc;
+
+// @brief The resume reply: uint64_t sequence number the stream continues with
+constexpr uint16_t resumed_message_type = 0xfffb;
+
+// @brief Size of the sequence frame, the header included
+constexpr size_t sequence_frame_size = 2 * sizeof(uint16_t) + sizeof(uint64_t);
+
+/*
+@class retransmit_ring
+@description
+The last frames sent on a stream, by sequence number. The ring holds
+a fixed number of frames, the oldest are overwritten; the slots keep
+their buffers, so the steady state does not allocate.
+*/
+class retransmit_ring
+{
+public:
+    explicit retransmit_ring(size_t capacity)
+        : frames_(capacity)
+    {
+    }
+
+    // @brief Stores the frame, returns its sequence number
+    uint64_t push(const void* frame, size_t len)
+    {
+        frames_[next_ % frames_.size()].assign(static_cast<const char*>(frame), len);
+        return next_++;
+    }
+
+    // @brief The sequence number of the next frame
+    uint64_t next() const
+    {
+        return next_;
+    }
+
+    // @brief The sequence number of the oldest frame still held
+    uint64_t oldest() const
+    {
+        return next_ > frames_.size() ? next_ - frames_.size() : 0;
+    }
+
+    // @brief Checks if the frames from the given sequence number on are all held
+    bool holds(uint64_t from) const
+    {
+        return from >= oldest() && from <= next_;
+    }
+
+    // @brief Passes the frames from the given sequence number on, see holds()
+    template <typename F>
+    void replay(uint64_t from, F&& f) const
+    {
+        for (auto seq = from; seq < next_; ++seq)
+        {
+            auto& frame = frames_[seq % frames_.size()];
+            f(seq, frame.data(), frame.size());
+        }
+    }
+
+private:
+    std::vector<std::string> frames_;
+    uint64_t next_ = 0;
+};
+
+/*
+@class sequenced_stream
+@description
+The sending side of a resumable stream. Outlives the sessions: a session
+of the receiver reconnecting with the same stream id takes it over.
+*/
+class sequenced_stream
+{
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    explicit sequenced_stream(size_t ring_size)
+        : ring_(ring_size)
+    {
+    }
+
+    retransmit_ring& ring()
+    {
+        return ring_;
+    }
+
+    // @brief The session sending the stream now, nullptr if detached
+    const void* owner() const
+    {
+        return owner_;
+    }
+
+    void attach(const void* session)
+    {
+        owner_ = session;
+    }
+
+    // @brief Detaches the session, unless another one took the stream over already
+    void detach(const void* session, clock_type::time_point now)
+    {
+        if (owner_ == session)
+        {
+            owner_ = nullptr;
+            detached_at_ = now;
+        }
+    }
+
+    // @brief Checks if the stream has been detached for longer than given
+    bool abandoned(clock_type::time_point now, clock_type::duration retention) const
+    {
+        return !owner_ && now - detached_at_ > retention;
+    }
+
+private:
+    retransmit_ring ring_;
+    const void* owner_ = nullptr;
+    clock_type::time_point detached_at_;
+};
+
+/*
+@class stream_registry
+@description
+The resumable streams of a server by stream id. The streams detached for
+longer than the retention are forgotten, the receivers resuming them
+later start over (and have to take a snapshot).
+*/
+class stream_registry
+{
+public:
+    using clock_type = sequenced_stream::clock_type;
+
+    stream_registry(size_t ring_size, clock_type::duration retention)
+        : ring_size_(ring_size)
+        , retention_(retention)
+    {
+    }
+
+    // @brief Finds the stream by id, creates a new one if there is none
+    std::shared_ptr<sequenced_stream> find_or_create(uint64_t id)
+    {
+        prune(clock_type::now());
+
+        auto& stream = streams_[id];
+        if (!stream)
+        {
+            stream = std::make_shared<sequenced_stream>(ring_size_);
+        }
+        return stream;
+    }
+
+    // @brief Returns the number of streams, attached or not
+    size_t size() const
+    {
+        return streams_.size();
+    }
+
+private:
+    // @brief Forgets the abandoned streams
+    void prune(clock_type::time_point now)
+    {
+        for (auto it = streams_.begin(); it != streams_.end();)
+        {
+            if (it->second->abandoned(now, retention_))
+            {
+                it = streams_.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    size_t ring_size_;
+    clock_type::duration retention_;
+    std::unordered_map<uint64_t, std::shared_ptr<sequenced_stream>> streams_;
+};
+
+} // namespace protoserv
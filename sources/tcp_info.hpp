@@ -0,0 +1,123 @@
+#pragma once
+
+#include <chrono>
+#include <ostream>
+#include <algorithm>
+#include <cstdint>
+
+#ifdef __linux__
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <linux/sockios.h>
+#endif
+
+#include "latency_stats.hpp"
+
+namespace protoserv
+{
+/*
+@brief Network health of a TCP connection, as seen by the kernel
+@description
+Tells a slow network (high rtt, retransmits, small congestion window)
+from a slow consumer (data piling up unsent or unacknowledged).
+*/
+struct tcp_sample
+{
+    // smoothed round trip time and its variation, microseconds
+    uint32_t rtt_us = 0;
+    uint32_t rttvar_us = 0;
+
+    // congestion window, segments
+    uint32_t cwnd = 0;
+
+    // segments retransmitted over the lifetime of the connection
+    uint32_t retransmits = 0;
+
+    // segments sent, but not acknowledged yet
+    uint32_t unacked = 0;
+
+    // bytes in the send queue the kernel has not sent yet
+    uint32_t notsent_bytes = 0;
+
+    // the moment the sample was taken, the epoch if never sampled
+    std::chrono::steady_clock::time_point sampled_at;
+};
+
+/*
+@description
+Queries TCP_INFO and the unsent part of the send queue of the given socket.
+Returns false and leaves the sample intact if the platform does not support it.
+*/
+inline bool sample_tcp_info(int fd, tcp_sample& sample)
+{
+#ifdef __linux__
+    tcp_info info{};
+    socklen_t len = sizeof(info);
+    if (::getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &len) != 0)
+    {
+        return false;
+    }
+
+    int notsent = 0;
+    if (::ioctl(fd, SIOCOUTQNSD, &notsent) != 0)
+    {
+        notsent = 0;
+    }
+
+    sample.rtt_us = info.tcpi_rtt;
+    sample.rttvar_us = info.tcpi_rttvar;
+    sample.cwnd = info.tcpi_snd_cwnd;
+    sample.retransmits = info.tcpi_total_retrans;
+    sample.unacked = info.tcpi_unacked;
+    sample.notsent_bytes = static_cast<uint32_t>(notsent);
+    sample.sampled_at = std::chrono::steady_clock::now();
+    return true;
+#else
+    return false;
+#endif
+}
+
+// @brief Aggregate of the TCP_INFO samples of many sessions
+struct tcp_summary
+{
+    // number of sessions sampled at least once
+    size_t sessions = 0;
+
+    // round trip times, nanoseconds
+    latency_histogram rtt;
+
+    uint64_t retransmits = 0;
+    uint64_t notsent_bytes = 0;
+    uint32_t max_unacked = 0;
+    uint32_t max_notsent_bytes = 0;
+
+    // @brief Accounts for the sample, ignores the never sampled ones
+    void add(const tcp_sample& s)
+    {
+        if (s.sampled_at != std::chrono::steady_clock::time_point())
+        {
+            ++sessions;
+            rtt.record(int64_t(s.rtt_us) * 1000);
+            retransmits += s.retransmits;
+            notsent_bytes += s.notsent_bytes;
+            max_unacked = std::max(max_unacked, s.unacked);
+            max_notsent_bytes = std::max(max_notsent_bytes, s.notsent_bytes);
+        }
+    }
+
+    // @brief Prints the summary
+    void print(std::ostream& os) const
+    {
+        os << "sessions     " << sessions << "\r\n"
+           << "rtt p50 us   " << rtt.percentile(50) / 1000 << "\r\n"
+           << "rtt p99 us   " << rtt.percentile(99) / 1000 << "\r\n"
+           << "rtt max us   " << rtt.max() / 1000 << "\r\n"
+           << "retransmits  " << retransmits << "\r\n"
+           << "unacked max  " << max_unacked << "\r\n"
+           << "notsent      " << notsent_bytes << " (max " << max_notsent_bytes << ")\r\n";
+    }
+};
+
+} // namespace protoserv
@@ -1,21 +1,153 @@
 
 #pragma once
 #include <boost/asio.hpp>
+#include <algorithm>
 #include <memory>
 #include <chrono>
+#include <cstdint>
+#include <functional>
+
+#ifdef __linux__
+#include <sys/timerfd.h>
+#include <unistd.h>
+#endif
 
 namespace protoserv
 {
+// @brief What a periodic timer does with the ticks it had no time to run
+// @description
+// catch_up runs the missed ticks back to back, skip drops them and waits for the next deadline.
+// Either way the deadlines stay where the period puts them, the handler time does not shift them.
+enum class tick_policy
+{
+    catch_up,
+    skip
+};
+
+/*
+@class tick_schedule
+@description
+The absolute deadlines of a periodic timer: start + N * period. Counts the ticks
+run late, i.e. more than the slack after their deadline, and those missed
+(skipped) when the handler or the loop fell a period or more behind.
+*/
+class tick_schedule
+{
+public:
+    using clock_type = std::chrono::steady_clock;
+
+    // @brief Starts over, the first tick is due a period from now
+    void start(clock_type::duration period, clock_type::time_point now)
+    {
+        period_ = std::max(period, clock_type::duration(1));
+        next_ = now + period_;
+    }
+
+    void set_policy(tick_policy policy)
+    {
+        policy_ = policy;
+    }
+
+    // @brief The delay after the deadline a tick is still on time within
+    void set_slack(clock_type::duration slack)
+    {
+        slack_ = slack;
+    }
+
+    // @brief Returns the deadline of the next tick
+    clock_type::time_point next() const
+    {
+        return next_;
+    }
+
+    clock_type::duration period() const
+    {
+        return period_;
+    }
+
+    // @brief Accounts for the tick due at next() run at now, returns the deadline of the one after
+    clock_type::time_point advance(clock_type::time_point now)
+    {
+        ++ticks_;
+        if (now - next_ > slack_)
+        {
+            ++late_;
+        }
+
+        next_ += period_;
+        if (policy_ == tick_policy::skip && next_ <= now)
+        {
+            auto behind = (now - next_) / period_ + 1;
+            missed_ += behind;
+            next_ += behind * period_;
+        }
+        return next_;
+    }
+
+    // @brief Accounts for the given number of ticks expired at once, see Timer::enable_timerfd()
+    void expired(uint64_t count, clock_type::time_point now)
+    {
+        if (count > 1)
+        {
+            // only the last one runs
+            missed_ += count - 1;
+            next_ += static_cast<int64_t>(count - 1) * period_;
+        }
+        advance(now);
+    }
+
+    // @brief Returns the number of ticks run
+    uint64_t ticks() const
+    {
+        return ticks_;
+    }
+
+    // @brief Returns the number of ticks run later than the slack after the deadline
+    uint64_t late() const
+    {
+        return late_;
+    }
+
+    // @brief Returns the number of ticks skipped
+    uint64_t missed() const
+    {
+        return missed_;
+    }
+
+private:
+    clock_type::duration period_{ 1 };
+    clock_type::duration slack_{ std::chrono::microseconds(100) };
+    clock_type::time_point next_;
+    tick_policy policy_ = tick_policy::skip;
+    uint64_t ticks_ = 0;
+    uint64_t late_ = 0;
+    uint64_t missed_ = 0;
+};
+
 // @brief Asynchronous timer
+// @description
+// The ticks are due on the absolute deadlines, see tick_schedule, so the handler time
+// does not make the timer drift. Missed ticks are skipped unless told otherwise.
 class Timer : public std::enable_shared_from_this<Timer>
 {
 public:
     using pointer = std::shared_ptr<Timer>;
+    using clock_type = tick_schedule::clock_type;
 
     explicit Timer(boost::asio::io_service& svc)
         : timer_(svc)
-        , period_(0)
+#ifdef __linux__
+        , fd_(svc)
+#endif
+    {
+    }
+
+    ~Timer()
     {
+#ifdef __linux__
+        boost::system::error_code ec;
+        fd_.close(ec);
+#endif
     }
 
     // @brief Schedules recurring asynchronous event
@@ -24,8 +156,7 @@ public:
     template <typename Period>
     void start(Period period, std::function<void(void)> handler)
     {
-        auto microsec = std::chrono::duration_cast<std::chrono::microseconds>(period);
-        period_ = boost::posix_time::microsec{ microsec.count() };
+        period_ = std::chrono::duration_cast<clock_type::duration>(period);
         handler_ = handler;
         resume();
     }
@@ -40,16 +171,78 @@ public:
     void pause()
     {
         paused_ = true;
+        ++generation_;
+#ifdef __linux__
+        if (fd_.is_open())
+        {
+            itimerspec off{};
+            ::timerfd_settime(fd_.native_handle(), 0, &off, nullptr);
+        }
+#endif
     }
 
-    // @brief Resumes the previously paused timer
+    // @brief Resumes the previously paused timer, the first tick is due a period from now
     void resume()
     {
         paused_ = false;
-        timer_.expires_from_now(period_);
+        ++generation_;
+        schedule_.start(period_, clock_type::now());
+#ifdef __linux__
+        if (fd_.is_open())
+        {
+            arm_timerfd();
+            do_wait_timerfd();
+            return;
+        }
+#endif
+        timer_.expires_at(schedule_.next());
         do_async_wait();
     }
 
+    // @brief Sets what to do with the ticks missed, see tick_policy
+    void set_policy(tick_policy policy)
+    {
+        schedule_.set_policy(policy);
+    }
+
+    // @brief Sets the delay after the deadline a tick still counts on time within
+    template <typename Duration>
+    void set_slack(Duration slack)
+    {
+        schedule_.set_slack(std::chrono::duration_cast<clock_type::duration>(slack));
+    }
+
+    /*
+    @description
+    Makes the timer run on its own CLOCK_MONOTONIC timerfd, armed once with the period:
+    the kernel keeps the deadlines, nothing is re-armed per tick. The ticks the loop
+    was too busy to take are counted as missed, whatever the policy. Linux only,
+    returns false elsewhere or if the timerfd can't be created. Call before start().
+    */
+    bool enable_timerfd()
+    {
+#ifdef __linux__
+        if (!fd_.is_open())
+        {
+            auto fd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (fd < 0)
+            {
+                return false;
+            }
+            fd_.assign(fd);
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // @brief Returns the tick accounting: the number of ticks run, late, missed
+    const tick_schedule& schedule() const
+    {
+        return schedule_;
+    }
+
 private:
 
     // @brief Schedules async timer event
@@ -57,24 +250,78 @@ private:
     {
         // asio keeps a reference to the timer thus preventing it from being destroyed
         auto self = shared_from_this();
-        timer_.async_wait([this, self](boost::system::error_code err)
+        auto generation = generation_;
+        timer_.async_wait([this, self, generation](boost::system::error_code err)
         {
-            if (!err && !paused_)
+            if (!err && !paused_ && generation == generation_)
             {
+                // the next deadline does not depend on the handler time
+                timer_.expires_at(schedule_.advance(clock_type::now()));
                 handler_();
 
                 // re-schedule timer event if not paused
-                if (!paused_)
+                if (!paused_ && generation == generation_)
                 {
-                    resume();
+                    do_async_wait();
                 }
             }
         });
     }
 
-    boost::asio::deadline_timer timer_;
-    boost::posix_time::microseconds period_;
+#ifdef __linux__
+    void arm_timerfd()
+    {
+        auto to_timespec = [](clock_type::duration d)
+        {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+            return timespec{ static_cast<time_t>(ns / 1000000000), static_cast<long>(ns % 1000000000) }; // NOLINT(runtime/int)
+        };
+
+        // steady_clock is CLOCK_MONOTONIC
+        itimerspec spec{};
+        spec.it_value = to_timespec(schedule_.next().time_since_epoch());
+        spec.it_interval = to_timespec(schedule_.period());
+        ::timerfd_settime(fd_.native_handle(), TFD_TIMER_ABSTIME, &spec, nullptr);
+    }
+
+    void do_wait_timerfd()
+    {
+        auto self = shared_from_this();
+        auto generation = generation_;
+        fd_.async_wait(boost::asio::posix::stream_descriptor::wait_read,
+                       [this, self, generation](boost::system::error_code err)
+        {
+            if (err || paused_ || generation != generation_)
+            {
+                return;
+            }
+
+            uint64_t expirations = 0;
+            if (::read(fd_.native_handle(), &expirations, sizeof(expirations)) == sizeof(expirations) && expirations)
+            {
+                schedule_.expired(expirations, clock_type::now());
+                handler_();
+            }
+
+            if (!paused_ && generation == generation_)
+            {
+                do_wait_timerfd();
+            }
+        });
+    }
+#endif
+
+    boost::asio::steady_timer timer_;
+    clock_type::duration period_{ 0 };
+    tick_schedule schedule_;
     std::function<void(void)> handler_;
     bool paused_ = false;
+    // a wait of a previous start, pause or resume is ignored
+    uint64_t generation_ = 0;
+
+#ifdef __linux__
+    // the timer's own timerfd, closed unless enabled
+    boost::asio::posix::stream_descriptor fd_;
+#endif
 };
 } // namespace protoserv
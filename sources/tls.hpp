@@ -0,0 +1,379 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/asio/ssl/error.hpp>
+
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#include <climits>
+
+namespace protoserv
+{
+// @brief Thrown when the TLS configuration can't be loaded
+class tls_error : public std::runtime_error
+{
+public:
+    explicit tls_error(const std::string& what)
+        : std::runtime_error(what + ": " + last_error())
+    {
+    }
+
+private:
+    static std::string last_error()
+    {
+        char buf[256] = "unknown error";
+        if (auto code = ERR_get_error())
+        {
+            ERR_error_string_n(code, buf, sizeof(buf));
+        }
+        return buf;
+    }
+};
+
+/*
+@class tls_context
+@description
+TLS configuration shared by the sessions of one side: the listener (server side)
+or the upstream connections (client side). With kernel_tls set, the server side
+asks OpenSSL to hand the record encryption over to the kernel (TCP_ULP tls)
+once the handshake is done, which requires OpenSSL 3 and the tls kernel module.
+The client side keeps it in userspace: the upstream server may send session
+tickets after the handshake, the kernel receive path fails on such records.
+*/
+class tls_context
+{
+public:
+    // @brief Server side context, the certificate chain and the private key are PEM files
+    static std::unique_ptr<tls_context> server(
+        const std::string& certificate, const std::string& private_key, bool kernel_tls = true)
+    {
+        std::unique_ptr<tls_context> ret(new tls_context(TLS_server_method(), true, kernel_tls));
+        auto ctx = ret->native_handle();
+
+        if (SSL_CTX_use_certificate_chain_file(ctx, certificate.c_str()) != 1)
+        {
+            throw tls_error("certificate " + certificate);
+        }
+        if (SSL_CTX_use_PrivateKey_file(ctx, private_key.c_str(), SSL_FILETYPE_PEM) != 1
+                || SSL_CTX_check_private_key(ctx) != 1)
+        {
+            throw tls_error("private key " + private_key);
+        }
+
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+        // no post-handshake messages, the kernel receive path would choke on them
+        SSL_CTX_set_num_tickets(ctx, 0);
+#endif
+        return ret;
+    }
+
+    /*
+    @description
+    Client side context. Unless verify_peer is off, the peer certificate chain
+    is verified against the CA file and the certificate must match server_name,
+    or the address connected to if the name is empty. The name, if any,
+    goes in the SNI extension as well.
+    */
+    static std::unique_ptr<tls_context> client(
+        const std::string& ca_file, const std::string& server_name = "", bool verify_peer = true)
+    {
+        if (verify_peer && ca_file.empty())
+        {
+            throw std::invalid_argument("TLS client: a CA file is required unless the peer verification is off");
+        }
+
+        std::unique_ptr<tls_context> ret(new tls_context(TLS_client_method(), false, false));
+        ret->server_name_ = server_name;
+        ret->verify_peer_ = verify_peer;
+        auto ctx = ret->native_handle();
+
+        if (!ca_file.empty() && SSL_CTX_load_verify_locations(ctx, ca_file.c_str(), nullptr) != 1)
+        {
+            throw tls_error("CA file " + ca_file);
+        }
+        SSL_CTX_set_verify(ctx, verify_peer ? SSL_VERIFY_PEER : SSL_VERIFY_NONE, nullptr);
+        return ret;
+    }
+
+    tls_context(const tls_context&) = delete;
+    tls_context& operator =(const tls_context&) = delete;
+
+    ~tls_context()
+    {
+        SSL_CTX_free(ctx_);
+    }
+
+    SSL_CTX* native_handle()
+    {
+        return ctx_;
+    }
+
+    // @brief Checks if the context accepts handshakes rather than initiates them
+    bool server_side() const
+    {
+        return server_side_;
+    }
+
+    // @brief The name the upstream certificate must match, empty means the address connected to
+    const std::string& server_name() const
+    {
+        return server_name_;
+    }
+
+    // @brief Checks if the client side verifies the upstream certificate
+    bool verify_peer() const
+    {
+        return verify_peer_;
+    }
+
+private:
+    tls_context(const SSL_METHOD* method, bool server_side, bool kernel_tls)
+        : ctx_(SSL_CTX_new(method))
+        , server_side_(server_side)
+    {
+        if (!ctx_)
+        {
+            throw tls_error("SSL_CTX_new");
+        }
+
+        SSL_CTX_set_min_proto_version(ctx_, TLS1_2_VERSION);
+#ifdef SSL_OP_ENABLE_KTLS
+        if (kernel_tls)
+        {
+            SSL_CTX_set_options(ctx_, SSL_OP_ENABLE_KTLS);
+        }
+#endif
+    }
+
+    SSL_CTX* ctx_;
+    bool server_side_;
+    std::string server_name_;
+    bool verify_peer_ = false;
+};
+
+/*
+@class tls_channel
+@description
+TLS state of a single connection. The handshake runs on the socket itself
+(non-blocking, the caller waits for readiness). Afterwards every direction
+the kernel took over is plain socket IO, the others go through memory BIOs:
+the session reads the ciphertext into input_buffer(), decrypts it with decrypt(),
+and sends the output() of encrypt().
+*/
+class tls_channel
+{
+public:
+    enum class state
+    {
+        done,
+        want_read,
+        want_write,
+        failed
+    };
+
+    // the largest TLS record along with its header and trailer
+    static constexpr size_t input_size = 16 * 1024 + 512;
+
+    // @brief The peer name is that of the upstream server, ignored on the server side
+    tls_channel(tls_context& ctx, int fd, const std::string& peer_name = "")
+        : ssl_(SSL_new(ctx.native_handle()))
+    {
+        if (!ssl_)
+        {
+            throw tls_error("SSL_new");
+        }
+
+        SSL_set_fd(ssl_, fd);
+        if (ctx.server_side())
+        {
+            SSL_set_accept_state(ssl_);
+        }
+        else
+        {
+            set_peer_name(ctx.server_name().empty() ? peer_name : ctx.server_name(), ctx.verify_peer());
+            SSL_set_connect_state(ssl_);
+        }
+    }
+
+    tls_channel(const tls_channel&) = delete;
+    tls_channel& operator =(const tls_channel&) = delete;
+
+    // @brief Frees the connection state, the socket stays open
+    ~tls_channel()
+    {
+        SSL_free(ssl_);
+    }
+
+    // @brief Makes a handshake step, tells what to wait for next
+    state handshake()
+    {
+        ERR_clear_error();
+        auto ret = SSL_do_handshake(ssl_);
+        if (ret == 1)
+        {
+            finish_handshake();
+            return state::done;
+        }
+
+        switch (SSL_get_error(ssl_, ret))
+        {
+        case SSL_ERROR_WANT_READ:
+            return state::want_read;
+        case SSL_ERROR_WANT_WRITE:
+            return state::want_write;
+        default:
+            return state::failed;
+        }
+    }
+
+    // @brief Checks if the kernel encrypts the outgoing data
+    bool kernel_send() const
+    {
+        return kernel_send_;
+    }
+
+    // @brief Checks if the kernel decrypts the incoming data
+    bool kernel_recv() const
+    {
+        return kernel_recv_;
+    }
+
+    // @brief The buffer to read the ciphertext into
+    boost::asio::mutable_buffer input_buffer()
+    {
+        return boost::asio::buffer(input_);
+    }
+
+    // @brief Passes the given number of ciphertext bytes read into input_buffer() on
+    void received(size_t len)
+    {
+        BIO_write(rbio_, input_.data(), static_cast<int>(len));
+    }
+
+    /*
+    @description
+    Decrypts the received data into the given buffer. Returns would_block if
+    a complete record is yet to be received, eof if the peer closed the session.
+    */
+    boost::system::error_code decrypt(void* buf, size_t size, size_t& len)
+    {
+        ERR_clear_error();
+        auto ret = SSL_read(ssl_, buf, static_cast<int>(std::min<size_t>(size, INT_MAX)));
+        if (ret > 0)
+        {
+            len = static_cast<size_t>(ret);
+            return {};
+        }
+
+        switch (SSL_get_error(ssl_, ret))
+        {
+        case SSL_ERROR_WANT_READ:
+            return boost::asio::error::would_block;
+        case SSL_ERROR_ZERO_RETURN:
+            return boost::asio::error::eof;
+        default:
+            return boost::system::error_code(static_cast<int>(ERR_get_error()), boost::asio::error::get_ssl_category());
+        }
+    }
+
+    // @brief Encrypts the data, the records pile up in output(). The data is lost on error.
+    boost::system::error_code encrypt(const void* buf, size_t len)
+    {
+        if (!len)
+        {
+            return {};
+        }
+
+        ERR_clear_error();
+        if (SSL_write(ssl_, buf, static_cast<int>(len)) > 0)
+        {
+            return {};
+        }
+        if (auto code = ERR_get_error())
+        {
+            return boost::system::error_code(static_cast<int>(code), boost::asio::error::get_ssl_category());
+        }
+        return boost::asio::error::fault;
+    }
+
+    /*
+    @description
+    Takes the records produced since the last call, including any protocol
+    messages generated while decrypting. Valid until the next call.
+    */
+    boost::asio::const_buffer output()
+    {
+        output_.resize(BIO_ctrl_pending(wbio_));
+        if (!output_.empty())
+        {
+            BIO_read(wbio_, output_.data(), static_cast<int>(output_.size()));
+        }
+        return boost::asio::buffer(output_);
+    }
+
+private:
+    // @brief Sends the host name in SNI, makes the handshake check the certificate against the name
+    void set_peer_name(const std::string& name, bool verify)
+    {
+        if (name.empty())
+        {
+            return;
+        }
+
+        boost::system::error_code ec;
+        boost::asio::ip::make_address(name, ec);
+        if (ec)
+        {
+            // a host name, the IP addresses are not sent in SNI
+            SSL_set_tlsext_host_name(ssl_, name.c_str());
+        }
+        if (verify)
+        {
+            auto param = SSL_get0_param(ssl_);
+            auto ok = ec ? X509_VERIFY_PARAM_set1_host(param, name.c_str(), 0)
+                      : X509_VERIFY_PARAM_set1_ip_asc(param, name.c_str());
+            if (ok != 1)
+            {
+                throw tls_error("peer name " + name);
+            }
+        }
+    }
+
+    // @brief Checks which directions the kernel took over, moves the rest to memory BIOs
+    void finish_handshake()
+    {
+#if defined(BIO_get_ktls_send)
+        kernel_send_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+        kernel_recv_ = BIO_get_ktls_recv(SSL_get_rbio(ssl_));
+#endif
+        // the socket BIO has read exactly the handshake records, nothing is left behind
+        if (!kernel_recv_)
+        {
+            rbio_ = BIO_new(BIO_s_mem());
+            SSL_set0_rbio(ssl_, rbio_);
+        }
+        if (!kernel_send_)
+        {
+            wbio_ = BIO_new(BIO_s_mem());
+            SSL_set0_wbio(ssl_, wbio_);
+        }
+        input_.resize(kernel_recv_ ? 0 : input_size);
+    }
+
+    SSL* ssl_;
+    BIO* rbio_ = nullptr;
+    BIO* wbio_ = nullptr;
+    bool kernel_send_ = false;
+    bool kernel_recv_ = false;
+    std::vector<uint8_t> input_;
+    std::vector<uint8_t> output_;
+};
+
+} // namespace protoserv
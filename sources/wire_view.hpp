@@ -0,0 +1,268 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace protoserv
+{
+// @brief The reader view type of the protobuf message, specialized by the generated views
+// @description
+// See tools/protoserv_viewgen: a module handler declared as onMessage(Connection&, View)
+// gets the view of the message instead of the parsed message. No type, no view.
+template <typename Message>
+struct view_of
+{
+};
+
+/*
+@class wire_view
+@description
+Reads the fields of an encoded protobuf message right from the bytes, only
+the fields asked for and only when asked. The strings and the bytes are
+string_views into the buffer: the view must not outlive it, a view passed
+to a message handler is good until the handler returns.
+
+Every accessor scans the message, the last occurrence of a field wins as
+with the parsed message. A malformed message reads as the default values.
+The base of the generated views, see tools/protoserv_viewgen.
+*/
+class wire_view
+{
+public:
+    wire_view() = default;
+
+    wire_view(const void* data, int size)
+        : begin_(static_cast<const uint8_t*>(data))
+        , end_(begin_ + size)
+    {
+    }
+
+    explicit wire_view(std::string_view bytes)
+        : wire_view(bytes.data(), static_cast<int>(bytes.size()))
+    {
+    }
+
+    // @brief Returns the encoded message
+    std::string_view wire() const
+    {
+        return std::string_view(reinterpret_cast<const char*>(begin_), end_ - begin_);
+    }
+
+protected:
+    enum wire_type
+    {
+        varint_type = 0,
+        fixed64_type = 1,
+        bytes_type = 2,
+        fixed32_type = 5
+    };
+
+    // @brief Checks if the field is present
+    bool has_field(int number) const
+    {
+        bool found = false;
+        scan(number, [&found](int, const uint8_t*, const uint8_t*)
+        {
+            found = true;
+        });
+        return found;
+    }
+
+    // @brief Reads a varint field: int32, int64, uint32, uint64, bool, enum
+    template <typename T>
+    T varint_field(int number, T def) const
+    {
+        auto ret = def;
+        scan(number, [&ret](int type, const uint8_t* p, const uint8_t* end)
+        {
+            if (type == varint_type)
+            {
+                ret = static_cast<T>(read_varint(p, end));
+            }
+        });
+        return ret;
+    }
+
+    // @brief Reads a zigzag encoded varint field: sint32, sint64
+    template <typename T>
+    T zigzag_field(int number, T def) const
+    {
+        auto ret = def;
+        scan(number, [&ret](int type, const uint8_t* p, const uint8_t* end)
+        {
+            if (type == varint_type)
+            {
+                ret = static_cast<T>(unzigzag(read_varint(p, end)));
+            }
+        });
+        return ret;
+    }
+
+    // @brief Reads a fixed-width field: fixed32, fixed64, sfixed32, sfixed64, float, double
+    template <typename T>
+    T fixed_field(int number, T def) const
+    {
+        auto ret = def;
+        scan(number, [&ret](int type, const uint8_t* p, const uint8_t*)
+        {
+            if (type == (sizeof(T) == 4 ? fixed32_type : fixed64_type))
+            {
+                std::memcpy(&ret, p, sizeof(T));
+            }
+        });
+        return ret;
+    }
+
+    // @brief Reads a length-delimited field: string, bytes, message
+    std::string_view bytes_field(int number, std::string_view def = std::string_view()) const
+    {
+        auto ret = def;
+        scan(number, [&ret](int type, const uint8_t* p, const uint8_t* end)
+        {
+            if (type == bytes_type)
+            {
+                ret = std::string_view(reinterpret_cast<const char*>(p), end - p);
+            }
+        });
+        return ret;
+    }
+
+    // @brief Passes every element of a repeated varint field on, packed or not
+    template <typename T, bool ZigZag = false, typename F>
+    void foreach_varint(int number, F&& f) const
+    {
+        scan(number, [&f](int type, const uint8_t* p, const uint8_t* end)
+        {
+            if (type == varint_type)
+            {
+                f(convert<T, ZigZag>(read_varint(p, end)));
+            }
+            else if (type == bytes_type)
+            {
+                while (p < end)
+                {
+                    f(convert<T, ZigZag>(read_varint(p, end)));
+                }
+            }
+        });
+    }
+
+    // @brief Passes every element of a repeated fixed-width field on, packed or not
+    template <typename T, typename F>
+    void foreach_fixed(int number, F&& f) const
+    {
+        scan(number, [&f](int type, const uint8_t* p, const uint8_t* end)
+        {
+            T value;
+            if (type == (sizeof(T) == 4 ? fixed32_type : fixed64_type))
+            {
+                std::memcpy(&value, p, sizeof(T));
+                f(value);
+            }
+            else if (type == bytes_type)
+            {
+                for (; end - p >= static_cast<std::ptrdiff_t>(sizeof(T)); p += sizeof(T))
+                {
+                    std::memcpy(&value, p, sizeof(T));
+                    f(value);
+                }
+            }
+        });
+    }
+
+    // @brief Passes every element of a repeated length-delimited field on
+    template <typename F>
+    void foreach_bytes(int number, F&& f) const
+    {
+        scan(number, [&f](int type, const uint8_t* p, const uint8_t* end)
+        {
+            if (type == bytes_type)
+            {
+                f(std::string_view(reinterpret_cast<const char*>(p), end - p));
+            }
+        });
+    }
+
+private:
+    // @brief Passes the wire type and the value bytes of every occurrence of the field on
+    template <typename F>
+    void scan(int number, F&& f) const
+    {
+        auto p = begin_;
+        while (p < end_)
+        {
+            auto key = read_varint(p, end_);
+            auto type = static_cast<int>(key & 7);
+            auto value = p;
+
+            switch (type)
+            {
+            case varint_type:
+                read_varint(p, end_);
+                break;
+            case fixed64_type:
+                p += 8;
+                break;
+            case fixed32_type:
+                p += 4;
+                break;
+            case bytes_type:
+            {
+                auto len = read_varint(p, end_);
+                if (len > static_cast<uint64_t>(end_ - p))
+                {
+                    return;
+                }
+                value = p;
+                p += len;
+                break;
+            }
+            default:
+                // groups are not supported, nor is anything after them
+                return;
+            }
+
+            if (p > end_)
+            {
+                return;
+            }
+            if (static_cast<int>(key >> 3) == number)
+            {
+                f(type, value, p);
+            }
+        }
+    }
+
+    static uint64_t read_varint(const uint8_t*& p, const uint8_t* end)
+    {
+        uint64_t ret = 0;
+        for (int shift = 0; p < end && shift < 64; shift += 7)
+        {
+            auto b = *p++;
+            ret |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if (!(b & 0x80))
+            {
+                break;
+            }
+        }
+        return ret;
+    }
+
+    static int64_t unzigzag(uint64_t v)
+    {
+        return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+    }
+
+    template <typename T, bool ZigZag>
+    static T convert(uint64_t v)
+    {
+        return ZigZag ? static_cast<T>(unzigzag(v)) : static_cast<T>(v);
+    }
+
+    const uint8_t* begin_ = nullptr;
+    const uint8_t* end_ = nullptr;
+};
+
+} // namespace protoserv
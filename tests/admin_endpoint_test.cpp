@@ -0,0 +1,134 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include <sstream>
+#include <string>
+
+#include "module.hpp"
+#include "runner.hpp"
+#include "admin_endpoint.hpp"
+
+#include "protobuf_messages/messages.pb.h"
+
+namespace test = tests;
+
+template <typename T>
+using Runner = test::Runner<T>;
+
+namespace
+{
+struct Server : public module_base<Server, test::SimpleClientMessage>
+{
+    Server()
+    {
+        onMetricsScraped = [](protoserv::metrics_writer & writer)
+        {
+            writer.family("app_answer", "gauge", "The answer");
+            writer.sample("app_answer", "", 42);
+        };
+    }
+};
+
+// @brief Sends the request to the admin port, reads the reply up to the delimiter or EOF
+std::string admin_request(uint16_t port, const std::string& request, const std::string& delim)
+{
+    using tcp = boost::asio::ip::tcp;
+
+    boost::asio::io_service service;
+    tcp::socket socket(service);
+    tcp::endpoint endpoint(boost::asio::ip::address::from_string("127.0.0.1"), port);
+
+    boost::system::error_code ec;
+    do
+    {
+        socket.close(ec);
+        socket.connect(endpoint, ec);
+    }
+    while (ec);
+
+    boost::asio::write(socket, boost::asio::buffer(request));
+
+    boost::asio::streambuf reply;
+    if (delim.empty())
+    {
+        boost::asio::read(socket, reply, ec);
+    }
+    else
+    {
+        boost::asio::read_until(socket, reply, delim, ec);
+    }
+
+    return std::string(boost::asio::buffers_begin(reply.data()), boost::asio::buffers_end(reply.data()));
+}
+} // namespace anonymous
+
+BOOST_AUTO_TEST_SUITE(admin_endpoint_test)
+
+BOOST_AUTO_TEST_CASE(writes_histogram_in_prometheus_format)
+{
+    protoserv::latency_histogram h;
+    h.record(1);
+    h.record(3);
+
+    std::ostringstream os;
+    protoserv::metrics_writer writer(os);
+    writer.histogram("lat", "type=\"1\"", h);
+
+    BOOST_CHECK_EQUAL(
+        "lat_bucket{type=\"1\",le=\"0\"} 0\n"
+        "lat_bucket{type=\"1\",le=\"1\"} 1\n"
+        "lat_bucket{type=\"1\",le=\"3\"} 2\n"
+        "lat_bucket{type=\"1\",le=\"+Inf\"} 2\n"
+        "lat_sum{type=\"1\"} 4\n"
+        "lat_count{type=\"1\"} 2\n", os.str());
+}
+
+BOOST_AUTO_TEST_CASE(exposes_metrics_over_http)
+{
+    protoserv::Options opts;
+    opts["Port"] = "5999";
+    opts["AdminPort"] = "6999";
+
+    Runner<Server> srv;
+    srv.run_in_background(opts);
+
+    auto reply = admin_request(6999, "GET /metrics HTTP/1.0\r\n\r\n", "");
+    srv.join();
+
+    BOOST_CHECK(reply.find("HTTP/1.0 200 OK") == 0);
+    BOOST_CHECK(reply.find("# TYPE protoserv_client_sessions gauge") != std::string::npos);
+    BOOST_CHECK(reply.find("app_answer 42") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(serves_stdin_commands)
+{
+    protoserv::Options opts;
+    opts["Port"] = "5999";
+    opts["AdminPort"] = "6999";
+
+    Runner<Server> srv;
+    srv.run_in_background(opts);
+
+    auto reply = admin_request(6999, "help\n", "\r\n\r\n");
+    srv.join();
+
+    BOOST_CHECK(reply.find("terminate server") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(closes_connection_on_overlong_line)
+{
+    protoserv::Options opts;
+    opts["Port"] = "5999";
+    opts["AdminPort"] = "6999";
+
+    Runner<Server> srv;
+    srv.run_in_background(opts);
+
+    using endpoint = protoserv::admin_endpoint<boost::asio::ip::tcp>;
+    auto reply = admin_request(6999, std::string(endpoint::max_line_length + 1024, 'x'), "");
+    srv.join();
+
+    BOOST_CHECK(reply.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
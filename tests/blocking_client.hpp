@@ -0,0 +1,90 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "server.hpp"
+
+namespace tests
+{
+/*
+@class blocking_client
+@description
+Talks the wire protocol over a blocking socket, so that the test decides what
+is written when, in pieces if need be, and reads the frames one by one.
+Connects with retries, the server may still be starting in the background.
+*/
+class blocking_client
+{
+public:
+    using tcp = boost::asio::ip::tcp;
+
+    explicit blocking_client(uint16_t port)
+        : socket_(io_)
+    {
+        for (int i = 0; i < 500; ++i)
+        {
+            boost::system::error_code ec;
+            socket_.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port), ec);
+            if (!ec)
+            {
+                socket_.set_option(tcp::no_delay(true));
+                return;
+            }
+            socket_.close();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        BOOST_FAIL("can't connect");
+    }
+
+    // @brief Writes the bytes as they are
+    void write(const std::string& bytes)
+    {
+        boost::asio::write(socket_, boost::asio::buffer(bytes));
+    }
+
+    // @brief Writes a frame of the given type, e.g. a control frame
+    void write(uint16_t type, const void* payload, size_t len)
+    {
+        std::string frame(2 * sizeof(uint16_t) + len, '\0');
+        auto header = reinterpret_cast<uint16_t*>(&frame[0]);
+        header[0] = static_cast<uint16_t>(frame.size());
+        header[1] = type;
+        std::memcpy(&header[2], payload, len);
+        write(frame);
+    }
+
+    // @brief Sends the message as a frame of the given type
+    void send(uint16_t type, const google::protobuf::Message& msg)
+    {
+        write(protoserv::encode_packet(type, msg));
+    }
+
+    // @brief Reads the next frame, returns its type and payload
+    uint16_t read(std::string& payload)
+    {
+        uint16_t header[2];
+        boost::asio::read(socket_, boost::asio::buffer(header));
+        payload.resize(header[0] - sizeof(header));
+        boost::asio::read(socket_, boost::asio::buffer(&payload[0], payload.size()));
+        return header[1];
+    }
+
+    // @brief Reads the next frame, it must be a message of the given type
+    void read(uint16_t type, google::protobuf::Message& msg)
+    {
+        std::string payload;
+        BOOST_REQUIRE_EQUAL(type, read(payload));
+        BOOST_REQUIRE(msg.ParseFromString(payload));
+    }
+
+private:
+    boost::asio::io_service io_;
+    tcp::socket socket_;
+};
+
+} // namespace tests
@@ -0,0 +1,172 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include "module.hpp"
+#include "runner.hpp"
+#include "async_client.hpp"
+#include "loopback_client.hpp"
+#include "message_batch.hpp"
+
+#include "protobuf_messages/messages.pb.h"
+
+#include <atomic>
+#include <chrono>
+
+namespace test = tests;
+
+template <typename T>
+using Runner = test::Runner<T>;
+
+using DeadlineProto = meta::proto<test::SimpleClientMessage, test::Type1Message>;
+using system_clock = std::chrono::system_clock;
+
+const uint16_t UPSTREAM_PORT = 6031;
+const uint16_t FRONTEND_PORT = 6032;
+
+namespace
+{
+// @brief Echoes, remembers the deadline of the last request
+class DeadlineServer : public module_base<DeadlineServer, DeadlineProto>
+{
+public:
+    void onMessage(ClientConnection& conn, test::SimpleClientMessage& msg)
+    {
+        ++served;
+        deadline = protoserv::current_deadline();
+        send_message(conn, msg);
+    }
+
+    void onMessage(ClientConnection&, test::Type1Message&)
+    {
+        deadline = protoserv::current_deadline();
+    }
+
+    std::atomic<int> served{ 0 };
+    std::atomic<int64_t> deadline{ -1 };
+};
+
+// @brief Passes the requests on to the upstream
+class Frontend : public module_base<Frontend, DeadlineProto>
+{
+public:
+    Frontend()
+    {
+        upstream_ = handle_server<Handler>("127.0.0.1", UPSTREAM_PORT);
+    }
+
+    struct Handler
+    {
+        void onConnected(ServerConnection&)
+        {
+            connected = true;
+        }
+
+        void onMessage(ServerConnection&, test::Type1Message&) {}
+
+        std::atomic<bool> connected{ false };
+    };
+
+    void onMessage(ClientConnection& conn, test::Type1Message& msg)
+    {
+        upstream_->send(msg);
+        send_message(conn, msg);
+    }
+
+    void onMessage(ClientConnection&, test::SimpleClientMessage&) {}
+
+    bool upstream_connected() const
+    {
+        return upstream_->connected;
+    }
+
+private:
+    std::shared_ptr<ClientOwner<Handler>> upstream_;
+};
+
+struct Mod
+{
+};
+
+int batch_handled = 0;
+
+void handle_batch(Mod&, protoserv::message_batch<Mod>& batch)
+{
+    batch_handled += static_cast<int>(batch.messages().size());
+}
+} // namespace anonymous
+
+BOOST_AUTO_TEST_SUITE(deadline_test)
+
+BOOST_AUTO_TEST_CASE(drops_expired_requests)
+{
+    DeadlineServer server;
+    protoserv::loopback_client<DeadlineServer> client(server);
+    client.connect();
+
+    test::SimpleClientMessage msg;
+    msg.set_timestamp(1);
+    client.send(msg, system_clock::now() - std::chrono::seconds(1));
+    BOOST_CHECK_EQUAL(0, server.served);
+    BOOST_CHECK_EQUAL(0u, client.pending());
+    BOOST_CHECK_EQUAL(1u, client.peer().expired_requests());
+
+    auto deadline = system_clock::now() + std::chrono::seconds(10);
+    client.send(msg, deadline);
+    BOOST_CHECK_EQUAL(1, server.served);
+    BOOST_CHECK_EQUAL(protoserv::deadline_ns(deadline), server.deadline);
+    BOOST_CHECK_EQUAL(1, client.wait_message<test::SimpleClientMessage>().timestamp());
+
+    // the deadline applies to a single request
+    client.send(msg);
+    BOOST_CHECK_EQUAL(2, server.served);
+    BOOST_CHECK_EQUAL(0, server.deadline);
+    BOOST_CHECK_EQUAL(0, protoserv::current_deadline());
+}
+
+BOOST_AUTO_TEST_CASE(drops_expired_batched_messages)
+{
+    Mod mod;
+    protoserv::message_batch<Mod> batch;
+    auto past = protoserv::deadline_clock_ns() - 1000;
+    auto future = protoserv::deadline_clock_ns() + 1000000000;
+
+    batch.append(mod, nullptr, &handle_batch, protoserv::Message{ 1, nullptr, 0, 0, past });
+    batch.append(mod, nullptr, &handle_batch, protoserv::Message{ 1, nullptr, 0, 0, future });
+    batch.append(mod, nullptr, &handle_batch, protoserv::Message{ 1, nullptr, 0, 0, 0 });
+    batch.flush(mod);
+
+    BOOST_CHECK_EQUAL(2, batch_handled);
+    BOOST_CHECK_EQUAL(1u, batch.expired());
+}
+
+BOOST_AUTO_TEST_CASE(propagates_to_upstream)
+{
+    Runner<DeadlineServer> upstream;
+    upstream.run_in_background(UPSTREAM_PORT);
+
+    Runner<Frontend> frontend;
+    frontend.run_in_background(FRONTEND_PORT);
+
+    for (int i = 0; i < 500 && !frontend->upstream_connected(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    BOOST_REQUIRE(frontend->upstream_connected());
+
+    protoserv::async_client<DeadlineProto> client;
+    client.wait_connect(FRONTEND_PORT);
+
+    auto deadline = system_clock::now() + std::chrono::seconds(10);
+    test::Type1Message msg;
+    msg.set_data(5);
+    client.send(msg, deadline);
+    client.wait_message<test::Type1Message>();
+
+    for (int i = 0; i < 500 && upstream->deadline == -1; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    BOOST_CHECK_EQUAL(protoserv::deadline_ns(deadline), upstream->deadline);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,223 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include "module.hpp"
+#include "loopback_client.hpp"
+#include "reply_order.hpp"
+
+#include "protobuf_messages/messages.pb.h"
+
+#include <string>
+#include <vector>
+
+namespace test = tests;
+
+// Type1Message is answered later, Type3Message right away, both with Type2Message
+using OrderProto = meta::proto<test::Type1Message, test::Type2Message, test::Type3Message>;
+
+namespace
+{
+class SlowServer : public module_base<SlowServer, OrderProto>
+{
+public:
+    void onMessage(ClientConnection& conn, test::Type1Message& msg)
+    {
+        requests.push_back(msg.data());
+        replies.push_back(conn.defer_reply());
+    }
+
+    void onMessage(ClientConnection& conn, test::Type3Message&)
+    {
+        test::Type2Message reply;
+        reply.set_data(-1);
+        if (!batched)
+        {
+            send_message(conn, reply);
+            return;
+        }
+
+        // encoded beforehand and sent in one go, as the last value cache sends a snapshot
+        auto frame = protoserv::encode_packet(meta::identify<OrderProto, test::Type2Message>(), reply);
+        std::vector<boost::asio::const_buffer> frames(2, boost::asio::buffer(frame));
+        conn.send_encoded(frames);
+    }
+
+    void onMessage(ClientConnection&, test::Type2Message&) {}
+
+    // @brief Answers the i-th deferred request, as the upstream would
+    void answer(size_t i)
+    {
+        test::Type2Message reply;
+        reply.set_data(requests[i]);
+        send_message(replies[i], reply);
+    }
+
+    std::vector<int> requests;
+    std::vector<protoserv::deferred_reply> replies;
+    bool batched = false;
+};
+
+using Client = protoserv::loopback_client<SlowServer>;
+
+test::Type1Message slow(int data)
+{
+    test::Type1Message msg;
+    msg.set_data(data);
+    return msg;
+}
+} // namespace anonymous
+
+BOOST_AUTO_TEST_SUITE(deferred_reply_test)
+
+BOOST_AUTO_TEST_CASE(releases_in_the_reserved_order)
+{
+    std::vector<std::string> out;
+    protoserv::reply_order order([&out](const void* buf, size_t len)
+    {
+        out.emplace_back(static_cast<const char*>(buf), len);
+    });
+
+    order.send("a", 1);
+    BOOST_CHECK_EQUAL(1u, out.size());
+
+    auto first = order.reserve();
+    order.send("b", 1);
+    auto second = order.reserve();
+    order.send("c", 1);
+    BOOST_CHECK(order.holding());
+    BOOST_CHECK_EQUAL(2u, order.deferred());
+
+    order.add(second, "2", 1);
+    order.complete(second);
+    BOOST_CHECK_EQUAL(1u, out.size());
+
+    order.add(first, "1", 1);
+    order.complete(first);
+    BOOST_CHECK((out == std::vector<std::string>{ "a", "1", "b", "2", "c" }));
+    BOOST_CHECK(!order.holding());
+    BOOST_CHECK_EQUAL(0u, order.deferred());
+
+    // complete already, sent as any other frame
+    order.add(first, "x", 1);
+    order.complete(first);
+    BOOST_CHECK_EQUAL("x", out.back());
+}
+
+BOOST_AUTO_TEST_CASE(dropped_token_lets_the_rest_go)
+{
+    std::vector<std::string> out;
+    auto order = std::make_shared<protoserv::reply_order>([&out](const void* buf, size_t len)
+    {
+        out.emplace_back(static_cast<const char*>(buf), len);
+    });
+
+    {
+        protoserv::deferred_reply reply(order, order->reserve());
+        auto copy = reply;
+        order->send("a", 1);
+        BOOST_CHECK(copy.pending());
+        BOOST_CHECK(out.empty());
+    }
+    BOOST_CHECK((out == std::vector<std::string>{ "a" }));
+
+    protoserv::deferred_reply cancelled(order, order->reserve());
+    order->send("b", 1);
+    cancelled.cancel();
+    BOOST_CHECK(!cancelled.pending());
+    BOOST_CHECK_EQUAL("b", out.back());
+
+    // the session is gone
+    protoserv::deferred_reply orphan(order, order->reserve());
+    order.reset();
+    BOOST_CHECK(!orphan.pending());
+    orphan.send_encoded("c", 1);
+}
+
+BOOST_AUTO_TEST_CASE(holds_up_to_the_limit)
+{
+    std::vector<std::string> out;
+    protoserv::reply_order order([&out](const void* buf, size_t len)
+    {
+        out.emplace_back(static_cast<const char*>(buf), len);
+    });
+    order.set_hold_limit(4);
+
+    auto slot = order.reserve();
+    BOOST_CHECK(order.send("abc", 3));
+    BOOST_CHECK(!order.send("de", 2));
+    BOOST_CHECK_EQUAL(3u, order.held_bytes());
+
+    order.add(slot, "1", 1);
+    order.complete(slot);
+    BOOST_CHECK((out == std::vector<std::string>{ "1", "abc" }));
+    BOOST_CHECK_EQUAL(0u, order.held_bytes());
+    BOOST_CHECK(order.send("de", 2));
+}
+
+BOOST_AUTO_TEST_CASE(reply_never_sent_closes_the_session)
+{
+    SlowServer server;
+    Client client(server);
+    client.connect();
+    client.peer().limit_held_bytes(64);
+
+    client.send(slow(1));
+    for (int i = 0; i < 32; ++i)
+    {
+        client.send(test::Type3Message());
+    }
+    BOOST_CHECK_EQUAL(0u, client.pending());
+    BOOST_CHECK(client.peer().held_overflows() > 0);
+}
+
+BOOST_AUTO_TEST_CASE(replies_go_out_in_the_request_order)
+{
+    SlowServer server;
+    Client client(server);
+    client.connect();
+
+    test::Type3Message fast;
+    client.send(slow(1));
+    client.send(fast);
+    client.send(slow(2));
+    client.send(fast);
+
+    // all handled, none answered
+    BOOST_CHECK_EQUAL(2u, server.requests.size());
+    BOOST_CHECK_EQUAL(0u, client.pending());
+
+    server.answer(1);
+    BOOST_CHECK_EQUAL(0u, client.pending());
+
+    server.answer(0);
+    BOOST_CHECK_EQUAL(4u, client.pending());
+    for (auto expected : { 1, -1, 2, -1 })
+    {
+        BOOST_CHECK_EQUAL(expected, client.wait_message<test::Type2Message>().data());
+    }
+
+    // nothing deferred, nothing held
+    client.send(fast);
+    BOOST_CHECK_EQUAL(-1, client.wait_message<test::Type2Message>().data());
+}
+
+BOOST_AUTO_TEST_CASE(holds_the_frames_sent_in_one_go)
+{
+    SlowServer server;
+    server.batched = true;
+    Client client(server);
+    client.connect();
+
+    client.send(slow(1));
+    client.send(test::Type3Message());
+    BOOST_CHECK_EQUAL(0u, client.pending());
+
+    server.answer(0);
+    BOOST_CHECK_EQUAL(3u, client.pending());
+    for (auto expected : { 1, -1, -1 })
+    {
+        BOOST_CHECK_EQUAL(expected, client.wait_message<test::Type2Message>().data());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,313 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include "module.hpp"
+#include "runner.hpp"
+#include "flow_control.hpp"
+#include "deadline.hpp"
+
+#include "protobuf_messages/messages.pb.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace test = tests;
+
+template <typename T>
+using Runner = test::Runner<T>;
+
+// Type1Message asks for a burst of SimpleClientMessage
+using FlowProto = meta::proto<test::SimpleClientMessage, test::Type1Message>;
+
+const int BURST = 1000;
+const uint16_t PRODUCER_PORT = 6021;
+
+namespace
+{
+// @brief Builds a frame of the given type and total size
+std::string frame(uint16_t type, uint16_t size, char fill = 'x')
+{
+    std::string ret(size, fill);
+    auto header = reinterpret_cast<uint16_t*>(&ret[0]);
+    header[0] = size;
+    header[1] = type;
+    return ret;
+}
+
+uint16_t frame_type(const std::string& f)
+{
+    return reinterpret_cast<const uint16_t*>(f.data())[1];
+}
+
+// @brief Sends a burst of messages as fast as it can, as asked
+class Producer : public module_base<Producer, FlowProto>
+{
+public:
+    explicit Producer(bool conflated = false)
+        : conflated_(conflated)
+    {
+    }
+
+    void onConnected(ClientConnection& conn)
+    {
+        if (conflated_)
+        {
+            conflate<test::SimpleClientMessage>(conn);
+        }
+    }
+
+    void onMessage(ClientConnection& conn, test::Type1Message& msg)
+    {
+        test::SimpleClientMessage note;
+        note.set_payload(std::string(100, 'x'));
+        for (int i = 0; i < msg.data(); ++i)
+        {
+            note.set_timestamp(i);
+            send_message(conn, note);
+        }
+        parked = conn.flow_control() ? conn.flow_control()->parked() : 0;
+    }
+
+    void onMessage(ClientConnection&, test::SimpleClientMessage&) {}
+
+    std::atomic<size_t> parked{ 0 };
+
+private:
+    bool conflated_;
+};
+
+class ConflatingProducer : public Producer
+{
+public:
+    ConflatingProducer()
+        : Producer(true)
+    {
+    }
+};
+
+// @brief Connects to the producer, asks for a burst, checks the order
+class Consumer : public module_base<Consumer, FlowProto>
+{
+public:
+    Consumer()
+    {
+        async_connect("127.0.0.1", PRODUCER_PORT);
+    }
+
+    void onConnected(ServerConnection& conn)
+    {
+        test::Type1Message start;
+        start.set_data(BURST);
+        send_message(conn, start);
+    }
+
+    void onMessage(ServerConnection&, test::SimpleClientMessage& msg)
+    {
+        if (msg.timestamp() <= last)
+        {
+            ++out_of_order;
+        }
+        last = msg.timestamp();
+        ++received;
+    }
+
+    void onMessage(ServerConnection&, test::Type1Message&) {}
+
+    std::atomic<int> received{ 0 };
+    std::atomic<int> last{ -1 };
+    std::atomic<int> out_of_order{ 0 };
+};
+
+template <typename Server>
+void run_with_window(Runner<Server>& srv, uint16_t port, const char* window)
+{
+    protoserv::Options opts;
+    opts["Port"] = std::to_string(port);
+    opts["FlowControlWindow"] = window;
+    srv.run_in_background(opts);
+}
+
+template <typename Predicate>
+void wait_for(Predicate pred)
+{
+    for (int i = 0; i < 500 && !pred(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+} // namespace anonymous
+
+BOOST_AUTO_TEST_SUITE(flow_control_test)
+
+BOOST_AUTO_TEST_CASE(unlimited_until_granted)
+{
+    protoserv::credit_flow flow;
+    BOOST_CHECK(!flow.limited());
+    BOOST_CHECK(flow.can_send());
+    flow.sent(100);
+    BOOST_CHECK(flow.can_send());
+
+    flow.granted(protoserv::credit_grant{ 2, 0 });
+    BOOST_CHECK(flow.limited());
+    flow.sent(100);
+    flow.sent(100);
+    BOOST_CHECK(!flow.can_send());
+
+    flow.granted(protoserv::credit_grant{ 1, 0 });
+    BOOST_CHECK(flow.can_send());
+}
+
+BOOST_AUTO_TEST_CASE(grants_a_quarter_of_the_window)
+{
+    protoserv::credit_flow flow;
+    flow.set_window(8, 0);
+    BOOST_CHECK_EQUAL(8u, flow.initial_grant().messages);
+
+    flow.consumed(10);
+    BOOST_CHECK(!flow.grant_due());
+    flow.consumed(10);
+    BOOST_REQUIRE(flow.grant_due());
+
+    auto grant = flow.take_grant();
+    BOOST_CHECK_EQUAL(2u, grant.messages);
+    BOOST_CHECK_EQUAL(0u, grant.bytes);
+    BOOST_CHECK(!flow.grant_due());
+}
+
+BOOST_AUTO_TEST_CASE(byte_credit_goes_negative_by_a_frame)
+{
+    protoserv::credit_flow flow;
+    flow.granted(protoserv::credit_grant{ 100, 1000 });
+
+    // larger than the whole window, still goes out
+    BOOST_CHECK(flow.can_send());
+    flow.sent(4000);
+    BOOST_CHECK(!flow.can_send());
+
+    flow.granted(protoserv::credit_grant{ 0, 2000 });
+    BOOST_CHECK(!flow.can_send());
+    flow.granted(protoserv::credit_grant{ 0, 1001 });
+    BOOST_CHECK(flow.can_send());
+}
+
+BOOST_AUTO_TEST_CASE(parks_in_order_and_conflates)
+{
+    protoserv::credit_flow flow;
+    flow.set_conflated(2, true);
+    flow.granted(protoserv::credit_grant{ 1, 0 });
+    flow.sent(8);
+
+    flow.park(frame(1, 8, 'a').data(), 8);
+    flow.park(frame(2, 8, 'b').data(), 8);
+    flow.park(frame(1, 8, 'c').data(), 8);
+    flow.park(frame(2, 8, 'd').data(), 8);
+    BOOST_CHECK_EQUAL(3u, flow.parked());
+    BOOST_CHECK_EQUAL(1u, flow.conflated());
+
+    std::vector<std::string> sent;
+    auto send = [&sent](const void* buf, size_t len)
+    {
+        sent.emplace_back(static_cast<const char*>(buf), len);
+    };
+
+    flow.flush(send);
+    BOOST_CHECK(sent.empty());
+
+    flow.granted(protoserv::credit_grant{ 2, 0 });
+    flow.flush(send);
+    BOOST_REQUIRE_EQUAL(2u, sent.size());
+    BOOST_CHECK_EQUAL(1, frame_type(sent[0]));
+    BOOST_CHECK_EQUAL('a', sent[0].back());
+    BOOST_CHECK_EQUAL(2, frame_type(sent[1]));
+    BOOST_CHECK_EQUAL('d', sent[1].back());
+
+    flow.granted(protoserv::credit_grant{ 5, 0 });
+    flow.flush(send);
+    BOOST_REQUIRE_EQUAL(3u, sent.size());
+    BOOST_CHECK_EQUAL('c', sent[2].back());
+    BOOST_CHECK_EQUAL(0u, flow.parked());
+}
+
+BOOST_AUTO_TEST_CASE(conflates_past_the_prefix_frames)
+{
+    protoserv::credit_flow flow;
+    flow.set_conflated(2, true);
+    flow.granted(protoserv::credit_grant{ 1, 0 });
+    flow.sent(8);
+
+    // a deadline frame in front of the message, as sent along with it
+    auto prefixed = [](char fill)
+    {
+        return frame(protoserv::deadline_message_type, protoserv::deadline_frame_size) + frame(2, 8, fill);
+    };
+
+    auto first = prefixed('a');
+    auto second = prefixed('b');
+    flow.park(first.data(), first.size());
+    flow.park(second.data(), second.size());
+    BOOST_CHECK_EQUAL(1u, flow.parked());
+    BOOST_CHECK_EQUAL(1u, flow.conflated());
+    BOOST_CHECK_EQUAL(second.size(), flow.parked_bytes());
+}
+
+BOOST_AUTO_TEST_CASE(parks_up_to_the_limit)
+{
+    protoserv::credit_flow flow;
+    flow.set_park_limit(20);
+    flow.granted(protoserv::credit_grant{ 1, 0 });
+    flow.sent(8);
+
+    BOOST_CHECK(flow.park(frame(1, 8).data(), 8));
+    BOOST_CHECK(flow.park(frame(1, 8).data(), 8));
+    BOOST_CHECK(!flow.park(frame(1, 8).data(), 8));
+    BOOST_CHECK_EQUAL(2u, flow.parked());
+    BOOST_CHECK_EQUAL(16u, flow.parked_bytes());
+
+    flow.granted(protoserv::credit_grant{ 1, 0 });
+    flow.flush([](const void*, size_t) {});
+    BOOST_CHECK_EQUAL(8u, flow.parked_bytes());
+    BOOST_CHECK(flow.park(frame(1, 8).data(), 8));
+}
+
+BOOST_AUTO_TEST_CASE(parks_the_burst_until_consumed)
+{
+    Runner<Producer> producer;
+    run_with_window(producer, PRODUCER_PORT, "4");
+
+    Runner<Consumer> consumer;
+    run_with_window(consumer, 6022, "4");
+
+    wait_for([&consumer]()
+    {
+        return consumer->received == BURST;
+    });
+
+    BOOST_CHECK_EQUAL(BURST, consumer->received);
+    BOOST_CHECK_EQUAL(BURST - 1, consumer->last);
+    BOOST_CHECK_EQUAL(0, consumer->out_of_order);
+    // all but the first window stayed in the producer, not in the socket
+    BOOST_CHECK_EQUAL(static_cast<size_t>(BURST - 4), producer->parked);
+}
+
+BOOST_AUTO_TEST_CASE(conflates_the_burst)
+{
+    Runner<ConflatingProducer> producer;
+    run_with_window(producer, PRODUCER_PORT, "4");
+
+    Runner<Consumer> consumer;
+    run_with_window(consumer, 6022, "4");
+
+    wait_for([&consumer]()
+    {
+        return consumer->last == BURST - 1;
+    });
+
+    // the window went out, then the latest value only
+    BOOST_CHECK_EQUAL(BURST - 1, consumer->last);
+    BOOST_CHECK_EQUAL(5, consumer->received);
+    BOOST_CHECK_EQUAL(0, consumer->out_of_order);
+    BOOST_CHECK_EQUAL(1u, producer->parked);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,182 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include "module.hpp"
+#include "runner.hpp"
+#include "async_client.hpp"
+#include "hedging.hpp"
+
+#include "protobuf_messages/messages.pb.h"
+
+#include <atomic>
+#include <chrono>
+
+namespace test = tests;
+
+template <typename T>
+using Runner = test::Runner<T>;
+
+using HedgeProto = meta::proto<test::SimpleClientMessage, test::Type1Message>;
+
+const uint16_t SLOW_PORT = 6061;
+const uint16_t FAST_PORT = 6062;
+const uint16_t FRONTEND_PORT = 6063;
+
+namespace
+{
+// @brief Echoes after the given delay
+template <int DelayMs>
+class DelayedEcho : public module_base<DelayedEcho<DelayMs>, HedgeProto>
+{
+public:
+    using ClientConnection = typename module_base<DelayedEcho<DelayMs>, HedgeProto>::ClientConnection;
+
+    void onMessage(ClientConnection& conn, test::Type1Message& msg)
+    {
+        ++served;
+        this->async_wait(std::chrono::milliseconds(DelayMs), [this, &conn, msg]()
+        {
+            this->send_message(conn, msg);
+        });
+    }
+
+    void onMessage(ClientConnection&, test::SimpleClientMessage&) {}
+
+    std::atomic<int> served{ 0 };
+};
+
+using SlowEcho = DelayedEcho<300>;
+using FastEcho = DelayedEcho<0>;
+
+// @brief Asks the slow upstream first, hedges to the fast one
+class Frontend : public module_base<Frontend, HedgeProto>
+{
+public:
+    Frontend()
+    {
+        slow_ = handle_server_async("127.0.0.1", SLOW_PORT);
+        fast_ = handle_server_async("127.0.0.1", FAST_PORT);
+    }
+
+    void onMessage(ClientConnection& conn, test::Type1Message& msg)
+    {
+        send_hedged<test::Type1Message>(slow_, fast_, msg, [this, &conn](test::Type1Message & reply, auto err)
+        {
+            if (!err)
+            {
+                ++replies;
+                send_message(conn, reply);
+            }
+            hedges = hedging().hedges();
+            hedge_wins = hedging().hedge_wins();
+        });
+    }
+
+    void onMessage(ClientConnection&, test::SimpleClientMessage&) {}
+
+    bool upstreams_connected() const
+    {
+        return slow_->connected() && fast_->connected();
+    }
+
+    std::atomic<int> replies{ 0 };
+    std::atomic<uint64_t> hedges{ 0 };
+    std::atomic<uint64_t> hedge_wins{ 0 };
+
+private:
+    std::shared_ptr<ClientOwner<AsyncHandler>> slow_;
+    std::shared_ptr<ClientOwner<AsyncHandler>> fast_;
+};
+} // namespace anonymous
+
+BOOST_AUTO_TEST_SUITE(hedging_test)
+
+BOOST_AUTO_TEST_CASE(delay_follows_the_percentile)
+{
+    protoserv::hedge_policy policy;
+    policy.configure(90, std::chrono::microseconds(10), 0.05);
+    BOOST_CHECK(policy.delay() == std::chrono::microseconds(10));
+
+    // nine in ten replies within ~1ms, the rest take ~100ms
+    for (uint64_t i = 0; i < protoserv::hedge_policy::window; ++i)
+    {
+        policy.record(i % 10 == 9 ? std::chrono::milliseconds(100) : std::chrono::milliseconds(1));
+    }
+    auto delay = policy.delay();
+    BOOST_CHECK(delay >= std::chrono::milliseconds(1));
+    BOOST_CHECK(delay < std::chrono::milliseconds(3));
+
+    // never below the floor
+    policy.configure(90, std::chrono::milliseconds(50), 0.05);
+    BOOST_CHECK(policy.delay() == std::chrono::milliseconds(50));
+}
+
+BOOST_AUTO_TEST_CASE(hedges_within_the_budget)
+{
+    protoserv::hedge_policy policy;
+    policy.configure(95, std::chrono::microseconds(500), 0.25);
+
+    int hedged = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        policy.started();
+        hedged += policy.try_hedge();
+    }
+    BOOST_CHECK_EQUAL(250, hedged);
+    BOOST_CHECK_EQUAL(250u, policy.hedges());
+    BOOST_CHECK_EQUAL(750u, policy.suppressed());
+
+    // a quiet period buys a few hedges only
+    for (int i = 0; i < 1000; ++i)
+    {
+        policy.started();
+    }
+    hedged = 0;
+    while (policy.try_hedge())
+    {
+        ++hedged;
+    }
+    BOOST_CHECK_EQUAL(static_cast<int>(protoserv::hedge_policy::max_balance), hedged);
+}
+
+BOOST_AUTO_TEST_CASE(first_reply_wins)
+{
+    Runner<SlowEcho> slow;
+    slow.run_in_background(SLOW_PORT);
+    Runner<FastEcho> fast;
+    fast.run_in_background(FAST_PORT);
+
+    protoserv::Options opts;
+    opts["Port"] = std::to_string(FRONTEND_PORT);
+    opts["HedgeMinDelay"] = "5000";
+    opts["HedgeBudget"] = "100";
+    Runner<Frontend> frontend;
+    frontend.run_in_background(opts);
+
+    for (int i = 0; i < 500 && !frontend->upstreams_connected(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    BOOST_REQUIRE(frontend->upstreams_connected());
+
+    protoserv::async_client<HedgeProto> client;
+    client.wait_connect(FRONTEND_PORT);
+
+    test::Type1Message msg;
+    msg.set_data(7);
+    client.send(msg);
+
+    auto started = std::chrono::steady_clock::now();
+    BOOST_CHECK_EQUAL(7, client.wait_message<test::Type1Message>().data());
+    BOOST_CHECK(std::chrono::steady_clock::now() - started < std::chrono::milliseconds(250));
+    BOOST_CHECK_EQUAL(1u, frontend->hedges);
+    BOOST_CHECK_EQUAL(1u, frontend->hedge_wins);
+
+    // the late reply of the slow upstream is ignored
+    std::this_thread::sleep_for(std::chrono::milliseconds(400));
+    BOOST_CHECK_EQUAL(1, slow->served);
+    BOOST_CHECK_EQUAL(1, fast->served);
+    BOOST_CHECK_EQUAL(1, frontend->replies);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
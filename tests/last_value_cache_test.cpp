@@ -0,0 +1,164 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include "module.hpp"
+#include "loopback_client.hpp"
+#include "runner.hpp"
+#include "async_client.hpp"
+#include "last_value_cache.hpp"
+
+#include "protobuf_messages/messages.pb.h"
+
+#include <map>
+#include <random>
+
+namespace test = tests;
+
+// SimpleClientMessage is a price update, timestamp is the instrument, Type1Message subscribes
+using PriceProto = meta::proto<test::SimpleClientMessage, test::Type1Message>;
+
+namespace
+{
+class PriceServer : public module_base<PriceServer, PriceProto>
+{
+public:
+    void onMessage(ClientConnection& conn, test::SimpleClientMessage& msg)
+    {
+        cache_message(prices, msg.timestamp(), msg);
+    }
+
+    void onMessage(ClientConnection& conn, test::Type1Message&)
+    {
+        prices.snapshot(conn);
+    }
+
+    protoserv::last_value_cache prices;
+};
+
+using Client = protoserv::loopback_client<PriceServer>;
+
+// @brief Builds the frame of a tiny message
+std::string frame_of(int value)
+{
+    test::Type1Message msg;
+    msg.set_data(value);
+    return protoserv::encode_packet(1, msg);
+}
+} // namespace anonymous
+
+BOOST_AUTO_TEST_SUITE(last_value_cache_test)
+
+BOOST_AUTO_TEST_CASE(keeps_the_latest_value)
+{
+    protoserv::last_value_cache cache;
+    cache.update(7, frame_of(1).data(), frame_of(1).size());
+    cache.update(7, frame_of(2).data(), frame_of(2).size());
+
+    BOOST_CHECK_EQUAL(1u, cache.size());
+    BOOST_REQUIRE(cache.find(7));
+    BOOST_CHECK(*cache.find(7) == frame_of(2));
+    BOOST_CHECK(!cache.find(8));
+    BOOST_CHECK_EQUAL(frame_of(2).size(), cache.bytes());
+}
+
+BOOST_AUTO_TEST_CASE(matches_a_map_under_random_churn)
+{
+    protoserv::last_value_cache cache(4);
+    std::map<uint64_t, std::string> expected;
+    std::mt19937 rnd(42);
+
+    for (int i = 0; i < 20000; ++i)
+    {
+        // few distinct keys, so that the erases hit long probe sequences
+        uint64_t key = rnd() % 512;
+        if (rnd() % 3 == 0)
+        {
+            BOOST_CHECK_EQUAL(expected.erase(key) == 1, cache.erase(key));
+        }
+        else
+        {
+            auto frame = frame_of(i);
+            cache.update(key, frame.data(), frame.size());
+            expected[key] = frame;
+        }
+    }
+
+    BOOST_CHECK_EQUAL(expected.size(), cache.size());
+    for (auto& kv : expected)
+    {
+        auto found = cache.find(kv.first);
+        BOOST_REQUIRE(found);
+        BOOST_CHECK(*found == kv.second);
+    }
+
+    size_t visited = 0;
+    cache.foreach([&visited, &expected](uint64_t key, const std::string & frame)
+    {
+        ++visited;
+        BOOST_CHECK(expected[key] == frame);
+    });
+    BOOST_CHECK_EQUAL(expected.size(), visited);
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_on_subscribe)
+{
+    PriceServer server;
+    Client publisher(server);
+    publisher.connect();
+
+    const int INSTRUMENTS = 1000;
+    test::SimpleClientMessage price;
+    for (int tick = 0; tick < 3; ++tick)
+    {
+        for (int i = 0; i < INSTRUMENTS; ++i)
+        {
+            price.set_timestamp(i);
+            price.set_payload(std::to_string(i * 10 + tick));
+            publisher.send(price);
+        }
+    }
+    BOOST_CHECK_EQUAL(static_cast<size_t>(INSTRUMENTS), server.prices.size());
+
+    Client subscriber(server);
+    subscriber.connect();
+    subscriber.send(test::Type1Message());
+
+    BOOST_REQUIRE_EQUAL(static_cast<size_t>(INSTRUMENTS), subscriber.pending());
+    std::vector<bool> seen(INSTRUMENTS);
+    for (int i = 0; i < INSTRUMENTS; ++i)
+    {
+        auto msg = subscriber.wait_message<test::SimpleClientMessage>();
+        BOOST_REQUIRE(msg.timestamp() < INSTRUMENTS);
+        BOOST_CHECK(!seen[msg.timestamp()]);
+        seen[msg.timestamp()] = true;
+        BOOST_CHECK_EQUAL(std::to_string(msg.timestamp() * 10 + 2), msg.payload());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(snapshot_in_a_single_write)
+{
+    test::Runner<PriceServer> server;
+    server.run_in_background(6041);
+
+    protoserv::async_client<PriceProto> client;
+    client.wait_connect(6041);
+
+    const int INSTRUMENTS = 500;
+    test::SimpleClientMessage price;
+    price.set_payload(std::string(100, 'p'));
+    for (int i = 0; i < INSTRUMENTS; ++i)
+    {
+        price.set_timestamp(i);
+        client.send(price);
+    }
+    client.send(test::Type1Message());
+
+    int sum = 0;
+    for (int i = 0; i < INSTRUMENTS; ++i)
+    {
+        sum += client.wait_message<test::SimpleClientMessage>().timestamp();
+    }
+    BOOST_CHECK_EQUAL(INSTRUMENTS * (INSTRUMENTS - 1) / 2, sum);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
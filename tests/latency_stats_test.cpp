@@ -0,0 +1,89 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include <sstream>
+
+#include "latency_stats.hpp"
+#include "message.hpp"
+#include "deadline.hpp"
+#include "stream_resume.hpp"
+
+using protoserv::latency_histogram;
+using protoserv::latency_stats;
+
+BOOST_AUTO_TEST_SUITE(latency_stats_test)
+
+BOOST_AUTO_TEST_CASE(puts_durations_in_power_of_two_buckets)
+{
+    latency_histogram h;
+    h.record(0);
+    h.record(1);
+    h.record(1000);
+    h.record(1023);
+
+    BOOST_CHECK_EQUAL(1, h.bucket_size(0));
+    BOOST_CHECK_EQUAL(1, h.bucket_size(1));
+    BOOST_CHECK_EQUAL(2, h.bucket_size(10));
+    BOOST_CHECK_EQUAL(1023, latency_histogram::bucket_bound(10));
+}
+
+BOOST_AUTO_TEST_CASE(tracks_count_sum_and_max)
+{
+    latency_histogram h;
+    h.record(10);
+    h.record(30);
+    h.record(-5);
+
+    BOOST_CHECK_EQUAL(3, h.count());
+    BOOST_CHECK_EQUAL(40, h.sum());
+    BOOST_CHECK_EQUAL(30, h.max());
+}
+
+BOOST_AUTO_TEST_CASE(estimates_percentiles_by_bucket_bound)
+{
+    latency_histogram h;
+    for (int i = 0; i < 99; ++i)
+    {
+        h.record(100);
+    }
+    h.record(100000);
+
+    BOOST_CHECK_EQUAL(127, h.percentile(50));
+    BOOST_CHECK_EQUAL(127, h.percentile(99));
+    BOOST_CHECK_EQUAL(100000, h.percentile(100));
+}
+
+BOOST_AUTO_TEST_CASE(keeps_breakdown_per_message_type)
+{
+    latency_stats stats;
+    stats.get(3).handler.record(100);
+    stats.get(7).send_to_write.record(200);
+
+    int types = 0;
+    stats.foreach ([&types](int type, const protoserv::message_latency & t)
+    {
+        BOOST_CHECK(type == 3 || type == 7);
+        ++types;
+    });
+    BOOST_CHECK_EQUAL(2, types);
+
+    std::ostringstream os;
+    stats.print(os);
+    BOOST_CHECK(os.str().find("send_to_write") != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(attributes_prefixed_sends_to_the_message_they_carry)
+{
+    // sequence frame, deadline frame, then the message of type 5
+    uint16_t send[] = { 12, protoserv::sequence_message_type, 0, 0, 0, 0,
+                        12, protoserv::deadline_message_type, 0, 0, 0, 0,
+                        6, 5, 0
+                      };
+    BOOST_CHECK_EQUAL(5, protoserv::sent_message_type(send, sizeof(send)));
+    BOOST_CHECK_EQUAL(5, protoserv::sent_message_type(send + 6, sizeof(send) - 12));
+
+    // a control frame on its own
+    BOOST_CHECK_EQUAL(protoserv::sequence_message_type, protoserv::sent_message_type(send, 12));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
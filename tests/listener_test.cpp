@@ -0,0 +1,141 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include "module.hpp"
+#include "runner.hpp"
+#include "blocking_client.hpp"
+
+#include "protobuf_messages/messages.pb.h"
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+
+namespace test = tests;
+
+template <typename T>
+using Runner = test::Runner<T>;
+
+// Type1Message is a request answered with Type2Message, each module answers its own way
+using ListenerProto = meta::proto<test::Type1Message, test::Type2Message>;
+
+const uint16_t PUBLIC_PORT = 6091;
+const uint16_t REPLICATION_PORT = 6092;
+const uint16_t DEDICATED_PORT = 6093;
+const uint16_t FAILING_PORT = 6094;
+const uint16_t TAKEN_PORT = 6095;
+
+namespace
+{
+// @brief Answers with the request data plus the offset, notes the thread it runs in
+template <int Offset>
+class Answering : public module_base<Answering<Offset>, ListenerProto>
+{
+public:
+    using ClientConnection = typename module_base<Answering<Offset>, ListenerProto>::ClientConnection;
+
+    void onMessage(ClientConnection& conn, test::Type1Message& msg)
+    {
+        thread = std::this_thread::get_id();
+
+        test::Type2Message reply;
+        reply.set_data(msg.data() + Offset);
+        this->send_message(conn, reply);
+    }
+
+    void onMessage(ClientConnection&, test::Type2Message&) {}
+
+    std::atomic<std::thread::id> thread;
+};
+
+using Public = Answering<1000>;
+using Replication = Answering<2000>;
+
+// @brief Asks the server listening on the port, returns the answer
+int ask(uint16_t port, int data)
+{
+    test::blocking_client client(port);
+
+    test::Type1Message msg;
+    msg.set_data(data);
+    client.send(meta::identify<ListenerProto, test::Type1Message>(), msg);
+
+    test::Type2Message reply;
+    client.read(meta::identify<ListenerProto, test::Type2Message>(), reply);
+    return reply.data();
+}
+
+protoserv::Options listener_options(const char* loop)
+{
+    protoserv::Options opts;
+    opts["Port"] = std::to_string(PUBLIC_PORT);
+    opts["Listener.replication.Port"] = std::to_string(REPLICATION_PORT);
+    opts["Listener.replication.Loop"] = loop;
+    // configured, but no module declared for it
+    opts["Listener.unknown.Port"] = "0";
+    return opts;
+}
+} // namespace anonymous
+
+BOOST_AUTO_TEST_SUITE(listener_test)
+
+BOOST_AUTO_TEST_CASE(listener_shares_the_loop)
+{
+    Replication* replication = nullptr;
+
+    Runner<Public> server;
+    server->add_listener<Replication>("replication", [&replication](Replication & r)
+    {
+        replication = &r;
+    });
+    // declared, but not configured: no listener
+    server->add_listener<Replication>("absent");
+
+    auto opts = listener_options("shared");
+    server.run_in_background(opts);
+
+    BOOST_CHECK_EQUAL(1001, ask(PUBLIC_PORT, 1));
+    BOOST_CHECK_EQUAL(2002, ask(REPLICATION_PORT, 2));
+
+    BOOST_REQUIRE(replication);
+    BOOST_CHECK(replication->thread.load() == server->thread.load());
+}
+
+BOOST_AUTO_TEST_CASE(listener_runs_on_a_dedicated_loop)
+{
+    Replication* replication = nullptr;
+
+    Runner<Public> server;
+    server->add_listener<Replication>("replication", [&replication](Replication & r)
+    {
+        replication = &r;
+    });
+
+    auto opts = listener_options("dedicated");
+    opts["Port"] = std::to_string(DEDICATED_PORT);
+    server.run_in_background(opts);
+
+    BOOST_CHECK_EQUAL(1003, ask(DEDICATED_PORT, 3));
+    BOOST_CHECK_EQUAL(2004, ask(REPLICATION_PORT, 4));
+
+    BOOST_REQUIRE(replication);
+    BOOST_CHECK(replication->thread.load() != server->thread.load());
+}
+
+BOOST_AUTO_TEST_CASE(dedicated_loop_failure_reaches_the_host)
+{
+    // the listener can't bind, its loop thread fails to start
+    boost::asio::io_service io;
+    boost::asio::ip::tcp::acceptor taken(io, { boost::asio::ip::address_v4::loopback(), TAKEN_PORT });
+
+    Runner<Public> server;
+    server->add_listener<Replication>("replication");
+
+    auto opts = listener_options("dedicated");
+    opts["Port"] = std::to_string(FAILING_PORT);
+    opts["Listener.replication.Port"] = std::to_string(TAKEN_PORT);
+    BOOST_CHECK_THROW(server.run(opts), std::exception);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
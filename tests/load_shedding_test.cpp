@@ -0,0 +1,147 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include "module.hpp"
+#include "loopback_client.hpp"
+#include "load_shedder.hpp"
+
+#include "protobuf_messages/messages.pb.h"
+
+#include <chrono>
+#include <string>
+
+namespace test = tests;
+
+// Type1Message is expensive and answered "busy" under load, Type3Message is dropped
+using ShedProto = meta::proto<test::SimpleClientMessage, test::Type1Message, test::Type2Message, test::Type3Message>;
+
+namespace
+{
+class ShedServer : public module_base<ShedServer, ShedProto>
+{
+public:
+    ShedServer()
+    {
+        test::Type2Message busy;
+        busy.set_data(-1);
+        shed_when_overloaded<test::Type1Message>(busy);
+        shed_when_overloaded<test::Type3Message>();
+    }
+
+    void onMessage(ClientConnection& conn, test::SimpleClientMessage& msg)
+    {
+        send_message(conn, msg);
+    }
+
+    void onMessage(ClientConnection& conn, test::Type1Message& msg)
+    {
+        test::Type2Message reply;
+        reply.set_data(msg.data());
+        send_message(conn, reply);
+    }
+
+    void onMessage(ClientConnection&, test::Type2Message&) {}
+
+    void onMessage(ClientConnection&, test::Type3Message&)
+    {
+        ++served;
+    }
+
+    int served = 0;
+};
+
+using Client = protoserv::loopback_client<ShedServer>;
+
+// @brief Stands for a session, records what is sent
+struct fake_connection
+{
+    size_t queued_read_bytes() const
+    {
+        return queued;
+    }
+
+    void send_encoded(const void* frame, size_t len)
+    {
+        sent.assign(static_cast<const char*>(frame), len);
+    }
+
+    size_t queued = 0;
+    std::string sent;
+};
+} // namespace anonymous
+
+BOOST_AUTO_TEST_SUITE(load_shedding_test)
+
+BOOST_AUTO_TEST_CASE(sheds_marked_types_only)
+{
+    protoserv::load_shedder shedder;
+    shedder.configure(std::chrono::nanoseconds(0), 1000);
+    shedder.mark(3, "busy");
+
+    fake_connection conn;
+    conn.queued = 5000;
+    BOOST_CHECK(!shedder.try_shed(conn, 2));
+    BOOST_CHECK(shedder.try_shed(conn, 3));
+    BOOST_CHECK_EQUAL("busy", conn.sent);
+
+    conn.queued = 1000;
+    BOOST_CHECK(!shedder.try_shed(conn, 3));
+    BOOST_CHECK_EQUAL(1u, shedder.shed_count());
+}
+
+BOOST_AUTO_TEST_CASE(measures_the_loop_lag)
+{
+    using namespace std::chrono;
+
+    protoserv::load_shedder shedder;
+    shedder.configure(milliseconds(5), 0);
+
+    auto start = protoserv::load_shedder::clock_type::now();
+    shedder.tick(start + milliseconds(12), start + milliseconds(10));
+    BOOST_CHECK(shedder.loop_lag() == milliseconds(2));
+    BOOST_CHECK(!shedder.overloaded(0));
+
+    // the lag of the tick before does not add up
+    shedder.tick(start + milliseconds(28), start + milliseconds(20));
+    BOOST_CHECK(shedder.loop_lag() == milliseconds(8));
+    BOOST_CHECK(shedder.overloaded(0));
+
+    // a timer running early is no lag
+    shedder.tick(start + milliseconds(29), start + milliseconds(30));
+    BOOST_CHECK(shedder.loop_lag() == milliseconds(0));
+}
+
+BOOST_AUTO_TEST_CASE(answers_busy_while_lagging)
+{
+    ShedServer server;
+    server.load_shedding().configure(std::chrono::milliseconds(1), 0);
+
+    Client client(server);
+    client.connect();
+
+    test::Type1Message request;
+    request.set_data(7);
+    client.send(request);
+    BOOST_CHECK_EQUAL(7, client.wait_message<test::Type2Message>().data());
+
+    server.load_shedding().record_lag(std::chrono::milliseconds(50));
+    client.send(request);
+    BOOST_CHECK_EQUAL(-1, client.wait_message<test::Type2Message>().data());
+
+    client.send(test::Type3Message());
+    BOOST_CHECK_EQUAL(0, server.served);
+    BOOST_CHECK_EQUAL(0u, client.pending());
+
+    // the unmarked types are served regardless
+    test::SimpleClientMessage ping;
+    ping.set_timestamp(3);
+    client.send(ping);
+    BOOST_CHECK_EQUAL(3, client.wait_message<test::SimpleClientMessage>().timestamp());
+    BOOST_CHECK_EQUAL(2u, server.load_shedding().shed_count());
+
+    server.load_shedding().record_lag(std::chrono::milliseconds(0));
+    client.send(test::Type3Message());
+    BOOST_CHECK_EQUAL(1, server.served);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,129 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include "module.hpp"
+#include "loopback_client.hpp"
+
+#include "protobuf_messages/messages.pb.h"
+
+namespace test = tests;
+
+using TestProto = meta::proto<test::SimpleClientMessage, test::Type1Message>;
+
+namespace
+{
+class LoopbackServer : public module_base<LoopbackServer, TestProto>
+{
+public:
+    void onConnected(ClientConnection& conn)
+    {
+        ++connected;
+
+        // greet the client right away
+        test::Type1Message hello;
+        hello.set_data(42);
+        send_message(conn, hello);
+    }
+
+    void onDisconnected(ClientConnection&)
+    {
+        ++disconnected;
+    }
+
+    void onMessage(ClientConnection& conn, test::SimpleClientMessage& msg)
+    {
+        if (msg.payload() == "bye")
+        {
+            conn.close();
+            return;
+        }
+
+        test::SimpleClientMessage reply;
+        reply.set_timestamp(msg.timestamp() + 1);
+        reply.set_payload(msg.payload());
+        send_message(conn, reply);
+    }
+
+    int connected = 0;
+    int disconnected = 0;
+};
+
+using Client = protoserv::loopback_client<LoopbackServer>;
+} // namespace anonymous
+
+BOOST_AUTO_TEST_SUITE(loopback_test)
+
+BOOST_AUTO_TEST_CASE(replies_before_send_returns)
+{
+    LoopbackServer server;
+    Client client(server);
+    client.connect();
+
+    BOOST_CHECK_EQUAL(1, server.connected);
+    BOOST_CHECK_EQUAL(42, client.wait_message<test::Type1Message>().data());
+
+    test::SimpleClientMessage msg;
+    msg.set_timestamp(100);
+    msg.set_payload("hello");
+    client.send(msg);
+
+    BOOST_REQUIRE_EQUAL(1u, client.pending());
+    test::SimpleClientMessage reply;
+    BOOST_REQUIRE(client.try_receive(reply));
+    BOOST_CHECK_EQUAL(101, reply.timestamp());
+    BOOST_CHECK_EQUAL("hello", reply.payload());
+}
+
+BOOST_AUTO_TEST_CASE(keeps_order_across_buffer_growth)
+{
+    LoopbackServer server;
+    Client client(server);
+    client.connect();
+
+    // outgrow the initial read buffer of both sessions
+    test::SimpleClientMessage msg;
+    msg.set_payload(std::string(20000, 'x'));
+    for (int i = 0; i < 100; ++i)
+    {
+        msg.set_timestamp(i);
+        client.send(msg);
+    }
+
+    for (int i = 0; i < 100; ++i)
+    {
+        test::SimpleClientMessage reply;
+        BOOST_REQUIRE(client.try_receive(reply));
+        BOOST_CHECK_EQUAL(i + 1, reply.timestamp());
+        BOOST_CHECK_EQUAL(msg.payload().size(), reply.payload().size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(disconnects_both_ways)
+{
+    LoopbackServer server;
+    {
+        Client client(server);
+        client.connect();
+        BOOST_CHECK(client.connected());
+    }
+    BOOST_CHECK_EQUAL(1, server.disconnected);
+
+    Client client(server);
+    client.connect();
+
+    test::SimpleClientMessage bye;
+    bye.set_payload("bye");
+    client.send(bye);
+
+    BOOST_CHECK(!client.connected());
+    BOOST_CHECK_EQUAL(2, server.disconnected);
+
+    size_t sessions = 0;
+    server.foreach_connection([&sessions](auto)
+    {
+        ++sessions;
+    });
+    BOOST_CHECK_EQUAL(0u, sessions);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
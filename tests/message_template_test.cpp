@@ -0,0 +1,114 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include "module.hpp"
+#include "loopback_client.hpp"
+#include "message_template.hpp"
+
+#include "protobuf_messages/messages.pb.h"
+
+#include <stdexcept>
+
+namespace test = tests;
+
+// Type1Message asks for the quotes, Type5Message is a quote
+using QuoteProto = meta::proto<test::Type1Message, test::Type4Message, test::Type5Message>;
+
+namespace
+{
+// @brief Sends the asked number of quotes from a template
+class QuoteServer : public module_base<QuoteServer, QuoteProto>
+{
+public:
+    QuoteServer()
+        : quote_(make_template(prototype(), { 1 }))
+    {
+    }
+
+    void onMessage(ClientConnection& conn, test::Type1Message& msg)
+    {
+        for (int i = 0; i < msg.data(); ++i)
+        {
+            quote_.set(0, 100.0 + i).send(conn);
+        }
+    }
+
+    void onMessage(ClientConnection&, test::Type4Message&) {}
+    void onMessage(ClientConnection&, test::Type5Message&) {}
+
+private:
+    static test::Type5Message prototype()
+    {
+        test::Type5Message msg;
+        msg.set_data(0);
+        return msg;
+    }
+
+    protoserv::message_template quote_;
+};
+
+using Client = protoserv::loopback_client<QuoteServer>;
+
+template <typename T>
+T parse_frame(const std::string& frame)
+{
+    T msg;
+    BOOST_REQUIRE(msg.ParseFromArray(frame.data() + 4, static_cast<int>(frame.size() - 4)));
+    return msg;
+}
+} // namespace anonymous
+
+BOOST_AUTO_TEST_SUITE(message_template_test)
+
+BOOST_AUTO_TEST_CASE(patches_fixed_width_fields)
+{
+    test::Type4Message f;
+    f.set_data(1.0f);
+    protoserv::message_template floats(4, f, { 1 });
+
+    floats.set(0, 2.5f);
+    BOOST_CHECK_EQUAL(4, reinterpret_cast<const uint16_t*>(floats.frame().data())[1]);
+    BOOST_CHECK_EQUAL(2.5f, parse_frame<test::Type4Message>(floats.frame()).data());
+
+    test::Type5Message d;
+    d.set_data(1.0);
+    protoserv::message_template doubles(5, d, { 1 });
+
+    doubles.set(0, -7.25);
+    BOOST_CHECK_EQUAL(-7.25, parse_frame<test::Type5Message>(doubles.frame()).data());
+    BOOST_CHECK_EQUAL(d.ByteSize() + 4u, doubles.frame().size());
+}
+
+BOOST_AUTO_TEST_CASE(refuses_what_it_cannot_patch)
+{
+    test::Type1Message varint;
+    varint.set_data(1);
+    BOOST_CHECK_THROW(protoserv::message_template(1, varint, { 1 }), std::invalid_argument);
+
+    test::Type5Message unset;
+    BOOST_CHECK_THROW(protoserv::message_template(5, unset, { 1 }), std::invalid_argument);
+
+    test::Type5Message d;
+    d.set_data(1.0);
+    protoserv::message_template doubles(5, d, { 1 });
+    BOOST_CHECK_THROW(doubles.set(0, 1.0f), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(sends_patched_copies)
+{
+    QuoteServer server;
+    Client client(server);
+    client.connect();
+
+    test::Type1Message ask;
+    ask.set_data(3);
+    client.send(ask);
+
+    BOOST_REQUIRE_EQUAL(3u, client.pending());
+    for (int i = 0; i < 3; ++i)
+    {
+        BOOST_CHECK_EQUAL(100.0 + i, client.wait_message<test::Type5Message>().data());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,9 +1,11 @@
 #include <boost/test/unit_test.hpp>
 #include <boost/test/unit_test_suite.hpp>
+#include <boost/mpl/list.hpp>
 
 #include "module.hpp"
 #include "runner.hpp"
 #include "async_client.hpp"
+#include "loopback_client.hpp"
 
 #include "protobuf_messages/messages.pb.h"
 
@@ -547,3 +549,98 @@ BOOST_AUTO_TEST_CASE(concurrent_clients_correctness_test)
 }
 
 BOOST_AUTO_TEST_SUITE_END()
+
+namespace
+{
+template <typename Policy>
+class PolicyEchoServer
+    : public module_policy<PolicyEchoServer<Policy>, Policy, test::SimpleClientMessage>
+{
+public:
+    using ClientConnection = typename PolicyEchoServer::ClientConnection;
+
+    void onMessage(ClientConnection& conn, test::SimpleClientMessage& msg)
+    {
+        this->send_message(conn, msg);
+    }
+};
+
+using bench_policies = boost::mpl::list <
+                       protoserv::default_session_policy,
+                       protoserv::small_message_policy,
+                       protoserv::large_message_policy
+                       >;
+} // namespace anonymous
+
+BOOST_FIXTURE_TEST_SUITE(policy_bench, module_bench_fixture, *boost::unit_test::disabled())
+
+BOOST_AUTO_TEST_CASE_TEMPLATE(session_policy_matrix, Policy, bench_policies)
+{
+    Runner<PolicyEchoServer<Policy>> server;
+    server.run_in_background(get_server_port());
+    server.wait_until_server_ready();
+
+    for (auto payload_size : { 16, 1024, 32 * 1024 })
+    {
+        Client client;
+        client.connect(get_server_port());
+
+        test::SimpleClientMessage message;
+        message.set_payload(std::string(payload_size, 'x'));
+
+        std::cout << "Policy read buffer " << Policy::read_buffer_size
+                  << " bytes, payload " << payload_size << " bytes" << std::endl;
+
+        auto server_messages = 0;
+        auto left_to_send = BENCH_MESSAGES;
+
+        Bandwidth band;
+        while (server_messages < BENCH_MESSAGES)
+        {
+            if (left_to_send > 0)
+            {
+                --left_to_send;
+                client.send(message);
+            }
+
+            if (client.try_receive(message))
+            {
+                band.iterate();
+                ++server_messages;
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(loopback_bench, *boost::unit_test::disabled())
+
+// the framework overhead alone: framing, parsing and dispatch, no kernel involved
+BOOST_AUTO_TEST_CASE_TEMPLATE(loopback_echo, Policy, bench_policies)
+{
+    PolicyEchoServer<Policy> server;
+    protoserv::loopback_client<PolicyEchoServer<Policy>> client(server);
+    client.connect();
+
+    for (auto payload_size : { 16, 1024, 32 * 1024 })
+    {
+        test::SimpleClientMessage message;
+        message.set_payload(std::string(payload_size, 'x'));
+
+        std::cout << "Loopback, policy read buffer " << Policy::read_buffer_size
+                  << " bytes, payload " << payload_size << " bytes" << std::endl;
+
+        Bandwidth band;
+        for (auto i = 0; i < BENCH_MESSAGES; ++i)
+        {
+            client.send(message);
+            if (client.try_receive(message))
+            {
+                band.iterate();
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -506,4 +506,92 @@ BOOST_AUTO_TEST_CASE(implicitly_forwards_return_value_to_client_alternative_synt
     BOOST_CHECK_EQUAL(TEST_TIMESTAMP, message.timestamp());
 }
 
+BOOST_AUTO_TEST_CASE(passes_same_type_messages_in_batches_preserving_order)
+{
+    struct Server : public module_base<Server, TestProto>
+    {
+        void onMessages(ClientConnection& conn, protoserv::span<const test::SimpleClientMessage> msgs)
+        {
+            ++batches;
+            largest_batch = std::max<size_t>(largest_batch, msgs.size());
+            for (auto& msg : msgs)
+            {
+                send_message(conn, msg);
+            }
+        }
+
+        void onMessage(ClientConnection& conn, test::Type1Message& msg)
+        {
+            test::SimpleClientMessage reply;
+            reply.set_timestamp(-msg.data());
+            send_message(conn, reply);
+        }
+
+        std::atomic<int> batches{ 0 };
+        std::atomic<size_t> largest_batch{ 0 };
+    };
+
+    Runner<Server> server;
+    server.run_in_background(get_server_port());
+    client_connect();
+
+    // sent before the client loop runs, the messages after the first one go out in a single write
+    test::SimpleClientMessage simple;
+    test::Type1Message type1;
+    for (int i = 1; i <= 10; ++i)
+    {
+        simple.set_timestamp(i);
+        server->send_message(client, simple);
+
+        if (i == 5)
+        {
+            type1.set_data(100);
+            server->send_message(client, type1);
+        }
+    }
+
+    const int expected[] = { 1, 2, 3, 4, 5, -100, 6, 7, 8, 9, 10 };
+    for (auto timestamp : expected)
+    {
+        auto message = client.wait_message<test::SimpleClientMessage>();
+        BOOST_CHECK_EQUAL(timestamp, message.timestamp());
+    }
+
+    // the type 1 message splits the batch it arrives in
+    BOOST_CHECK_GT(server->largest_batch.load(), 1u);
+    BOOST_CHECK_LT(server->batches.load(), 10);
+
+    client.disconnect();
+}
+
+BOOST_AUTO_TEST_CASE(provides_scratch_memory_to_handlers)
+{
+    struct Server : public module_base<Server, test::SimpleClientMessage>
+    {
+        void onMessage(ClientConnection& conn, test::SimpleClientMessage& msg)
+        {
+            std::pmr::string payload(msg.payload().begin(), msg.payload().end(), scratch_memory());
+            payload += payload;
+
+            test::SimpleClientMessage reply;
+            reply.set_payload(payload.data(), payload.size());
+            send_message(conn, reply);
+        }
+    };
+
+    Runner<Server> server;
+    server.run_in_background(get_server_port());
+    client_connect();
+
+    testMessage.set_payload(std::string(100, 'x'));
+    for (int i = 0; i < 3; ++i)
+    {
+        client_send_test_message();
+        auto message = client.wait_message<test::SimpleClientMessage>();
+        BOOST_CHECK_EQUAL(std::string(200, 'x'), message.payload());
+    }
+
+    client.disconnect();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -243,5 +243,96 @@ BOOST_AUTO_TEST_CASE(resumes_timer)
     BOOST_CHECK_GT(server->timer_called.load(), 1);
 }
 
+BOOST_AUTO_TEST_CASE(keeps_ticks_on_absolute_deadlines)
+{
+    using namespace std::chrono_literals;
+    protoserv::tick_schedule schedule;
+    auto t0 = protoserv::tick_schedule::clock_type::now();
+    schedule.start(1ms, t0);
+    schedule.set_slack(100us);
+
+    // the handler time does not move the deadlines
+    BOOST_CHECK(schedule.advance(t0 + 1ms + 50us) == t0 + 2ms);
+    BOOST_CHECK(schedule.advance(t0 + 2ms + 300us) == t0 + 3ms);
+    BOOST_CHECK_EQUAL(2u, schedule.ticks());
+    BOOST_CHECK_EQUAL(1u, schedule.late());
+
+    // three and a half periods behind, the ticks due meanwhile are skipped
+    BOOST_CHECK(schedule.advance(t0 + 6ms + 500us) == t0 + 7ms);
+    BOOST_CHECK_EQUAL(3u, schedule.missed());
+
+    // caught up, all of them run
+    schedule.set_policy(protoserv::tick_policy::catch_up);
+    BOOST_CHECK(schedule.advance(t0 + 9ms + 500us) == t0 + 8ms);
+    BOOST_CHECK(schedule.advance(t0 + 9ms + 500us) == t0 + 9ms);
+    BOOST_CHECK(schedule.advance(t0 + 9ms + 500us) == t0 + 10ms);
+    BOOST_CHECK_EQUAL(3u, schedule.missed());
+    BOOST_CHECK_EQUAL(5u, schedule.late());
+}
+
+BOOST_AUTO_TEST_CASE(timer_does_not_drift)
+{
+    using namespace std::chrono_literals;
+    boost::asio::io_service svc;
+    auto timer = std::make_shared<Timer>(svc);
+
+    int ticks = 0;
+    bool early = false;
+    auto start = std::chrono::steady_clock::now();
+    timer->start(2ms, [&ticks, &early, &timer]()
+    {
+        // advanced already, the deadline of this tick is a period before the next one
+        auto& schedule = timer->schedule();
+        early = early || std::chrono::steady_clock::now() < schedule.next() - schedule.period();
+
+        // the handler takes a quarter of the period
+        std::this_thread::sleep_for(500us);
+        if (++ticks == 25)
+        {
+            timer->stop();
+        }
+    });
+    auto first = timer->schedule().next();
+    svc.run();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // re-armed after the handler, the deadlines would move by its time, 12.5 ms over 25 ticks;
+    // the skipped ones, if the machine is busy, keep the deadlines on the period grid
+    const auto& schedule = timer->schedule();
+    BOOST_CHECK_EQUAL(25, ticks);
+    BOOST_CHECK(!early);
+    BOOST_CHECK(schedule.next() == first + static_cast<int64_t>(25 + schedule.missed()) * schedule.period());
+    BOOST_CHECK(elapsed >= 50ms);
+}
+
+BOOST_AUTO_TEST_CASE(timerfd_counts_missed_ticks)
+{
+    using namespace std::chrono_literals;
+    boost::asio::io_service svc;
+    auto timer = std::make_shared<Timer>(svc);
+    if (!timer->enable_timerfd())
+    {
+        return;
+    }
+
+    int ticks = 0;
+    timer->start(1ms, [&ticks, &timer]()
+    {
+        if (++ticks == 2)
+        {
+            // the loop stalls for five periods
+            std::this_thread::sleep_for(5500us);
+        }
+        if (ticks == 4)
+        {
+            timer->stop();
+        }
+    });
+    svc.run();
+
+    BOOST_CHECK_EQUAL(4, ticks);
+    BOOST_CHECK_GE(timer->schedule().missed(), 4u);
+    BOOST_CHECK_GE(timer->schedule().late(), 1u);
+}
 
 BOOST_AUTO_TEST_SUITE_END()
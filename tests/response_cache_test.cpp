@@ -0,0 +1,171 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include "module.hpp"
+#include "loopback_client.hpp"
+#include "response_cache.hpp"
+
+#include "protobuf_messages/messages.pb.h"
+
+#include <chrono>
+#include <string>
+
+namespace test = tests;
+
+// Type1Message is an idempotent lookup answered with Type2Message, SimpleClientMessage is not cached
+using LookupProto = meta::proto<test::SimpleClientMessage, test::Type1Message, test::Type2Message>;
+
+namespace
+{
+class LookupServer : public module_base<LookupServer, LookupProto>
+{
+public:
+    LookupServer()
+    {
+        cache_responses<test::Type1Message>(std::chrono::seconds(10));
+    }
+
+    void onMessage(ClientConnection& conn, test::Type1Message& msg)
+    {
+        ++looked_up;
+        test::Type2Message reply;
+        reply.set_data(msg.data() * 2 + version);
+        send_message(conn, reply);
+    }
+
+    void onMessage(ClientConnection& conn, test::SimpleClientMessage& msg)
+    {
+        ++echoed;
+        send_message(conn, msg);
+    }
+
+    void onMessage(ClientConnection&, test::Type2Message&) {}
+
+    int looked_up = 0;
+    int echoed = 0;
+    int version = 0;
+};
+
+using Client = protoserv::loopback_client<LookupServer>;
+using clock_type = protoserv::response_cache::clock_type;
+
+// @brief Builds a frame of the given type and payload
+std::string frame(uint16_t type, const std::string& payload)
+{
+    std::string ret(4, '\0');
+    auto header = reinterpret_cast<uint16_t*>(&ret[0]);
+    header[0] = static_cast<uint16_t>(4 + payload.size());
+    header[1] = type;
+    return ret + payload;
+}
+
+test::Type1Message lookup(int data)
+{
+    test::Type1Message msg;
+    msg.set_data(data);
+    return msg;
+}
+} // namespace anonymous
+
+BOOST_AUTO_TEST_SUITE(response_cache_test)
+
+BOOST_AUTO_TEST_CASE(keeps_replies_until_they_expire)
+{
+    protoserv::response_cache cache;
+    cache.enable(1, std::chrono::seconds(1));
+    auto now = clock_type::now();
+
+    std::string request = "abcdefghijk";
+    BOOST_CHECK(!cache.find(1, request.data(), request.size(), now));
+    BOOST_CHECK(cache.store(1, request.data(), request.size(), frame(2, "reply"), now));
+
+    auto found = cache.find(1, request.data(), request.size(), now + std::chrono::milliseconds(999));
+    BOOST_REQUIRE(found);
+    BOOST_CHECK(*found == frame(2, "reply"));
+    BOOST_CHECK(!cache.find(1, request.data(), request.size(), now + std::chrono::seconds(1)));
+
+    // same bytes, other type
+    BOOST_CHECK(!cache.find(3, request.data(), request.size(), now));
+    BOOST_CHECK_EQUAL(1u, cache.hits());
+    BOOST_CHECK_EQUAL(3u, cache.misses());
+}
+
+BOOST_AUTO_TEST_CASE(keeps_single_frames_of_enabled_types_only)
+{
+    protoserv::response_cache cache;
+    cache.enable(1, std::chrono::seconds(1));
+    auto now = clock_type::now();
+
+    BOOST_CHECK(!cache.store(2, "a", 1, frame(2, "reply"), now));
+    BOOST_CHECK(!cache.store(1, "a", 1, std::string(), now));
+    BOOST_CHECK(!cache.store(1, "a", 1, frame(2, "one") + frame(2, "two"), now));
+    BOOST_CHECK(!cache.find(1, "a", 1, now));
+}
+
+BOOST_AUTO_TEST_CASE(stays_bounded)
+{
+    protoserv::response_cache cache(16);
+    cache.enable(1, std::chrono::seconds(1));
+    auto now = clock_type::now();
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        auto request = std::to_string(i);
+        cache.store(1, request.data(), request.size(), frame(2, request), now + std::chrono::milliseconds(i));
+    }
+
+    int kept = 0;
+    for (int i = 0; i < 1000; ++i)
+    {
+        auto request = std::to_string(i);
+        auto found = cache.find(1, request.data(), request.size(), now);
+        if (found)
+        {
+            BOOST_CHECK(*found == frame(2, request));
+            ++kept;
+        }
+    }
+    BOOST_CHECK(kept > 0);
+    BOOST_CHECK(kept <= 16);
+}
+
+BOOST_AUTO_TEST_CASE(answers_repeated_lookups_from_the_cache)
+{
+    LookupServer server;
+    Client client(server);
+    client.connect();
+
+    client.send(lookup(5));
+    BOOST_CHECK_EQUAL(10, client.wait_message<test::Type2Message>().data());
+    client.send(lookup(5));
+    BOOST_CHECK_EQUAL(10, client.wait_message<test::Type2Message>().data());
+    BOOST_CHECK_EQUAL(1, server.looked_up);
+
+    client.send(lookup(6));
+    BOOST_CHECK_EQUAL(12, client.wait_message<test::Type2Message>().data());
+    BOOST_CHECK_EQUAL(2, server.looked_up);
+    BOOST_CHECK_EQUAL(1u, server.response_cache().hits());
+
+    // the answer changes, the module says so
+    server.version = 1;
+    server.invalidate_response(lookup(5));
+    client.send(lookup(5));
+    BOOST_CHECK_EQUAL(11, client.wait_message<test::Type2Message>().data());
+    client.send(lookup(6));
+    BOOST_CHECK_EQUAL(12, client.wait_message<test::Type2Message>().data());
+
+    server.invalidate_responses<test::Type1Message>();
+    client.send(lookup(6));
+    BOOST_CHECK_EQUAL(13, client.wait_message<test::Type2Message>().data());
+    BOOST_CHECK_EQUAL(4, server.looked_up);
+
+    // the other types are always handled
+    test::SimpleClientMessage ping;
+    client.send(ping);
+    client.send(ping);
+    client.wait_message<test::SimpleClientMessage>();
+    client.wait_message<test::SimpleClientMessage>();
+    BOOST_CHECK_EQUAL(2, server.echoed);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,320 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include "module.hpp"
+#include "runner.hpp"
+#include "async_client.hpp"
+#include "latency_stats.hpp"
+
+#include "protobuf_messages/messages.pb.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+namespace test = tests;
+
+template <typename T>
+using Runner = test::Runner<T>;
+
+// Type1Message triggers a broadcast, Type2Message an idle sweep
+using ScaleProto = meta::proto<test::SimpleClientMessage, test::Type1Message, test::Type2Message>;
+using Client = protoserv::async_client<ScaleProto>;
+
+#ifdef _DEBUG
+const size_t SCALE_SESSIONS = 2000;
+#else
+const size_t SCALE_SESSIONS = 100000;
+#endif
+
+// a loopback source address keeps up to this many sessions, well below the ephemeral port range
+const size_t SESSIONS_PER_ADDRESS = 16000;
+
+// connects in flight, roughly the listen backlog
+const size_t CONNECTS_IN_FLIGHT = 1024;
+
+// every measurement is repeated, the first round tends to be an outlier
+const int ROUNDS = 3;
+
+namespace
+{
+class ScaleServer : public module_base<ScaleServer, ScaleProto>
+{
+public:
+    void onConnected(ClientConnection&)
+    {
+        ++sessions;
+    }
+
+    void onDisconnected(ClientConnection&)
+    {
+        --sessions;
+    }
+
+    // @brief Sends a message to every session but the one asking for it
+    void onMessage(ClientConnection& conn, test::Type1Message& msg)
+    {
+        test::SimpleClientMessage note;
+        note.set_timestamp(msg.data());
+
+        foreach_connection([this, &conn, &note](auto session)
+        {
+            if (session != &conn)
+            {
+                send_message(*session, note);
+            }
+        });
+        send_message(conn, msg);
+    }
+
+    // @brief Measures a pass of the inactivity check over all sessions, nothing is closed
+    void onMessage(ClientConnection& conn, test::Type2Message&)
+    {
+        auto started = std::chrono::steady_clock::now();
+        foreach_connection([](auto session)
+        {
+            session->disconnect_inactive(std::chrono::hours(24));
+        });
+        auto took = std::chrono::steady_clock::now() - started;
+
+        test::Type2Message reply;
+        reply.set_data(std::chrono::duration_cast<std::chrono::nanoseconds>(took).count());
+        send_message(conn, reply);
+    }
+
+    std::atomic<size_t> sessions{ 0 };
+};
+
+// @brief Raises the soft open files limit up to the hard one, returns the limit in effect
+size_t raise_open_files_limit()
+{
+    rlimit rl{};
+    ::getrlimit(RLIMIT_NOFILE, &rl);
+    rl.rlim_cur = rl.rlim_max;
+    ::setrlimit(RLIMIT_NOFILE, &rl);
+    ::getrlimit(RLIMIT_NOFILE, &rl);
+    return rl.rlim_cur;
+}
+
+// @brief Returns the resident set size of the process
+size_t resident_bytes()
+{
+    size_t total = 0;
+    size_t resident = 0;
+    std::ifstream statm("/proc/self/statm");
+    statm >> total >> resident;
+    return resident * ::sysconf(_SC_PAGESIZE);
+}
+
+// @brief The number of sessions, PROTOSERV_SCALE_SESSIONS overrides the default
+size_t scale_sessions()
+{
+    auto env = std::getenv("PROTOSERV_SCALE_SESSIONS");
+    return env ? boost::lexical_cast<size_t>(env) : SCALE_SESSIONS;
+}
+
+double elapsed_ms(std::chrono::steady_clock::time_point since)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+/*
+@description
+Lots of mostly idle raw connections, all driven by a single io_service.
+Every 16k sessions take their own source address out of 127.0.0.0/8,
+so that the ephemeral ports of a single address do not run out.
+*/
+class IdleSessions
+{
+public:
+    using tcp = boost::asio::ip::tcp;
+    using error_code = boost::system::error_code;
+
+    explicit IdleSessions(uint16_t port)
+        : server_(boost::asio::ip::address_v4::loopback(), port)
+    {
+    }
+
+    // @brief Opens the given number of connections, returns the number of failures
+    size_t connect(size_t count)
+    {
+        sockets_.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            sockets_.emplace_back(service_);
+        }
+        buffers_.resize(count);
+
+        next_ = 0;
+        for (size_t i = 0; i < std::min(count, CONNECTS_IN_FLIGHT); ++i)
+        {
+            start_connect(next_++);
+        }
+
+        service_.reset();
+        service_.run();
+        return failed_;
+    }
+
+    // @brief Waits until every session receives something, records the delivery latency
+    void receive_all(std::chrono::steady_clock::time_point since, protoserv::latency_histogram& latency)
+    {
+        for (size_t i = 0; i < sockets_.size(); ++i)
+        {
+            if (!sockets_[i].is_open())
+            {
+                continue;
+            }
+
+            sockets_[i].async_read_some(boost::asio::buffer(buffers_[i]),
+                                        [since, &latency](error_code err, size_t)
+            {
+                if (!err)
+                {
+                    auto took = std::chrono::steady_clock::now() - since;
+                    latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(took).count());
+                }
+            });
+        }
+
+        service_.reset();
+        service_.run();
+    }
+
+    size_t size() const
+    {
+        return sockets_.size() - failed_;
+    }
+
+private:
+    // @brief Source address of the i-th session: 127.1.0.1, 127.1.0.2 etc.
+    static boost::asio::ip::address_v4 source_address(size_t i)
+    {
+        return boost::asio::ip::address_v4(0x7f010001 + static_cast<uint32_t>(i / SESSIONS_PER_ADDRESS));
+    }
+
+    void start_connect(size_t i)
+    {
+        auto& socket = sockets_[i];
+        socket.open(tcp::v4());
+        socket.set_option(boost::asio::socket_base::linger(true, 0));
+
+#ifdef IP_BIND_ADDRESS_NO_PORT
+        // the port is picked at connect time, unique per 4-tuple rather than per address
+        int on = 1;
+        ::setsockopt(socket.native_handle(), IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &on, sizeof(on));
+#endif
+        socket.bind(tcp::endpoint(source_address(i), 0));
+
+        socket.async_connect(server_, [this, i](error_code err)
+        {
+            if (err)
+            {
+                ++failed_;
+                error_code ec;
+                sockets_[i].close(ec);
+            }
+            if (next_ < sockets_.size())
+            {
+                start_connect(next_++);
+            }
+        });
+    }
+
+    boost::asio::io_service service_;
+    tcp::endpoint server_;
+    std::vector<tcp::socket> sockets_;
+    std::vector<std::array<uint8_t, 64>> buffers_;
+    size_t next_ = 0;
+    size_t failed_ = 0;
+};
+} // namespace anonymous
+
+/*
+@description
+Sizing benchmark: hundreds of thousands of idle sessions on a single server.
+Reports the accept rate, the memory per session, the cost of an idle sweep
+and the latency of a broadcast to every session. Both ends live in this process,
+so the open files limit must allow two descriptors per session.
+*/
+BOOST_AUTO_TEST_SUITE(scale_bench, *boost::unit_test::disabled())
+
+BOOST_AUTO_TEST_CASE(idle_sessions_scale)
+{
+    auto id = boost::unit_test::framework::current_test_case().p_id;
+    uint16_t port = 6201 + (id % 100);
+
+    auto limit = raise_open_files_limit();
+    auto count = scale_sessions();
+    if (2 * count + 64 > limit)
+    {
+        count = limit > 64 ? (limit - 64) / 2 : 0;
+        std::cout << "Scale: open files limit is " << limit << ", sessions cut down to " << count << std::endl;
+    }
+    BOOST_REQUIRE(count > 0);
+
+    Runner<ScaleServer> server;
+    server.run_in_background(port);
+
+    Client control;
+    control.wait_connect(port);
+
+    auto rss_before = resident_bytes();
+
+    IdleSessions idle(port);
+    auto started = std::chrono::steady_clock::now();
+    auto failed = idle.connect(count);
+    // a session the server never accepts must not hang the bench, a minute is plenty for a million
+    auto give_up = started + std::chrono::seconds(60);
+    while (server->sessions < idle.size() + 1 && std::chrono::steady_clock::now() < give_up)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    BOOST_REQUIRE_MESSAGE(server->sessions >= idle.size() + 1,
+                          "only " << server->sessions << " of " << idle.size() + 1 << " sessions accepted");
+    auto accept_ms = elapsed_ms(started);
+
+    std::cout << "Scale: " << idle.size() << " sessions (" << failed << " failed to connect)" << std::endl;
+    std::cout << "Scale: accepted in " << accept_ms << " ms, "
+              << static_cast<size_t>(idle.size() / accept_ms * 1000) << " sessions/sec" << std::endl;
+    std::cout << "Scale: " << (resident_bytes() - rss_before) / std::max<size_t>(idle.size(), 1)
+              << " bytes resident per session, both ends" << std::endl;
+
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        control.send(test::Type2Message());
+        auto sweep = control.wait_message<test::Type2Message>();
+        std::cout << "Scale: idle sweep " << sweep.data() / 1000 << " us, "
+                  << sweep.data() / std::max<size_t>(idle.size(), 1) << " ns per session" << std::endl;
+    }
+
+    for (int round = 0; round < ROUNDS; ++round)
+    {
+        protoserv::latency_histogram latency;
+
+        test::Type1Message trigger;
+        trigger.set_data(round);
+        auto sent = std::chrono::steady_clock::now();
+        control.send(trigger);
+        idle.receive_all(sent, latency);
+        control.wait_message<test::Type1Message>();
+
+        BOOST_CHECK_EQUAL(idle.size(), latency.count());
+        std::cout << "Scale: broadcast to " << latency.count() << " sessions, p50 "
+                  << latency.percentile(50) / 1000 << " us, p99 "
+                  << latency.percentile(99) / 1000 << " us, last "
+                  << latency.max() / 1000 << " us" << std::endl;
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,80 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include <memory_resource>
+#include <vector>
+#include <string>
+
+#include "scratch_arena.hpp"
+
+using protoserv::scratch_arena;
+
+BOOST_AUTO_TEST_SUITE(scratch_arena_test)
+
+BOOST_AUTO_TEST_CASE(allocates_aligned_memory)
+{
+    scratch_arena arena(1024);
+
+    auto p1 = arena.allocate(1, 1);
+    auto p2 = arena.allocate(8, 8);
+    auto p3 = arena.allocate(16, 16);
+
+    BOOST_CHECK(p1 != p2);
+    BOOST_CHECK_EQUAL(0, reinterpret_cast<uintptr_t>(p2) % 8);
+    BOOST_CHECK_EQUAL(0, reinterpret_cast<uintptr_t>(p3) % 16);
+
+    arena.deallocate(p1, 1, 1);
+    arena.deallocate(p2, 8, 8);
+    arena.deallocate(p3, 16, 16);
+}
+
+BOOST_AUTO_TEST_CASE(reuses_memory_after_reset)
+{
+    scratch_arena arena(1024);
+
+    auto p1 = arena.allocate(100, 8);
+    arena.deallocate(p1, 100, 8);
+    arena.reset();
+
+    auto p2 = arena.allocate(100, 8);
+    arena.deallocate(p2, 100, 8);
+    BOOST_CHECK_EQUAL(p1, p2);
+    BOOST_CHECK_EQUAL(0, arena.outlived());
+}
+
+BOOST_AUTO_TEST_CASE(merges_chunks_to_high_water_mark)
+{
+    scratch_arena arena(1024);
+    {
+        std::pmr::vector<int> v(&arena);
+        for (int i = 0; i < 1000; ++i)
+        {
+            v.push_back(i);
+        }
+    }
+    BOOST_CHECK(arena.capacity() > 1024);
+
+    auto capacity = arena.capacity();
+    arena.reset();
+    BOOST_CHECK_EQUAL(capacity, arena.capacity());
+    BOOST_CHECK_EQUAL(0, arena.used());
+}
+
+BOOST_AUTO_TEST_CASE(serves_pmr_containers)
+{
+    scratch_arena arena;
+    std::pmr::string s("a string long enough to defeat small string optimization", &arena);
+    BOOST_CHECK(arena.used() > 0);
+}
+
+#ifndef NDEBUG
+BOOST_AUTO_TEST_CASE(reports_allocation_outliving_reset)
+{
+    scratch_arena arena;
+    arena.allocate(10, 1);
+    arena.reset();
+    BOOST_CHECK_EQUAL(1, arena.outlived());
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
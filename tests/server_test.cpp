@@ -386,5 +386,75 @@ BOOST_AUTO_TEST_CASE(passes_user_data_across_events)
     BOOST_CHECK_EQUAL(123, srv->userData);
 }
 
+BOOST_AUTO_TEST_CASE(collects_latency_breakdown_with_kernel_timestamps)
+{
+    struct Server : public module_base<Server, test::SimpleClientMessage>
+    {
+        auto onMessage(ClientConnection& conn, test::SimpleClientMessage& msg)
+        {
+            rxTime = conn.rx_time();
+            latency().foreach ([this](int, const protoserv::message_latency & t)
+            {
+                dispatched += t.read_to_dispatch.count();
+            });
+            return msg;
+        }
+
+        int64_t rxTime = 0;
+        uint64_t dispatched = 0;
+    };
+
+    protoserv::Options opts;
+    opts["Port"] = "5999";
+    opts["RxTimestamps"] = "1";
+
+    Runner<Server> srv;
+    srv.run_in_background(opts);
+
+    Client client;
+    client.wait_connect(5999);
+    srv->send_message(client, testMessage);
+    client.wait_message<test::SimpleClientMessage>();
+    client.disconnect();
+    srv.join();
+
+    BOOST_CHECK(srv->rxTime > 0);
+    BOOST_CHECK_EQUAL(1, srv->dispatched);
+}
+
+BOOST_AUTO_TEST_CASE(samples_tcp_info_of_live_sessions)
+{
+    struct Server : public module_base<Server, test::SimpleClientMessage>
+    {
+        auto onMessage(ClientConnection& conn, test::SimpleClientMessage& msg)
+        {
+            sampled = conn.tcp_info().sampled_at != std::chrono::steady_clock::time_point();
+            sessions = tcp_info_summary().sessions;
+            return msg;
+        }
+
+        bool sampled = false;
+        size_t sessions = 0;
+    };
+
+    protoserv::Options opts;
+    opts["Port"] = "5999";
+    opts["TcpInfoInterval"] = "1";
+
+    Runner<Server> srv;
+    srv.run_in_background(opts);
+
+    Client client;
+    client.wait_connect(5999);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    srv->send_message(client, testMessage);
+    client.wait_message<test::SimpleClientMessage>();
+    client.disconnect();
+    srv.join();
+
+    BOOST_CHECK(srv->sampled);
+    BOOST_CHECK_EQUAL(1, srv->sessions);
+}
+
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,135 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "session_buffers.hpp"
+
+using protoserv::adaptive_buffer;
+
+namespace
+{
+// @brief Simulates a socket read of the given size
+void read(adaptive_buffer& buf, size_t len)
+{
+    assert(buf.free_capacity() >= len);
+    memset(buf.end(), 'x', len);
+    buf.grow(len);
+}
+} // namespace anonymous
+
+BOOST_AUTO_TEST_SUITE(adaptive_buffer_test)
+
+BOOST_AUTO_TEST_CASE(grows_when_exhausted)
+{
+    adaptive_buffer buf;
+    auto capacity = buf.capacity();
+
+    read(buf, capacity);
+    BOOST_CHECK_EQUAL(0, buf.free_capacity());
+
+    buf.grow_capacity();
+    BOOST_CHECK(buf.capacity() > capacity);
+    BOOST_CHECK_EQUAL(capacity, buf.size());
+}
+
+BOOST_AUTO_TEST_CASE(allocates_exact_size_for_large_frame)
+{
+    adaptive_buffer buf;
+    read(buf, 100);
+
+    buf.expect(10000);
+    BOOST_CHECK(buf.wants_resize());
+
+    buf.grow_capacity();
+    BOOST_CHECK_EQUAL(10000, buf.capacity());
+    BOOST_CHECK_EQUAL(100, buf.size());
+}
+
+BOOST_AUTO_TEST_CASE(shrinks_back_once_large_frame_is_consumed)
+{
+    adaptive_buffer buf;
+    buf.expect(30000);
+    buf.grow_capacity();
+    read(buf, 30000);
+
+    buf.erase(30000);
+    buf.expect(0);
+
+    // a number of small reads makes the estimate decay
+    for (int i = 0; i < 64; ++i)
+    {
+        buf.grow_capacity();
+        read(buf, 10);
+        buf.erase(10);
+    }
+
+    buf.grow_capacity();
+    BOOST_CHECK(buf.capacity() < 30000);
+    BOOST_CHECK(!buf.wants_resize());
+}
+
+BOOST_AUTO_TEST_CASE(keeps_unconsumed_bytes_when_reallocating)
+{
+    adaptive_buffer buf;
+    read(buf, 8);
+    memcpy(buf.begin() + 4, "abcd", 4);
+    buf.erase(4);
+
+    buf.expect(5000);
+    buf.grow_capacity();
+
+    BOOST_CHECK_EQUAL(4, buf.size());
+    BOOST_CHECK_EQUAL(0, memcmp(buf.begin(), "abcd", 4));
+}
+
+BOOST_AUTO_TEST_CASE(releases_memory_when_empty)
+{
+    adaptive_buffer buf;
+    buf.reserve(64 * 1024);
+    BOOST_CHECK(buf.releasable());
+
+    buf.release();
+    BOOST_CHECK_EQUAL(adaptive_buffer::min_capacity, buf.capacity());
+    BOOST_CHECK(!buf.releasable());
+}
+
+BOOST_AUTO_TEST_CASE(does_not_release_buffered_data)
+{
+    adaptive_buffer buf;
+    buf.reserve(64 * 1024);
+    read(buf, 10);
+
+    BOOST_CHECK(!buf.releasable());
+    buf.release();
+    BOOST_CHECK_EQUAL(64 * 1024, buf.capacity());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_AUTO_TEST_SUITE(writebuf_test)
+
+BOOST_AUTO_TEST_CASE(allocates_chunks_of_the_size_set_at_runtime)
+{
+    protoserv::basic_writebuf<16> buf;
+    buf.set_chunk_size(100);
+
+    std::string data(150, 'x');
+    buf.append(data.data(), data.size());
+
+    std::vector<size_t> capacities;
+    std::string written;
+    buf.foreach([&](auto & chunk)
+    {
+        capacities.push_back(chunk.capacity());
+        written.append(reinterpret_cast<const char*>(chunk.begin()), chunk.size());
+    });
+
+    const std::vector<size_t> expected = { 16, 100, 100 };
+    BOOST_CHECK_EQUAL_COLLECTIONS(expected.begin(), expected.end(), capacities.begin(), capacities.end());
+    BOOST_CHECK_EQUAL(data, written);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,321 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include "module.hpp"
+#include "loopback_client.hpp"
+#include "runner.hpp"
+#include "blocking_client.hpp"
+
+#include "protobuf_messages/messages.pb.h"
+
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <string>
+#include <thread>
+
+namespace test = tests;
+
+template <typename T>
+using Runner = test::Runner<T>;
+
+// Type1Message is a request answered with Type2Message, Type3Message asks to move to the other loop,
+// Type6Message asks for the bulk of Type6Message frames
+using MigrateProto = meta::proto<test::Type1Message, test::Type2Message, test::Type3Message, test::Type6Message>;
+
+const uint16_t FIRST_PORT = 6081;
+const uint16_t SECOND_PORT = 6082;
+const uint16_t BUSY_PORT = 6083;
+const uint16_t IDLE_PORT = 6084;
+const uint16_t BLOCKED_PORT = 6085;
+const uint16_t UNBLOCKED_PORT = 6086;
+
+namespace
+{
+// @brief A loop which counts the requests of a session in its user data
+class Loop : public module_base<Loop, MigrateProto>
+{
+public:
+    // @brief Answers with the loop id and the number of requests the session made
+    void onMessage(ClientConnection& conn, test::Type1Message&)
+    {
+        if (!conn.get_user_data_if<int>())
+        {
+            conn.set_user_data(0);
+        }
+        auto& served = conn.get_user_data<int>();
+        ++served;
+
+        auto until = std::chrono::steady_clock::now() + work;
+        while (std::chrono::steady_clock::now() < until)
+        {
+        }
+
+        test::Type2Message reply;
+        reply.set_data(id * 1000 + served);
+        send_message(conn, reply);
+    }
+
+    // @brief Acknowledges, then moves the session over to the peer loop
+    void onMessage(ClientConnection& conn, test::Type3Message&)
+    {
+        test::Type2Message ack;
+        ack.set_data(-id);
+        send_message(conn, ack);
+        moved = migrate(conn, *peer);
+    }
+
+    // @brief Sends more than the socket buffers take, the write stays in progress until the peer reads
+    void onMessage(ClientConnection& conn, test::Type6Message&)
+    {
+        test::Type6Message chunk;
+        chunk.set_data(std::string(bulk_size, 'x'));
+        for (int i = 0; i < bulk_frames; ++i)
+        {
+            send_message(conn, chunk);
+        }
+    }
+
+    void onMessage(ClientConnection&, test::Type2Message&) {}
+
+    static constexpr int bulk_frames = 200;
+    static constexpr size_t bulk_size = 60000;
+
+    void onConnected(ClientConnection&)
+    {
+        ++connected;
+    }
+
+    void onDisconnected(ClientConnection&)
+    {
+        ++disconnected;
+    }
+
+    int id = 0;
+    Loop* peer = nullptr;
+    std::chrono::microseconds work{ 0 };
+
+    std::atomic<int> connected{ 0 };
+    std::atomic<int> disconnected{ 0 };
+    std::atomic<bool> moved{ false };
+};
+
+// @brief Asks for the answers and the moves, see blocking_client
+class raw_peer : public test::blocking_client
+{
+public:
+    using blocking_client::blocking_client;
+    using blocking_client::read;
+
+    void ask()
+    {
+        write(request());
+    }
+
+    // @brief Reads the next Type2Message, returns its data
+    int read()
+    {
+        test::Type2Message msg;
+        read(msg);
+        return msg.data();
+    }
+
+    // @brief Reads the next frame, it must be of type T
+    template <typename T>
+    void read(T& msg)
+    {
+        read(meta::identify<MigrateProto, T>(), msg);
+    }
+
+    static std::string request()
+    {
+        test::Type1Message msg;
+        msg.set_data(123456);
+        return protoserv::encode_packet(meta::identify<MigrateProto, test::Type1Message>(), msg);
+    }
+
+    static std::string move_request()
+    {
+        return protoserv::encode_packet(meta::identify<MigrateProto, test::Type3Message>(), test::Type3Message());
+    }
+
+    static std::string bulk_request()
+    {
+        return protoserv::encode_packet(meta::identify<MigrateProto, test::Type6Message>(), test::Type6Message());
+    }
+};
+
+template <typename Predicate>
+void wait_for(Predicate pred)
+{
+    for (int i = 0; i < 500 && !pred(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+} // namespace anonymous
+
+BOOST_AUTO_TEST_SUITE(session_migration_test)
+
+BOOST_AUTO_TEST_CASE(busiest_loop_moves_the_load)
+{
+    struct fake_loop {};
+    fake_loop first, second, third;
+
+    protoserv::loop_balancer<fake_loop> balancer(0.2, std::chrono::milliseconds(100));
+    balancer.join(first);
+    balancer.join(second);
+    balancer.join(third);
+
+    // the others have reported nothing yet
+    double gap = 0;
+    BOOST_CHECK(balancer.report(0, 0.9, gap) == &second);
+    BOOST_CHECK_CLOSE(0.9, gap, 0.001);
+
+    // not the busiest
+    BOOST_CHECK(!balancer.report(1, 0.5, gap));
+    BOOST_CHECK(!balancer.report(2, 0.8, gap));
+    BOOST_CHECK(!balancer.report(0, 0.6, gap));
+
+    // within the threshold
+    BOOST_CHECK(!balancer.report(2, 0.65, gap));
+
+    BOOST_CHECK(balancer.report(2, 0.8, gap) == &second);
+    BOOST_CHECK_CLOSE(0.3, gap, 0.001);
+    BOOST_CHECK_CLOSE(0.8, balancer.utilisation(2), 0.001);
+}
+
+BOOST_AUTO_TEST_CASE(moves_the_session_with_its_state)
+{
+    Runner<Loop> first;
+    Runner<Loop> second;
+    first->id = 1;
+    first->peer = second.operator->();
+    second->id = 2;
+    second->peer = first.operator->();
+
+    first.run_in_background(FIRST_PORT);
+    second.run_in_background(SECOND_PORT);
+
+    raw_peer peer(FIRST_PORT);
+    peer.ask();
+    BOOST_CHECK_EQUAL(1001, peer.read());
+
+    // the move request along with a part of the next request, it stays in the read buffer
+    auto next = raw_peer::request();
+    peer.write(raw_peer::move_request() + next.substr(0, 5));
+    BOOST_CHECK_EQUAL(-1, peer.read());
+
+    wait_for([&second]()
+    {
+        return second->connected == 1;
+    });
+    BOOST_CHECK(first->moved);
+    BOOST_CHECK_EQUAL(1, first->disconnected);
+
+    // the other loop completes the request, the count goes on
+    peer.write(next.substr(5));
+    BOOST_CHECK_EQUAL(2002, peer.read());
+    peer.ask();
+    BOOST_CHECK_EQUAL(2003, peer.read());
+    BOOST_CHECK_EQUAL(0, second->disconnected);
+}
+
+BOOST_AUTO_TEST_CASE(moves_the_session_blocked_on_write)
+{
+    Runner<Loop> first;
+    Runner<Loop> second;
+    first->id = 1;
+    first->peer = second.operator->();
+    second->id = 2;
+    second->peer = first.operator->();
+
+    first.run_in_background(BLOCKED_PORT);
+    second.run_in_background(UNBLOCKED_PORT);
+
+    raw_peer peer(BLOCKED_PORT);
+    peer.ask();
+    BOOST_CHECK_EQUAL(1001, peer.read());
+
+    // not read for now, the write in progress is cancelled by the move
+    peer.write(raw_peer::bulk_request());
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    peer.write(raw_peer::move_request());
+
+    wait_for([&second]()
+    {
+        return second->connected == 1;
+    });
+    BOOST_CHECK(first->moved);
+    BOOST_CHECK_EQUAL(1, first->disconnected);
+
+    // the other loop writes the rest, nothing lost or repeated
+    for (int i = 0; i < Loop::bulk_frames; ++i)
+    {
+        test::Type6Message chunk;
+        peer.read(chunk);
+        BOOST_REQUIRE_EQUAL(Loop::bulk_size, chunk.data().size());
+    }
+    BOOST_CHECK_EQUAL(-1, peer.read());
+    peer.ask();
+    BOOST_CHECK_EQUAL(2002, peer.read());
+    BOOST_CHECK_EQUAL(0, second->disconnected);
+}
+
+BOOST_AUTO_TEST_CASE(loopback_session_stays)
+{
+    Loop server;
+    Loop other;
+    server.id = 1;
+    server.peer = &other;
+
+    protoserv::loopback_client<Loop> client(server);
+    client.connect();
+    client.send(test::Type3Message());
+    BOOST_CHECK_EQUAL(-1, client.wait_message<test::Type2Message>().data());
+    BOOST_CHECK(!server.moved);
+
+    client.send(test::Type1Message());
+    BOOST_CHECK_EQUAL(1001, client.wait_message<test::Type2Message>().data());
+}
+
+BOOST_AUTO_TEST_CASE(balancer_evens_out_the_loops)
+{
+    protoserv::loop_balancer<Loop::server_type> balancer(0.1, std::chrono::milliseconds(50));
+
+    Runner<Loop> busy;
+    Runner<Loop> idle;
+    busy->id = 1;
+    idle->id = 2;
+    busy->work = idle->work = std::chrono::milliseconds(1);
+    busy->balance(balancer);
+    idle->balance(balancer);
+
+    busy.run_in_background(BUSY_PORT);
+    idle.run_in_background(IDLE_PORT);
+
+    // both on the same loop
+    raw_peer first(BUSY_PORT);
+    raw_peer second(BUSY_PORT);
+
+    std::set<int> loops;
+    for (int i = 0; i < 500 && loops.size() < 2; ++i)
+    {
+        first.ask();
+        second.ask();
+        loops = { first.read() / 1000, second.read() / 1000 };
+    }
+    BOOST_CHECK((loops == std::set<int>{ 1, 2 }));
+
+    // settled, nothing bounces back
+    for (int i = 0; i < 20; ++i)
+    {
+        first.ask();
+        second.ask();
+        loops = { first.read() / 1000, second.read() / 1000 };
+    }
+    BOOST_CHECK((loops == std::set<int>{ 1, 2 }));
+    BOOST_CHECK_EQUAL(1, idle->connected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,200 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include "module.hpp"
+#include "runner.hpp"
+#include "async_client.hpp"
+#include "single_flight.hpp"
+
+#include "protobuf_messages/messages.pb.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace test = tests;
+
+template <typename T>
+using Runner = test::Runner<T>;
+
+// Type1Message asks for the reference data, SimpleClientMessage is the answer
+using RefProto = meta::proto<test::SimpleClientMessage, test::Type1Message>;
+
+const uint16_t UPSTREAM_PORT = 6071;
+const uint16_t FRONTEND_PORT = 6072;
+
+namespace
+{
+// @brief Answers after a while, counts the requests
+class ReferenceData : public module_base<ReferenceData, RefProto>
+{
+public:
+    void onMessage(ClientConnection& conn, test::Type1Message& msg)
+    {
+        ++served;
+        async_wait(std::chrono::milliseconds(100), [this, &conn, msg]()
+        {
+            test::SimpleClientMessage reply;
+            reply.set_timestamp(msg.data());
+            reply.set_payload("reference");
+            send_message(conn, reply);
+        });
+    }
+
+    void onMessage(ClientConnection&, test::SimpleClientMessage&) {}
+
+    std::atomic<int> served{ 0 };
+};
+
+class Frontend : public module_base<Frontend, RefProto>
+{
+public:
+    Frontend()
+    {
+        upstream_ = handle_server_async("127.0.0.1", UPSTREAM_PORT);
+    }
+
+    void onMessage(ClientConnection& conn, test::Type1Message& msg)
+    {
+        send_coalesced<test::SimpleClientMessage>(flights_, upstream_, msg, conn);
+    }
+
+    void onMessage(ClientConnection&, test::SimpleClientMessage&) {}
+
+    bool upstream_connected() const
+    {
+        return upstream_->connected();
+    }
+
+private:
+    std::shared_ptr<ClientOwner<AsyncHandler>> upstream_;
+    protoserv::single_flight flights_;
+};
+
+test::Type1Message request(int data)
+{
+    test::Type1Message msg;
+    msg.set_data(data);
+    return msg;
+}
+} // namespace anonymous
+
+BOOST_AUTO_TEST_SUITE(single_flight_test)
+
+BOOST_AUTO_TEST_CASE(identical_requests_share_the_call)
+{
+    protoserv::single_flight flights;
+    auto key = protoserv::single_flight::key_of(1, request(5));
+
+    std::vector<std::string> frames;
+    auto waiter = [&frames](const std::string * frame)
+    {
+        frames.push_back(frame ? *frame : "failed");
+    };
+
+    BOOST_CHECK(flights.join(key, waiter));
+    BOOST_CHECK(!flights.join(key, waiter));
+    BOOST_CHECK(!flights.join(key, waiter));
+    BOOST_CHECK_EQUAL(1u, flights.in_flight());
+    BOOST_CHECK_EQUAL(2u, flights.coalesced());
+
+    flights.complete(key, "reply");
+    BOOST_CHECK_EQUAL(0u, flights.in_flight());
+    BOOST_REQUIRE_EQUAL(3u, frames.size());
+    for (auto& f : frames)
+    {
+        BOOST_CHECK_EQUAL("reply", f);
+    }
+
+    // the next one starts over
+    BOOST_CHECK(flights.join(key, waiter));
+    flights.fail(key);
+    BOOST_CHECK_EQUAL("failed", frames.back());
+}
+
+BOOST_AUTO_TEST_CASE(keys_tell_requests_apart)
+{
+    using protoserv::single_flight;
+    BOOST_CHECK(single_flight::key_of(1, request(5)) == single_flight::key_of(1, request(5)));
+    BOOST_CHECK(single_flight::key_of(1, request(5)) != single_flight::key_of(1, request(6)));
+    BOOST_CHECK(single_flight::key_of(1, request(5)) != single_flight::key_of(2, request(5)));
+}
+
+BOOST_AUTO_TEST_CASE(fans_out_a_single_upstream_reply)
+{
+    Runner<ReferenceData> upstream;
+    upstream.run_in_background(UPSTREAM_PORT);
+
+    Runner<Frontend> frontend;
+    frontend.run_in_background(FRONTEND_PORT);
+
+    for (int i = 0; i < 500 && !frontend->upstream_connected(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    BOOST_REQUIRE(frontend->upstream_connected());
+
+    const int CLIENTS = 5;
+    std::vector<std::unique_ptr<protoserv::async_client<RefProto>>> clients;
+    for (int i = 0; i < CLIENTS; ++i)
+    {
+        clients.push_back(std::make_unique<protoserv::async_client<RefProto>>());
+        clients.back()->wait_connect(FRONTEND_PORT);
+    }
+
+    for (auto& c : clients)
+    {
+        c->send(request(42));
+    }
+    for (auto& c : clients)
+    {
+        auto reply = c->wait_message<test::SimpleClientMessage>();
+        BOOST_CHECK_EQUAL(42, reply.timestamp());
+        BOOST_CHECK_EQUAL("reference", reply.payload());
+    }
+    BOOST_CHECK_EQUAL(1, upstream->served);
+
+    // a different request makes its own call
+    clients.front()->send(request(43));
+    BOOST_CHECK_EQUAL(43, clients.front()->wait_message<test::SimpleClientMessage>().timestamp());
+    BOOST_CHECK_EQUAL(2, upstream->served);
+}
+
+BOOST_AUTO_TEST_CASE(drops_the_waiter_gone_before_the_reply)
+{
+    Runner<ReferenceData> upstream;
+    upstream.run_in_background(UPSTREAM_PORT);
+
+    Runner<Frontend> frontend;
+    frontend.run_in_background(FRONTEND_PORT);
+
+    for (int i = 0; i < 500 && !frontend->upstream_connected(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    BOOST_REQUIRE(frontend->upstream_connected());
+
+    using Client = protoserv::async_client<RefProto>;
+    auto gone = std::make_unique<Client>();
+    Client waiting;
+    gone->wait_connect(FRONTEND_PORT);
+    waiting.wait_connect(FRONTEND_PORT);
+
+    gone->send(request(42));
+    waiting.send(request(42));
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    gone->disconnect();
+    gone.reset();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    // likely takes the session object of the one gone, must not get its reply
+    Client next;
+    next.wait_connect(FRONTEND_PORT);
+    next.send(request(43));
+
+    BOOST_CHECK_EQUAL(42, waiting.wait_message<test::SimpleClientMessage>().timestamp());
+    BOOST_CHECK_EQUAL(43, next.wait_message<test::SimpleClientMessage>().timestamp());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,114 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "module.hpp"
+#include "runner.hpp"
+#include "async_client.hpp"
+#include "stats_segment.hpp"
+
+#include "protobuf_messages/messages.pb.h"
+
+namespace test = tests;
+namespace layout = protoserv::stats_layout;
+
+template <typename T>
+using Runner = test::Runner<T>;
+
+using Client = protoserv::async_client<test::SimpleClientMessage>;
+using protoserv::stats_segment;
+
+namespace
+{
+class EchoServer : public module_base<EchoServer, test::SimpleClientMessage>
+{
+public:
+    auto onMessage(ClientConnection& conn, test::SimpleClientMessage& msg)
+    {
+        return msg;
+    }
+};
+
+// @brief Returns the segment name unique to the test process
+std::string segment_name()
+{
+    return "/protoserv_test_" + std::to_string(::getpid());
+}
+
+// @brief Removes the segment when the test is over
+struct unlink_on_exit
+{
+    ~unlink_on_exit()
+    {
+        stats_segment::unlink(segment_name());
+    }
+};
+} // namespace anonymous
+
+BOOST_AUTO_TEST_SUITE(stats_segment_test)
+
+BOOST_AUTO_TEST_CASE(shares_figures_with_reader)
+{
+    unlink_on_exit guard;
+    auto writer = stats_segment::create(segment_name());
+    auto& session = writer->data().loops[1].sessions[0];
+    layout::write_locked(session, [](layout::session_figures & s)
+    {
+        layout::set(s.port, 5999);
+        layout::set(s.rtt_us, 42);
+    });
+
+    auto reader = stats_segment::open(segment_name());
+    BOOST_REQUIRE(reader);
+    BOOST_CHECK_EQUAL(layout::version, reader->data().head.version);
+
+    uint64_t rtt = 0;
+    BOOST_CHECK(layout::read_locked(reader->data().loops[1].sessions[0], [&rtt](const layout::session_figures & s)
+    {
+        rtt = layout::get(s.rtt_us);
+    }));
+    BOOST_CHECK_EQUAL(42, rtt);
+}
+
+BOOST_AUTO_TEST_CASE(does_not_open_missing_segment)
+{
+    BOOST_CHECK(!stats_segment::open("/protoserv_test_missing"));
+}
+
+BOOST_AUTO_TEST_CASE(publishes_server_figures)
+{
+    unlink_on_exit guard;
+
+    protoserv::Options opts;
+    opts["Port"] = "5999";
+    opts["StatsSegment"] = segment_name();
+    opts["StatsLoop"] = "2";
+    opts["StatsInterval"] = "10";
+
+    Runner<EchoServer> srv;
+    srv.run_in_background(opts);
+
+    Client client;
+    client.wait_connect(5999);
+    client.send(test::SimpleClientMessage());
+    client.wait_message<test::SimpleClientMessage>();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    auto reader = stats_segment::open(segment_name());
+    BOOST_REQUIRE(reader);
+    auto& loop = reader->data().loops[2];
+    BOOST_CHECK_EQUAL(::getpid(), layout::get(loop.pid));
+    BOOST_CHECK_EQUAL(1, layout::get(loop.client_sessions));
+    BOOST_CHECK_EQUAL(1, layout::get(loop.client_messages));
+    BOOST_CHECK_EQUAL(1, layout::get(loop.session_count));
+
+    client.disconnect();
+    srv.join();
+    BOOST_CHECK_EQUAL(0, layout::get(loop.pid));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
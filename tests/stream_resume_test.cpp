@@ -0,0 +1,309 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include "module.hpp"
+#include "runner.hpp"
+#include "blocking_client.hpp"
+#include "stream_resume.hpp"
+
+#include "protobuf_messages/messages.pb.h"
+
+#include <boost/asio.hpp>
+
+#include <atomic>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace test = tests;
+
+template <typename T>
+using Runner = test::Runner<T>;
+
+// Type1Message asks for a burst of SimpleClientMessage
+using StreamProto = meta::proto<test::SimpleClientMessage, test::Type1Message>;
+
+const int BURST = 10;
+const uint16_t RAW_PORT = 6051;
+const uint16_t PRODUCER_PORT = 6052;
+
+namespace
+{
+// @brief Sends a burst of numbered messages as asked, may drop the connection after the first one
+class Producer : public module_base<Producer, StreamProto>
+{
+public:
+    explicit Producer(bool dropping = false)
+        : dropped_(!dropping)
+    {
+    }
+
+    void onMessage(ClientConnection& conn, test::Type1Message& msg)
+    {
+        test::SimpleClientMessage note;
+        for (int i = 0; i < msg.data(); ++i)
+        {
+            note.set_timestamp(next_++);
+            send_message(conn, note);
+        }
+        if (!dropped_)
+        {
+            // the burst is likely still in the write buffer
+            dropped_ = true;
+            conn.close();
+        }
+    }
+
+    void onMessage(ClientConnection&, test::SimpleClientMessage&) {}
+
+private:
+    int next_ = 0;
+    bool dropped_;
+};
+
+class DroppingProducer : public Producer
+{
+public:
+    DroppingProducer()
+        : Producer(true)
+    {
+    }
+};
+
+// @brief Asks for a burst once, follows the stream over the reconnects
+class Consumer : public module_base<Consumer, StreamProto>
+{
+public:
+    Consumer()
+    {
+        async_connect("127.0.0.1", PRODUCER_PORT);
+    }
+
+    void onConnected(ServerConnection& conn)
+    {
+        if (!asked_)
+        {
+            asked_ = true;
+            conn.resume_on_reconnect([this](uint64_t, uint64_t)
+            {
+                ++gaps;
+            });
+
+            test::Type1Message start;
+            start.set_data(BURST);
+            send_message(conn, start);
+        }
+        ++connects;
+    }
+
+    void onMessage(ServerConnection&, test::SimpleClientMessage& msg)
+    {
+        if (msg.timestamp() != last + 1)
+        {
+            ++out_of_order;
+        }
+        last = msg.timestamp();
+        ++received;
+    }
+
+    void onMessage(ServerConnection&, test::Type1Message&) {}
+
+    std::atomic<int> received{ 0 };
+    std::atomic<int> last{ -1 };
+    std::atomic<int> out_of_order{ 0 };
+    std::atomic<int> gaps{ 0 };
+    std::atomic<int> connects{ 0 };
+
+private:
+    bool asked_ = false;
+};
+
+// @brief Decides which frames get lost, see blocking_client
+class raw_peer : public test::blocking_client
+{
+public:
+    using blocking_client::blocking_client;
+
+    void resume(uint64_t id, uint64_t next)
+    {
+        uint64_t request[2] = { id, next };
+        write(protoserv::resume_message_type, request, sizeof(request));
+    }
+
+    void ask(int count)
+    {
+        test::Type1Message msg;
+        msg.set_data(count);
+        send(meta::identify<StreamProto, test::Type1Message>(), msg);
+    }
+
+    uint64_t read_resumed()
+    {
+        std::string payload;
+        BOOST_REQUIRE_EQUAL(protoserv::resumed_message_type, read(payload));
+        return as_sequence(payload);
+    }
+
+    // @brief Reads a sequenced message, returns the sequence number and the timestamp
+    std::pair<uint64_t, int> read_sequenced()
+    {
+        std::string payload;
+        BOOST_REQUIRE_EQUAL(protoserv::sequence_message_type, read(payload));
+        auto seq = as_sequence(payload);
+
+        test::SimpleClientMessage msg;
+        read(meta::identify<StreamProto, test::SimpleClientMessage>(), msg);
+        return { seq, msg.timestamp() };
+    }
+
+private:
+    static uint64_t as_sequence(const std::string& payload)
+    {
+        uint64_t seq = 0;
+        BOOST_REQUIRE_EQUAL(sizeof(seq), payload.size());
+        std::memcpy(&seq, payload.data(), sizeof(seq));
+        return seq;
+    }
+};
+
+template <typename Server>
+void run_with_ring(Runner<Server>& srv, uint16_t port, const char* ring)
+{
+    protoserv::Options opts;
+    opts["Port"] = std::to_string(port);
+    opts["StreamResume"] = ring;
+    srv.run_in_background(opts);
+}
+
+template <typename Predicate>
+void wait_for(Predicate pred)
+{
+    for (int i = 0; i < 500 && !pred(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+} // namespace anonymous
+
+BOOST_AUTO_TEST_SUITE(stream_resume_test)
+
+BOOST_AUTO_TEST_CASE(ring_holds_the_latest_frames)
+{
+    protoserv::retransmit_ring ring(4);
+    for (int i = 0; i < 6; ++i)
+    {
+        auto frame = std::to_string(i);
+        BOOST_CHECK_EQUAL(static_cast<uint64_t>(i), ring.push(frame.data(), frame.size()));
+    }
+    BOOST_CHECK_EQUAL(6u, ring.next());
+    BOOST_CHECK_EQUAL(2u, ring.oldest());
+    BOOST_CHECK(!ring.holds(1));
+    BOOST_CHECK(ring.holds(2));
+    BOOST_CHECK(ring.holds(6));
+
+    std::string replayed;
+    ring.replay(3, [&replayed](uint64_t seq, const void* data, size_t size)
+    {
+        replayed.append(static_cast<const char*>(data), size);
+    });
+    BOOST_CHECK_EQUAL("345", replayed);
+}
+
+BOOST_AUTO_TEST_CASE(registry_forgets_abandoned_streams)
+{
+    protoserv::stream_registry streams(4, std::chrono::milliseconds(0));
+    int session;
+
+    auto stream = streams.find_or_create(1);
+    stream->attach(&session);
+    BOOST_CHECK(stream == streams.find_or_create(1));
+
+    // another session took the stream over, the detach of the previous one is late
+    int other;
+    stream->attach(&other);
+    stream->detach(&session, protoserv::sequenced_stream::clock_type::now());
+    BOOST_CHECK(stream->owner() == &other);
+
+    stream->detach(&other, protoserv::sequenced_stream::clock_type::now());
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    BOOST_CHECK(stream != streams.find_or_create(1));
+    BOOST_CHECK_EQUAL(1u, streams.size());
+}
+
+BOOST_AUTO_TEST_CASE(replays_the_missed_frames)
+{
+    Runner<Producer> producer;
+    run_with_ring(producer, RAW_PORT, "64");
+
+    const uint64_t id = 42;
+    {
+        raw_peer peer(RAW_PORT);
+        peer.resume(id, 0);
+        BOOST_CHECK_EQUAL(0u, peer.read_resumed());
+        peer.ask(BURST);
+
+        // only the first three make it
+        for (int i = 0; i < 3; ++i)
+        {
+            auto msg = peer.read_sequenced();
+            BOOST_CHECK_EQUAL(static_cast<uint64_t>(i), msg.first);
+            BOOST_CHECK_EQUAL(i, msg.second);
+        }
+    }
+
+    raw_peer peer(RAW_PORT);
+    peer.resume(id, 3);
+    BOOST_CHECK_EQUAL(3u, peer.read_resumed());
+    for (int i = 3; i < BURST; ++i)
+    {
+        auto msg = peer.read_sequenced();
+        BOOST_CHECK_EQUAL(static_cast<uint64_t>(i), msg.first);
+        BOOST_CHECK_EQUAL(i, msg.second);
+    }
+
+    // the stream goes on where it stopped
+    peer.ask(1);
+    auto msg = peer.read_sequenced();
+    BOOST_CHECK_EQUAL(static_cast<uint64_t>(BURST), msg.first);
+    BOOST_CHECK_EQUAL(BURST, msg.second);
+}
+
+BOOST_AUTO_TEST_CASE(skips_ahead_beyond_the_ring)
+{
+    Runner<Producer> producer;
+    run_with_ring(producer, RAW_PORT + 2, "4");
+
+    const uint64_t id = 7;
+    {
+        raw_peer peer(RAW_PORT + 2);
+        peer.resume(id, 0);
+        peer.read_resumed();
+        peer.ask(BURST);
+        peer.read_sequenced();
+    }
+
+    raw_peer peer(RAW_PORT + 2);
+    peer.resume(id, 1);
+    BOOST_CHECK_EQUAL(static_cast<uint64_t>(BURST), peer.read_resumed());
+
+    peer.ask(1);
+    BOOST_CHECK_EQUAL(static_cast<uint64_t>(BURST), peer.read_sequenced().first);
+}
+
+BOOST_AUTO_TEST_CASE(consumer_resumes_after_reconnect)
+{
+    Runner<DroppingProducer> producer;
+    run_with_ring(producer, PRODUCER_PORT, "64");
+
+    Runner<Consumer> consumer;
+    consumer.run_in_background(PRODUCER_PORT + 10);
+
+    wait_for([&consumer] { return consumer->received == BURST; });
+
+    BOOST_CHECK_EQUAL(BURST, consumer->received);
+    BOOST_CHECK_EQUAL(0, consumer->out_of_order);
+    BOOST_CHECK_EQUAL(0, consumer->gaps);
+    BOOST_CHECK_GE(consumer->connects, 2);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,345 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+#include <boost/asio/ssl.hpp>
+
+#include "module.hpp"
+#include "runner.hpp"
+#include "async_client.hpp"
+
+#include "protobuf_messages/messages.pb.h"
+
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include <cstdio>
+#include <string>
+#include <unistd.h>
+
+namespace test = tests;
+
+template <typename T>
+using Runner = test::Runner<T>;
+
+using Client = protoserv::async_client<test::SimpleClientMessage>;
+using tcp = boost::asio::ip::tcp;
+
+#ifdef _DEBUG
+const auto TLS_BENCH_MESSAGES = 5000;
+#else
+const auto TLS_BENCH_MESSAGES = 50000;
+#endif
+
+namespace
+{
+class TlsEchoServer : public module_base<TlsEchoServer, test::SimpleClientMessage>
+{
+public:
+    void onConnected(ClientConnection&)
+    {
+        ++connected;
+    }
+
+    void onMessage(ClientConnection& conn, test::SimpleClientMessage& msg)
+    {
+        tls = conn.tls_enabled();
+        kernel_tls = conn.kernel_tls();
+        send_message(conn, msg);
+    }
+
+    std::atomic<int> connected{ 0 };
+    std::atomic<bool> tls{ false };
+    std::atomic<bool> kernel_tls{ false };
+};
+
+// @brief A self-signed certificate along with its key in a single PEM file, removed at exit
+class self_signed_certificate
+{
+public:
+    self_signed_certificate()
+        : path_("/tmp/protoserv_tls_test_" + std::to_string(::getpid()) + ".pem")
+    {
+        auto kctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+        EVP_PKEY* key = nullptr;
+        EVP_PKEY_keygen_init(kctx);
+        EVP_PKEY_CTX_set_ec_paramgen_curve_nid(kctx, NID_X9_62_prime256v1);
+        EVP_PKEY_keygen(kctx, &key);
+        EVP_PKEY_CTX_free(kctx);
+
+        auto cert = X509_new();
+        X509_set_version(cert, 2);
+        ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+        X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+        X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+        X509_set_pubkey(cert, key);
+
+        auto name = X509_get_subject_name(cert);
+        X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC,
+                                   reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+        X509_set_issuer_name(cert, name);
+        X509_sign(cert, key, EVP_sha256());
+
+        auto file = std::fopen(path_.c_str(), "w");
+        PEM_write_X509(file, cert);
+        PEM_write_PrivateKey(file, key, nullptr, nullptr, 0, nullptr, nullptr);
+        std::fclose(file);
+
+        X509_free(cert);
+        EVP_PKEY_free(key);
+    }
+
+    ~self_signed_certificate()
+    {
+        std::remove(path_.c_str());
+    }
+
+    const std::string& path() const
+    {
+        return path_;
+    }
+
+private:
+    std::string path_;
+};
+
+// @brief Writes the framed message to the stream
+template <typename Stream>
+void write_frame(Stream& stream, const test::SimpleClientMessage& msg)
+{
+    std::string frame(4 + msg.ByteSize(), '\0');
+    auto header = reinterpret_cast<uint16_t*>(&frame[0]);
+    header[0] = static_cast<uint16_t>(frame.size());
+    header[1] = 0;
+    msg.SerializeToArray(&frame[4], msg.ByteSize());
+    boost::asio::write(stream, boost::asio::buffer(frame));
+}
+
+// @brief Reads a framed message from the stream
+template <typename Stream>
+test::SimpleClientMessage read_frame(Stream& stream)
+{
+    uint16_t header[2];
+    boost::asio::read(stream, boost::asio::buffer(header));
+
+    std::string body(header[0] - 4, '\0');
+    boost::asio::read(stream, boost::asio::buffer(&body[0], body.size()));
+
+    test::SimpleClientMessage msg;
+    msg.ParseFromString(body);
+    return msg;
+}
+
+protoserv::Options tls_options(uint16_t port, const self_signed_certificate& cert)
+{
+    protoserv::Options opts;
+    opts["Port"] = std::to_string(port);
+    opts["TlsCertificate"] = cert.path();
+    return opts;
+}
+
+// @brief Connects to the TLS echo server, sends a message once connected
+struct Upstream : public module_base<Upstream, test::SimpleClientMessage>
+{
+    Upstream()
+    {
+        async_connect("127.0.0.1", 5999);
+    }
+
+    void onConnected(ServerConnection& conn)
+    {
+        test::SimpleClientMessage msg;
+        msg.set_timestamp(7);
+        send_message(conn, msg);
+    }
+
+    void onMessage(ServerConnection& conn, test::SimpleClientMessage& msg)
+    {
+        tls = conn.tls_enabled();
+        timestamp = msg.timestamp();
+    }
+
+    std::atomic<bool> tls{ false };
+    std::atomic<int> timestamp{ 0 };
+};
+
+} // namespace anonymous
+
+struct tls_fixture
+{
+    tls_fixture()
+        : ssl(boost::asio::ssl::context::tls_client)
+    {
+        message.set_timestamp(121212);
+        message.set_payload("secret");
+    }
+
+    // @brief Connects, retries until the server is up
+    void connect(tcp::socket& socket, uint16_t port)
+    {
+        boost::system::error_code ec;
+        do
+        {
+            socket.close();
+            socket.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port), ec);
+        }
+        while (ec);
+        socket.set_option(tcp::no_delay(true));
+    }
+
+    self_signed_certificate cert;
+    boost::asio::io_service service;
+    boost::asio::ssl::context ssl;
+    test::SimpleClientMessage message;
+};
+
+BOOST_FIXTURE_TEST_SUITE(tls_test, tls_fixture)
+
+BOOST_AUTO_TEST_CASE(serves_tls_clients)
+{
+    Runner<TlsEchoServer> srv;
+    auto opts = tls_options(5999, cert);
+    srv.run_in_background(opts);
+
+    boost::asio::ssl::stream<tcp::socket> stream(service, ssl);
+    connect(stream.next_layer(), 5999);
+    stream.handshake(boost::asio::ssl::stream_base::client);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        message.set_timestamp(i);
+        write_frame(stream, message);
+        auto reply = read_frame(stream);
+        BOOST_CHECK_EQUAL(i, reply.timestamp());
+        BOOST_CHECK_EQUAL("secret", reply.payload());
+    }
+
+    BOOST_CHECK(srv->tls);
+    BOOST_TEST_MESSAGE("kernel TLS " << (srv->kernel_tls ? "on" : "off"));
+}
+
+BOOST_AUTO_TEST_CASE(connects_to_tls_upstream)
+{
+    Runner<TlsEchoServer> echo;
+    auto opts = tls_options(5999, cert);
+    echo.run_in_background(opts);
+
+    protoserv::Options upstream_opts;
+    upstream_opts["Port"] = "6000";
+    upstream_opts["TlsUpstream"] = "1";
+    upstream_opts["TlsCaFile"] = cert.path();
+    upstream_opts["TlsServerName"] = "localhost";
+
+    Runner<Upstream> srv;
+    srv.run_in_background(upstream_opts);
+
+    for (int i = 0; i < 500 && !srv->timestamp; ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    BOOST_CHECK_EQUAL(7, srv->timestamp);
+    BOOST_CHECK(srv->tls);
+}
+
+BOOST_AUTO_TEST_CASE(refuses_upstream_of_another_name)
+{
+    Runner<TlsEchoServer> echo;
+    auto opts = tls_options(5999, cert);
+    echo.run_in_background(opts);
+
+    // the certificate is issued to localhost, not to the address connected to
+    protoserv::Options upstream_opts;
+    upstream_opts["Port"] = "6000";
+    upstream_opts["TlsUpstream"] = "1";
+    upstream_opts["TlsCaFile"] = cert.path();
+
+    Runner<Upstream> srv;
+    srv.run_in_background(upstream_opts);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+    BOOST_CHECK_EQUAL(0, srv->timestamp);
+    BOOST_CHECK_EQUAL(0, echo->connected);
+}
+
+BOOST_AUTO_TEST_CASE(requires_ca_file_to_verify_upstream)
+{
+    BOOST_CHECK_THROW(protoserv::tls_context::client(""), std::invalid_argument);
+    BOOST_CHECK(protoserv::tls_context::client("", "", false));
+}
+
+BOOST_AUTO_TEST_CASE(does_not_connect_plain_clients)
+{
+    Runner<TlsEchoServer> srv;
+    auto opts = tls_options(5999, cert);
+    srv.run_in_background(opts);
+
+    tcp::socket socket(service);
+    connect(socket, 5999);
+    write_frame(socket, message);
+
+    // the garbage fails the handshake, the server closes the socket
+    char byte;
+    boost::system::error_code ec;
+    while (!ec)
+    {
+        socket.read_some(boost::asio::buffer(&byte, 1), ec);
+    }
+
+    BOOST_CHECK_EQUAL(0, srv->connected);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+// @brief Echo round trips over TLS (kernel or userspace, whichever is available) versus plain TCP
+BOOST_FIXTURE_TEST_SUITE(tls_bench, tls_fixture, *boost::unit_test::disabled())
+
+BOOST_AUTO_TEST_CASE(tls_throughput_cost)
+{
+    constexpr int BATCH = 100;
+
+    auto run = [this](auto& stream, const char* name, size_t payload_size)
+    {
+        message.set_payload(std::string(payload_size, 'x'));
+
+        auto started = std::chrono::steady_clock::now();
+        for (int sent = 0; sent < TLS_BENCH_MESSAGES; sent += BATCH)
+        {
+            for (int i = 0; i < BATCH; ++i)
+            {
+                write_frame(stream, message);
+            }
+            for (int i = 0; i < BATCH; ++i)
+            {
+                read_frame(stream);
+            }
+        }
+        auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+        std::cout << name << ", payload " << payload_size << " bytes: "
+                  << static_cast<int>(TLS_BENCH_MESSAGES / seconds) << " msg/sec, "
+                  << static_cast<int>(TLS_BENCH_MESSAGES * payload_size / seconds / 1024 / 1024) << " MB/sec"
+                  << std::endl;
+    };
+
+    Runner<TlsEchoServer> plain;
+    plain.run_in_background(5999);
+    Runner<TlsEchoServer> tls;
+    auto opts = tls_options(6000, cert);
+    tls.run_in_background(opts);
+
+    tcp::socket socket(service);
+    connect(socket, 5999);
+
+    boost::asio::ssl::stream<tcp::socket> stream(service, ssl);
+    connect(stream.next_layer(), 6000);
+    stream.handshake(boost::asio::ssl::stream_base::client);
+
+    for (auto payload_size : { 16, 1024, 16 * 1024 })
+    {
+        run(socket, "plain", payload_size);
+        run(stream, "tls", payload_size);
+    }
+    std::cout << "server side kernel TLS " << (tls->kernel_tls ? "on" : "off") << std::endl;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
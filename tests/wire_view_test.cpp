@@ -0,0 +1,203 @@
+#include <boost/test/unit_test.hpp>
+#include <boost/test/unit_test_suite.hpp>
+
+#include "module.hpp"
+#include "loopback_client.hpp"
+
+#include "protobuf_messages/messages.views.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace test = tests;
+
+using ViewProto = meta::proto<test::SimpleClientMessage, test::Type8Message, test::Type2Message>;
+
+namespace
+{
+// @brief Reads the payloads right from the receive buffer
+class ViewServer : public module_base<ViewServer, ViewProto>
+{
+public:
+    void onMessage(ClientConnection&, test::SimpleClientMessageView msg)
+    {
+        payloads.emplace_back(msg.payload());
+        timestamps.push_back(msg.timestamp());
+    }
+
+    test::Type2Message onMessage(ClientConnection&, test::Type8MessageView msg)
+    {
+        test::Type2Message reply;
+        reply.set_data(msg.data1() + msg.data2());
+        return reply;
+    }
+
+    void onMessage(ClientConnection&, test::Type2Message&) {}
+
+    std::vector<std::string> payloads;
+    std::vector<int> timestamps;
+};
+
+using Client = protoserv::loopback_client<ViewServer>;
+
+// @brief Exposes the repeated field readers of the base, the test messages have no repeated fields
+class RepeatedView : public protoserv::wire_view
+{
+public:
+    using protoserv::wire_view::wire_view;
+
+    std::vector<int32_t> numbers() const
+    {
+        std::vector<int32_t> ret;
+        foreach_varint<int32_t>(1, [&ret](int32_t v) { ret.push_back(v); });
+        return ret;
+    }
+
+    std::vector<int64_t> signed_numbers() const
+    {
+        std::vector<int64_t> ret;
+        foreach_varint<int64_t, true>(1, [&ret](int64_t v) { ret.push_back(v); });
+        return ret;
+    }
+
+    std::vector<uint32_t> fixed() const
+    {
+        std::vector<uint32_t> ret;
+        foreach_fixed<uint32_t>(1, [&ret](uint32_t v) { ret.push_back(v); });
+        return ret;
+    }
+};
+
+template <typename T>
+std::string encode(const T& msg)
+{
+    return msg.SerializeAsString();
+}
+} // namespace anonymous
+
+BOOST_AUTO_TEST_SUITE(wire_view_test)
+
+BOOST_AUTO_TEST_CASE(reads_the_scalar_fields)
+{
+    test::Type8Message msg;
+    msg.set_data1(-7);
+    msg.set_data2(1LL << 40);
+    auto bytes = encode(msg);
+
+    test::Type8MessageView view(bytes.data(), static_cast<int>(bytes.size()));
+    BOOST_CHECK_EQUAL(-7, view.data1());
+    BOOST_CHECK_EQUAL(1LL << 40, view.data2());
+    BOOST_CHECK(view.has_data1());
+
+    test::Type4Message f;
+    f.set_data(1.5f);
+    auto fbytes = encode(f);
+    BOOST_CHECK_EQUAL(1.5f, test::Type4MessageView(fbytes).data());
+
+    test::Type5Message d;
+    d.set_data(-2.25);
+    auto dbytes = encode(d);
+    BOOST_CHECK_EQUAL(-2.25, test::Type5MessageView(dbytes).data());
+
+    test::Type3Message b;
+    b.set_data(true);
+    auto bbytes = encode(b);
+    BOOST_CHECK(test::Type3MessageView(bbytes).data());
+}
+
+BOOST_AUTO_TEST_CASE(reads_the_strings_in_place)
+{
+    test::SimpleClientMessage msg;
+    msg.set_timestamp(42);
+    msg.set_payload("hello");
+    auto bytes = encode(msg);
+
+    test::SimpleClientMessageView view(bytes);
+    auto payload = view.payload();
+    BOOST_CHECK_EQUAL("hello", std::string(payload));
+    BOOST_CHECK(payload.data() >= bytes.data() && payload.data() + payload.size() <= bytes.data() + bytes.size());
+    BOOST_CHECK_EQUAL(42, view.timestamp());
+    BOOST_CHECK(view.wire() == bytes);
+}
+
+BOOST_AUTO_TEST_CASE(reads_the_absent_fields_as_defaults)
+{
+    test::Type8Message msg;
+    msg.set_data2(3);
+    auto bytes = encode(msg);
+
+    test::Type8MessageView view(bytes);
+    BOOST_CHECK(!view.has_data1());
+    BOOST_CHECK_EQUAL(0, view.data1());
+    BOOST_CHECK_EQUAL(3, view.data2());
+
+    test::SimpleClientMessageView empty;
+    BOOST_CHECK(empty.payload().empty());
+    BOOST_CHECK(!empty.has_payload());
+
+    // truncated in the middle of the string
+    test::SimpleClientMessage s;
+    s.set_payload("truncated");
+    auto sbytes = encode(s);
+    test::SimpleClientMessageView broken(sbytes.data(), static_cast<int>(sbytes.size()) - 1);
+    BOOST_CHECK(broken.payload().empty());
+}
+
+BOOST_AUTO_TEST_CASE(last_occurrence_wins)
+{
+    test::Type1Message first;
+    first.set_data(1);
+    test::Type1Message second;
+    second.set_data(2);
+    // merged encodings, as the parser sees them
+    auto bytes = encode(first) + encode(second);
+
+    BOOST_CHECK_EQUAL(2, test::Type1MessageView(bytes).data());
+
+    test::Type1Message parsed;
+    parsed.ParseFromString(bytes);
+    BOOST_CHECK_EQUAL(parsed.data(), test::Type1MessageView(bytes).data());
+
+    BOOST_CHECK((RepeatedView(bytes).numbers() == std::vector<int32_t>{ 1, 2 }));
+}
+
+BOOST_AUTO_TEST_CASE(reads_the_packed_fields)
+{
+    // field 1, packed: 1, 300, -1 as varints
+    const std::string varints("\x0a\x0d\x01\xac\x02\xff\xff\xff\xff\xff\xff\xff\xff\xff\x01", 15);
+    BOOST_CHECK((RepeatedView(varints).numbers() == std::vector<int32_t>{ 1, 300, -1 }));
+
+    // field 1, packed: 1, -1, 2 zigzag encoded
+    const std::string zigzag("\x0a\x03\x02\x01\x04", 5);
+    BOOST_CHECK((RepeatedView(zigzag).signed_numbers() == std::vector<int64_t>{ 1, -1, 2 }));
+
+    // field 1, packed fixed32: 1, 2
+    const std::string fixed("\x0a\x08\x01\x00\x00\x00\x02\x00\x00\x00", 10);
+    BOOST_CHECK((RepeatedView(fixed).fixed() == std::vector<uint32_t>{ 1, 2 }));
+}
+
+BOOST_AUTO_TEST_CASE(module_handlers_take_the_views)
+{
+    ViewServer server;
+    Client client(server);
+    client.connect();
+
+    test::SimpleClientMessage msg;
+    msg.set_timestamp(7);
+    msg.set_payload("first");
+    client.send(msg);
+    msg.set_payload("second");
+    client.send(msg);
+
+    test::Type8Message sum;
+    sum.set_data1(40);
+    sum.set_data2(2);
+    client.send(sum);
+    BOOST_CHECK_EQUAL(42, client.wait_message<test::Type2Message>().data());
+
+    BOOST_CHECK((server.payloads == std::vector<std::string>{ "first", "second" }));
+    BOOST_CHECK((server.timestamps == std::vector<int>{ 7, 7 }));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,251 @@
+#include <boost/asio/ip/address_v4.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stats_segment.hpp"
+
+// @brief Live view of the stats published by protoserv servers to a shared memory segment
+// @description
+// Usage: protoserv_top <segment name> [refresh interval, ms] [--once]
+// Reads the segment only, the servers do not take part in it.
+
+using namespace protoserv::stats_layout;
+
+namespace
+{
+struct session_row
+{
+    int loop;
+    uint32_t server;
+    uint32_t address;
+    uint32_t port;
+    uint64_t idle_ms;
+    uint64_t read_buffer_bytes;
+    uint64_t rtt_us;
+    uint64_t unacked;
+    uint64_t notsent_bytes;
+    uint64_t retransmits;
+};
+
+struct loop_snapshot
+{
+    uint64_t client_connections = 0;
+    uint64_t client_messages = 0;
+    uint64_t server_messages = 0;
+};
+
+const char* phase_names[phase_count] = { "kernel_to_read", "read_to_dispatch", "handler", "send_to_write" };
+
+uint64_t wall_clock_ns()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+// @brief Converts the counter increment to a per second rate
+uint64_t rate(uint64_t now, uint64_t before, double seconds)
+{
+    return seconds > 0 && now >= before ? static_cast<uint64_t>((now - before) / seconds) : 0;
+}
+
+void print_loops(const segment& seg, std::vector<loop_snapshot>& prev, double seconds)
+{
+    std::cout << std::left << std::setw(6) << "loop" << std::right
+              << std::setw(8) << "pid" << std::setw(10) << "age ms"
+              << std::setw(10) << "clients" << std::setw(10) << "servers"
+              << std::setw(10) << "conn/s" << std::setw(12) << "cli msg/s"
+              << std::setw(12) << "srv msg/s" << std::setw(14) << "readbuf" << "\n";
+
+    auto now = wall_clock_ns();
+    for (uint32_t i = 0; i < max_loops; ++i)
+    {
+        auto& loop = seg.loops[i];
+        auto pid = get(loop.pid);
+        if (!pid)
+        {
+            continue;
+        }
+
+        loop_snapshot cur;
+        cur.client_connections = get(loop.client_connections);
+        cur.client_messages = get(loop.client_messages);
+        cur.server_messages = get(loop.server_messages);
+
+        auto updated = get(loop.updated_ns);
+        std::cout << std::left << std::setw(6) << i << std::right
+                  << std::setw(8) << pid
+                  << std::setw(10) << (now > updated ? (now - updated) / 1000000 : 0)
+                  << std::setw(10) << get(loop.client_sessions)
+                  << std::setw(10) << get(loop.server_sessions)
+                  << std::setw(10) << rate(cur.client_connections, prev[i].client_connections, seconds)
+                  << std::setw(12) << rate(cur.client_messages, prev[i].client_messages, seconds)
+                  << std::setw(12) << rate(cur.server_messages, prev[i].server_messages, seconds)
+                  << std::setw(14) << get(loop.read_buffer_bytes) << "\n";
+
+        prev[i] = cur;
+    }
+    std::cout << "\n";
+}
+
+void print_types(const segment& seg)
+{
+    std::cout << std::left << std::setw(6) << "loop" << std::setw(6) << "type" << std::setw(18) << "phase"
+              << std::right << std::setw(12) << "count" << std::setw(12) << "p50 ns"
+              << std::setw(12) << "p99 ns" << std::setw(12) << "max ns" << "\n";
+
+    for (uint32_t i = 0; i < max_loops; ++i)
+    {
+        auto& loop = seg.loops[i];
+        if (!get(loop.pid))
+        {
+            continue;
+        }
+
+        for (uint32_t type = 0; type < max_types; ++type)
+        {
+            for (int p = 0; p < phase_count; ++p)
+            {
+                auto& f = loop.types[type].phases[p];
+                if (get(f.count))
+                {
+                    std::cout << std::left << std::setw(6) << i << std::setw(6) << type
+                              << std::setw(18) << phase_names[p] << std::right
+                              << std::setw(12) << get(f.count) << std::setw(12) << get(f.p50)
+                              << std::setw(12) << get(f.p99) << std::setw(12) << get(f.max) << "\n";
+                }
+            }
+        }
+    }
+    std::cout << "\n";
+}
+
+void print_sessions(const segment& seg, size_t limit)
+{
+    std::vector<session_row> rows;
+    for (uint32_t i = 0; i < max_loops; ++i)
+    {
+        auto& loop = seg.loops[i];
+        if (!get(loop.pid))
+        {
+            continue;
+        }
+
+        auto count = std::min<uint64_t>(get(loop.session_count), max_sessions);
+        for (uint64_t j = 0; j < count; ++j)
+        {
+            session_row row;
+            row.loop = i;
+            auto consistent = read_locked(loop.sessions[j], [&row](const session_figures & s)
+            {
+                row.server = get(s.server);
+                row.address = get(s.address);
+                row.port = get(s.port);
+                row.idle_ms = get(s.idle_ms);
+                row.read_buffer_bytes = get(s.read_buffer_bytes);
+                row.rtt_us = get(s.rtt_us);
+                row.unacked = get(s.unacked);
+                row.notsent_bytes = get(s.notsent_bytes);
+                row.retransmits = get(s.retransmits);
+            });
+
+            if (consistent)
+            {
+                rows.push_back(row);
+            }
+        }
+    }
+
+    // the sessions most likely to be in trouble go first
+    std::sort(rows.begin(), rows.end(), [](auto & a, auto & b)
+    {
+        return a.notsent_bytes != b.notsent_bytes ? a.notsent_bytes > b.notsent_bytes : a.rtt_us > b.rtt_us;
+    });
+
+    std::cout << std::left << std::setw(6) << "loop" << std::setw(8) << "kind" << std::setw(24) << "peer"
+              << std::right << std::setw(10) << "idle ms" << std::setw(10) << "rtt us"
+              << std::setw(10) << "unacked" << std::setw(12) << "notsent" << std::setw(10) << "retrans"
+              << std::setw(12) << "readbuf" << "\n";
+
+    for (size_t i = 0; i < std::min(limit, rows.size()); ++i)
+    {
+        auto& r = rows[i];
+        auto peer = boost::asio::ip::address_v4(r.address).to_string() + ":" + std::to_string(r.port);
+        std::cout << std::left << std::setw(6) << r.loop << std::setw(8) << (r.server ? "server" : "client")
+                  << std::setw(24) << peer << std::right
+                  << std::setw(10) << r.idle_ms << std::setw(10) << r.rtt_us
+                  << std::setw(10) << r.unacked << std::setw(12) << r.notsent_bytes
+                  << std::setw(10) << r.retransmits << std::setw(12) << r.read_buffer_bytes << "\n";
+    }
+}
+} // namespace anonymous
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: protoserv_top <segment name> [interval ms] [--once]" << std::endl;
+        return 1;
+    }
+
+    std::string name = argv[1];
+    int interval_ms = 1000;
+    bool once = false;
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--once")
+        {
+            once = true;
+        }
+        else
+        {
+            interval_ms = boost::lexical_cast<int>(arg);
+        }
+    }
+
+    auto seg = protoserv::stats_segment::open(name);
+    if (!seg)
+    {
+        std::cerr << "protoserv_top: no stats segment " << name << " of version "
+                  << version << std::endl;
+        return 1;
+    }
+
+    std::vector<loop_snapshot> prev(max_loops);
+    auto last = std::chrono::steady_clock::now();
+    bool first = true;
+
+    for (;;)
+    {
+        auto now = std::chrono::steady_clock::now();
+        auto seconds = first ? 0.0 : std::chrono::duration<double>(now - last).count();
+        last = now;
+        first = false;
+
+        if (!once)
+        {
+            // clear the terminal
+            std::cout << "\033[H\033[2J";
+        }
+
+        print_loops(seg->data(), prev, seconds);
+        print_types(seg->data());
+        print_sessions(seg->data(), 20);
+        std::cout << std::flush;
+
+        if (once)
+        {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(interval_ms));
+    }
+
+    return 0;
+}
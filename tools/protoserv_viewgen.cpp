@@ -0,0 +1,345 @@
+#include <google/protobuf/descriptor.h>
+#include <google/protobuf/descriptor.pb.h>
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// @brief Generates the zero-copy reader views of the messages, see wire_view.hpp
+// @description
+// Usage: protoserv_viewgen <descriptor set> <generated .pb.h include> <output header>
+// The descriptor set comes from protoc --include_imports --descriptor_set_out, the views
+// are generated for the messages of the last file of the set, the one protoc was given.
+
+using namespace google::protobuf;
+
+namespace
+{
+// @brief Returns the C++ namespace of the package, a.b becomes a::b
+std::string cpp_namespace(const std::string& package)
+{
+    std::string ret;
+    for (auto c : package)
+    {
+        ret += c == '.' ? std::string("::") : std::string(1, c);
+    }
+    return ret;
+}
+
+// @brief Returns the generated class name of the message, nested messages go as Outer_Inner
+std::string class_name(const Descriptor* d)
+{
+    return d->containing_type() ? class_name(d->containing_type()) + "_" + d->name() : d->name();
+}
+
+// @brief Returns the fully qualified generated class name of the message
+std::string qualified_name(const Descriptor* d)
+{
+    auto ns = cpp_namespace(d->file()->package());
+    return ns.empty() ? "::" + class_name(d) : "::" + ns + "::" + class_name(d);
+}
+
+// @brief Returns the fully qualified name of the generated view of the message
+std::string view_name(const Descriptor* d)
+{
+    return qualified_name(d) + "View";
+}
+
+std::string enum_name(const EnumDescriptor* e)
+{
+    auto name = e->containing_type() ? class_name(e->containing_type()) + "_" + e->name() : e->name();
+    auto ns = cpp_namespace(e->file()->package());
+    return ns.empty() ? "::" + name : "::" + ns + "::" + name;
+}
+
+// @brief Returns a C++ string literal of the bytes
+std::string quoted(const std::string& s)
+{
+    std::ostringstream os;
+    os << '"';
+    for (unsigned char c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            os << '\\' << c;
+        }
+        else if (c < 0x20 || c >= 0x7f)
+        {
+            os << "\\" << std::oct << static_cast<int>(c) << std::dec << "\"\"";
+        }
+        else
+        {
+            os << c;
+        }
+    }
+    os << '"';
+    return os.str();
+}
+
+struct field_code
+{
+    std::string type;    // the value type
+    std::string reader;  // the wire_view reader of a single value
+    std::string each;    // the wire_view reader of a repeated field
+    std::string def;     // the default value
+};
+
+// @brief Maps the field to its value type and the wire_view readers, false if not supported
+bool describe(const FieldDescriptor* f, field_code& code)
+{
+    auto number_default = [f]() -> std::string
+    {
+        switch (f->cpp_type())
+        {
+        case FieldDescriptor::CPPTYPE_INT32:
+            return std::to_string(f->default_value_int32());
+        case FieldDescriptor::CPPTYPE_INT64:
+            return std::to_string(f->default_value_int64()) + "LL";
+        case FieldDescriptor::CPPTYPE_UINT32:
+            return std::to_string(f->default_value_uint32()) + "U";
+        case FieldDescriptor::CPPTYPE_UINT64:
+            return std::to_string(f->default_value_uint64()) + "ULL";
+        case FieldDescriptor::CPPTYPE_FLOAT:
+        {
+            std::ostringstream os;
+            os.precision(9);
+            os << std::showpoint << f->default_value_float() << 'f';
+            return os.str();
+        }
+        case FieldDescriptor::CPPTYPE_DOUBLE:
+        {
+            std::ostringstream os;
+            os.precision(17);
+            os << std::showpoint << f->default_value_double();
+            return os.str();
+        }
+        case FieldDescriptor::CPPTYPE_BOOL:
+            return f->default_value_bool() ? "true" : "false";
+        default:
+            return "0";
+        }
+    };
+
+    auto scalar = [&code, &number_default](const char* type, const char* reader, const char* each)
+    {
+        code.type = type;
+        code.reader = reader;
+        code.each = each;
+        code.def = number_default();
+    };
+
+    switch (f->type())
+    {
+    case FieldDescriptor::TYPE_INT32:
+        scalar("int32_t", "varint_field<int32_t>", "foreach_varint<int32_t>");
+        break;
+    case FieldDescriptor::TYPE_INT64:
+        scalar("int64_t", "varint_field<int64_t>", "foreach_varint<int64_t>");
+        break;
+    case FieldDescriptor::TYPE_UINT32:
+        scalar("uint32_t", "varint_field<uint32_t>", "foreach_varint<uint32_t>");
+        break;
+    case FieldDescriptor::TYPE_UINT64:
+        scalar("uint64_t", "varint_field<uint64_t>", "foreach_varint<uint64_t>");
+        break;
+    case FieldDescriptor::TYPE_BOOL:
+        scalar("bool", "varint_field<bool>", "foreach_varint<bool>");
+        break;
+    case FieldDescriptor::TYPE_SINT32:
+        scalar("int32_t", "zigzag_field<int32_t>", "foreach_varint<int32_t, true>");
+        break;
+    case FieldDescriptor::TYPE_SINT64:
+        scalar("int64_t", "zigzag_field<int64_t>", "foreach_varint<int64_t, true>");
+        break;
+    case FieldDescriptor::TYPE_FIXED32:
+        scalar("uint32_t", "fixed_field<uint32_t>", "foreach_fixed<uint32_t>");
+        break;
+    case FieldDescriptor::TYPE_FIXED64:
+        scalar("uint64_t", "fixed_field<uint64_t>", "foreach_fixed<uint64_t>");
+        break;
+    case FieldDescriptor::TYPE_SFIXED32:
+        scalar("int32_t", "fixed_field<int32_t>", "foreach_fixed<int32_t>");
+        break;
+    case FieldDescriptor::TYPE_SFIXED64:
+        scalar("int64_t", "fixed_field<int64_t>", "foreach_fixed<int64_t>");
+        break;
+    case FieldDescriptor::TYPE_FLOAT:
+        scalar("float", "fixed_field<float>", "foreach_fixed<float>");
+        break;
+    case FieldDescriptor::TYPE_DOUBLE:
+        scalar("double", "fixed_field<double>", "foreach_fixed<double>");
+        break;
+    case FieldDescriptor::TYPE_ENUM:
+    {
+        auto e = enum_name(f->enum_type());
+        code.type = e;
+        code.reader = "varint_field<" + e + ">";
+        code.each = "foreach_varint<" + e + ">";
+        code.def = "static_cast<" + e + ">(" + std::to_string(f->default_value_enum()->number()) + ")";
+        break;
+    }
+    case FieldDescriptor::TYPE_STRING:
+    case FieldDescriptor::TYPE_BYTES:
+        code.type = "std::string_view";
+        code.reader = "bytes_field";
+        code.each = "foreach_bytes";
+        code.def = f->has_default_value() ? "std::string_view(" + quoted(f->default_value_string()) + ", " +
+                   std::to_string(f->default_value_string().size()) + ")" : "std::string_view()";
+        break;
+    case FieldDescriptor::TYPE_MESSAGE:
+        code.type = view_name(f->message_type());
+        code.reader = "";
+        code.each = "foreach_bytes";
+        code.def = "";
+        break;
+    default:
+        // groups
+        return false;
+    }
+    return true;
+}
+
+void generate_view(const Descriptor* d, std::ostream& os)
+{
+    for (int i = 0; i < d->nested_type_count(); ++i)
+    {
+        generate_view(d->nested_type(i), os);
+    }
+
+    auto name = class_name(d) + "View";
+    os << "// @brief Reader view of " << d->full_name() << ", see protoserv::wire_view\n"
+       << "class " << name << " : public protoserv::wire_view\n"
+       << "{\n"
+       << "public:\n"
+       << "    using message_type = " << qualified_name(d) << ";\n"
+       << "    using protoserv::wire_view::wire_view;\n";
+
+    for (int i = 0; i < d->field_count(); ++i)
+    {
+        auto f = d->field(i);
+        field_code code;
+        if (!describe(f, code))
+        {
+            continue;
+        }
+
+        auto number = std::to_string(f->number());
+        os << "\n";
+        if (f->is_repeated())
+        {
+            os << "    template <typename F>\n"
+               << "    void foreach_" << f->name() << "(F&& f) const\n"
+               << "    {\n";
+            if (f->type() == FieldDescriptor::TYPE_MESSAGE)
+            {
+                os << "        foreach_bytes(" << number << ", [&f](std::string_view bytes)\n"
+                   << "        {\n"
+                   << "            f(" << code.type << "(bytes));\n"
+                   << "        });\n";
+            }
+            else
+            {
+                os << "        " << code.each << "(" << number << ", std::forward<F>(f));\n";
+            }
+            os << "    }\n";
+            continue;
+        }
+
+        os << "    " << code.type << " " << f->name() << "() const\n"
+           << "    {\n";
+        if (f->type() == FieldDescriptor::TYPE_MESSAGE)
+        {
+            os << "        return " << code.type << "(bytes_field(" << number << "));\n";
+        }
+        else
+        {
+            os << "        return " << code.reader << "(" << number << ", " << code.def << ");\n";
+        }
+        os << "    }\n"
+           << "\n"
+           << "    bool has_" << f->name() << "() const\n"
+           << "    {\n"
+           << "        return has_field(" << number << ");\n"
+           << "    }\n";
+    }
+    os << "};\n\n";
+}
+
+void generate_traits(const Descriptor* d, std::ostream& os)
+{
+    for (int i = 0; i < d->nested_type_count(); ++i)
+    {
+        generate_traits(d->nested_type(i), os);
+    }
+
+    os << "template <>\n"
+       << "struct view_of<" << qualified_name(d) << ">\n"
+       << "{\n"
+       << "    using type = " << view_name(d) << ";\n"
+       << "};\n\n";
+}
+} // namespace anonymous
+
+int main(int argc, char** argv)
+{
+    if (argc != 4)
+    {
+        std::cerr << "Usage: protoserv_viewgen <descriptor set> <generated .pb.h include> <output header>\n";
+        return 1;
+    }
+
+    FileDescriptorSet set;
+    std::ifstream in(argv[1], std::ios::binary);
+    if (!set.ParseFromIstream(&in) || set.file_size() == 0)
+    {
+        std::cerr << "protoserv_viewgen: can't read the descriptor set " << argv[1] << "\n";
+        return 1;
+    }
+
+    DescriptorPool pool;
+    const FileDescriptor* file = nullptr;
+    for (auto& proto : set.file())
+    {
+        file = pool.BuildFile(proto);
+        if (!file)
+        {
+            std::cerr << "protoserv_viewgen: can't build " << proto.name() << "\n";
+            return 1;
+        }
+    }
+
+    std::ostringstream os;
+    os << "// Generated by protoserv_viewgen from " << file->name() << ", do not edit\n"
+       << "#pragma once\n\n"
+       << "#include \"wire_view.hpp\"\n"
+       << "#include \"" << argv[2] << "\"\n\n"
+       << "#include <string_view>\n"
+       << "#include <utility>\n\n";
+
+    auto ns = cpp_namespace(file->package());
+    if (!ns.empty())
+    {
+        os << "namespace " << ns << "\n{\n";
+    }
+    for (int i = 0; i < file->message_type_count(); ++i)
+    {
+        generate_view(file->message_type(i), os);
+    }
+    if (!ns.empty())
+    {
+        os << "} // namespace " << ns << "\n\n";
+    }
+
+    os << "namespace protoserv\n{\n";
+    for (int i = 0; i < file->message_type_count(); ++i)
+    {
+        generate_traits(file->message_type(i), os);
+    }
+    os << "} // namespace protoserv\n";
+
+    std::ofstream out(argv[3]);
+    out << os.str();
+    return out ? 0 : 1;
+}